@@ -1,25 +1,85 @@
 #ifndef BUFFER_H
 #define BUFFER_H
 
-#include <queue>
-#include <future>
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
 
 // Unlike channels in Go, we modularize buffer management
-template<typename T>
-class Buffer {
+// a buffer is a ring over cap slots that are allocated once by the constructor,
+// so push and pop never allocate. elements are constructed in place on push
+// and destroyed on pop, so T needs no default constructor.
+//
+// the slots come from a Slots type:
+//     HeapSlots<T, Alloc>     n slots from an allocator, n chosen at run time.
+//     InlineSlots<T, N>       N slots inside the object, so the capacity is a constant.
+
+// raw storage for n elements from Alloc. the owner constructs and destroys the elements.
+template<typename T, typename Alloc = std::allocator<T>>
+class HeapSlots {
+private:
+    using traits = std::allocator_traits<Alloc>;
+    [[no_unique_address]] Alloc alloc;
+    T* data;
+    size_t n;
+public:
+    explicit HeapSlots(size_t n = 0, const Alloc& a = Alloc())
+        : alloc(a), data(n > 0 ? traits::allocate(alloc, n) : nullptr), n(n) {}
+    HeapSlots(const HeapSlots&) = delete;
+    HeapSlots& operator=(const HeapSlots&) = delete;
+    ~HeapSlots() {
+        if (data) traits::deallocate(alloc, data, n);
+    }
+
+    void swap(HeapSlots& o) {
+        std::swap(data, o.data);
+        std::swap(n, o.n);
+    }
+
+    T* at(size_t i) {return data + i;}
+    size_t size() const {return n;}
+    const Alloc& allocator() const {return alloc;}
+};
+
+// raw storage for N elements inside the object.
+template<typename T, size_t N>
+class InlineSlots {
 private:
-    std::queue<T> q;
-    size_t cap;
+    alignas(T) unsigned char bytes[N * sizeof(T)];
+public:
+    template<typename... Args>
+    explicit InlineSlots(size_t = N, Args&&...) {}
+    InlineSlots(const InlineSlots&) = delete;
+    InlineSlots& operator=(const InlineSlots&) = delete;
+
+    T* at(size_t i) {return reinterpret_cast<T*>(bytes) + i;}
+    static constexpr size_t size() {return N;}
+};
+
+template<typename T, typename Slots>
+class Ring {
+protected:
+    // slot i is alive iff it is within [head, head + cur_size) modulo the capacity.
+    Slots slots;
+    size_t head{0};
     // cur_size is atomic to enable lock-free fast-track condition in chan_recv
     // note: ++, --, operator= on cur_size are atomic
     std::atomic<size_t> cur_size{0};
+
+    size_t index(size_t i) const {
+        size_t j = head + i;
+        return j < slots.size() ? j : j - slots.size();
+    }
 public:
-    explicit Buffer(size_t n = 0);
-    // Copy constructor
-    Buffer(const Buffer &b);
-    // Move constructor
-    Buffer(Buffer &&b);
+    // extra arguments (ex. an allocator) go to the Slots constructor.
+    template<typename... Args>
+    explicit Ring(size_t n = 0, Args&&... args);
+    ~Ring();
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
 
     // Copy push()
     void push(const T& elem);
@@ -33,57 +93,105 @@ public:
     bool is_full();
 };
 
-template<typename T>
-Buffer<T>::Buffer(size_t n) {
-    cap = n;
-}
-
-template<typename T>
-Buffer<T>::Buffer(const Buffer &b) : q(b.q), cap(b.cap), cur_size() {
-    cur_size = b.cur_size.load();
-}
+template<typename T, typename Slots>
+template<typename... Args>
+Ring<T, Slots>::Ring(size_t n, Args&&... args) : slots(n, std::forward<Args>(args)...) {}
 
-template<typename T>
-Buffer<T>::Buffer(Buffer &&b) : q(std::move(b.q)), cap(std::move(b.cap)), cur_size() {
-    cur_size = b.cur_size.exchange(0);
+template<typename T, typename Slots>
+Ring<T, Slots>::~Ring() {
+    while (cur_size > 0) {
+        pop();
+    }
 }
 
-template<typename T>
-void Buffer<T>::push(const T& elem) {
-    q.push(elem);
+template<typename T, typename Slots>
+void Ring<T, Slots>::push(const T& elem) {
+    std::construct_at(slots.at(index(cur_size)), elem);
     cur_size++;
 }
 
-template<typename T>
-void Buffer<T>::push(T&& elem) {
-    q.push(elem);
+template<typename T, typename Slots>
+void Ring<T, Slots>::push(T&& elem) {
+    std::construct_at(slots.at(index(cur_size)), std::move(elem));
     cur_size++;
 }
 
-template<typename T>
-T& Buffer<T>::front() {
-    return q.front();
+template<typename T, typename Slots>
+T& Ring<T, Slots>::front() {
+    return *slots.at(head);
 }
 
-template<typename T>
-void Buffer<T>::pop() {
-    q.pop();
+template<typename T, typename Slots>
+void Ring<T, Slots>::pop() {
+    std::destroy_at(slots.at(head));
+    head = index(1);
     cur_size--;
 }
 
-template<typename T>
-size_t Buffer<T>::current_size() {
+template<typename T, typename Slots>
+size_t Ring<T, Slots>::current_size() {
     return cur_size.load();
 }
 
-template<typename T>
-size_t Buffer<T>::capacity() {
-    return cap;
+template<typename T, typename Slots>
+size_t Ring<T, Slots>::capacity() {
+    return slots.size();
+}
+
+template<typename T, typename Slots>
+bool Ring<T, Slots>::is_full() {
+    return slots.size() == cur_size.load();
+}
+
+// the channel buffer: capacity chosen at run time, 0 for unbuffered channels.
+template<typename T, typename Alloc = std::allocator<T>>
+using Buffer = Ring<T, HeapSlots<T, Alloc>>;
+
+// capacity N known at compile time, so capacity checks fold away.
+template<typename T, size_t N>
+using FixedBuffer = Ring<T, InlineSlots<T, N>>;
+
+// never full: push doubles the slots when they run out, and they are kept after a drain,
+// so a channel allocates only while its high-water mark grows.
+template<typename T, typename Alloc = std::allocator<T>>
+class GrowableBuffer : public Ring<T, HeapSlots<T, Alloc>> {
+private:
+    using Base = Ring<T, HeapSlots<T, Alloc>>;
+    void grow();
+public:
+    explicit GrowableBuffer(size_t n = 0, const Alloc& a = Alloc()) : Base(n, a) {}
+
+    void push(const T& elem);
+    void push(T&& elem);
+
+    // reported as unlimited, so the channel never takes its unbuffered or full paths.
+    size_t capacity() {return SIZE_MAX;}
+    bool is_full() {return false;}
+};
+
+template<typename T, typename Alloc>
+void GrowableBuffer<T, Alloc>::grow() {
+    size_t n = this->slots.size();
+    HeapSlots<T, Alloc> bigger(n > 0 ? 2 * n : 16, this->slots.allocator());
+    for (size_t i = 0; i < n; ++i) {
+        T* p = this->slots.at(this->index(i));
+        std::construct_at(bigger.at(i), std::move(*p));
+        std::destroy_at(p);
+    }
+    this->slots.swap(bigger);
+    this->head = 0;
+}
+
+template<typename T, typename Alloc>
+void GrowableBuffer<T, Alloc>::push(const T& elem) {
+    if (this->cur_size == this->slots.size()) grow();
+    Base::push(elem);
 }
 
-template<typename T>
-bool Buffer<T>::is_full() {
-    return cap == cur_size.load();
+template<typename T, typename Alloc>
+void GrowableBuffer<T, Alloc>::push(T&& elem) {
+    if (this->cur_size == this->slots.size()) grow();
+    Base::push(std::move(elem));
 }
 
 #endif
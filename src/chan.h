@@ -2,16 +2,31 @@
 #define CHAN_H
 
 #include "buffer.h"
-
+#include "policies.h"
+#include "readiness.h"
+#include "tap.h"
+#include "trace.h"
+#include "watchdog.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
 #include <functional>
 #include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 
 // for simplicity, we inherit std::exception and not std::runtime_error for now.
 class ChannelClosedDuringSendException : public std::exception {
     const char* what() const noexcept override;
 };
 
-const char* ChannelClosedDuringSendException::what() const noexcept {
+inline const char* ChannelClosedDuringSendException::what() const noexcept {
     return "while waiting to send, the channel was closed by another thread";
 }
 
@@ -19,7 +34,7 @@ class ChannelClosedDuringRecvException : public std::exception {
     const char* what() const noexcept override;
 };
 
-const char* ChannelClosedDuringRecvException::what() const noexcept {
+inline const char* ChannelClosedDuringRecvException::what() const noexcept {
     return "while waiting to recv, the channel was closed by another thread";
 }
 
@@ -27,7 +42,7 @@ class ChannelDestructedDuringSendException : public std::exception {
     const char* what() const noexcept override;
 };
 
-const char* ChannelDestructedDuringSendException::what() const noexcept {
+inline const char* ChannelDestructedDuringSendException::what() const noexcept {
     return "while waiting to send, the channel was destructed";
 }
 
@@ -35,7 +50,7 @@ class ChannelDestructedDuringRecvException : public std::exception {
     const char* what() const noexcept override;
 };
 
-const char* ChannelDestructedDuringRecvException::what() const noexcept {
+inline const char* ChannelDestructedDuringRecvException::what() const noexcept {
     return "while waiting to recv, the channel was destructed";
 }
 
@@ -43,7 +58,7 @@ class SendOnClosedChannelException : public std::exception {
     const char* what() const noexcept override;
 };
 
-const char* SendOnClosedChannelException::what() const noexcept {
+inline const char* SendOnClosedChannelException::what() const noexcept {
     return "send on closed channel";
 }
 
@@ -51,171 +66,529 @@ class CloseOfClosedChannelException : public std::exception {
     const char* what() const noexcept override;
 };
 
-const char* CloseOfClosedChannelException::what() const noexcept {
+inline const char* CloseOfClosedChannelException::what() const noexcept {
     return "close of closed channel";
 }
 
+// outcome of a channel operation, for the noexcept API (send_status, try_send, recv_status, try_recv,
+// close_status). the throwing API is a thin wrapper that maps these to the exceptions above.
+enum class ChanStatus : uint8_t {
+    ok,                     // sent, received a value, or closed.
+    would_block,            // a nonblocking operation found no room, no value or no partner.
+    closed,                 // send or close on a closed channel, or recv on a closed and drained one.
+    closed_while_blocked,   // a blocked send was released by close().
+    destructed,             // a blocked operation was released by the channel's destructor.
+};
+
+inline const char* chan_status_name(ChanStatus s) {
+    switch (s) {
+        case ChanStatus::ok:                    return "ok";
+        case ChanStatus::would_block:           return "would_block";
+        case ChanStatus::closed:                return "closed";
+        case ChanStatus::closed_while_blocked:  return "closed_while_blocked";
+        default:                                return "destructed";
+    }
+}
+
+// exceptions of the throwing API. would_block is not an error, and neither is a recv on a closed channel.
+inline void throw_send_status(ChanStatus s) {
+    switch (s) {
+        case ChanStatus::closed:                throw SendOnClosedChannelException();
+        case ChanStatus::closed_while_blocked:  throw ChannelClosedDuringSendException();
+        case ChanStatus::destructed:            throw ChannelDestructedDuringSendException();
+        default:                                return;
+    }
+}
+
+inline void throw_recv_status(ChanStatus s) {
+    if (s == ChanStatus::destructed) throw ChannelDestructedDuringRecvException();
+}
+
+inline void throw_close_status(ChanStatus s) {
+    if (s == ChanStatus::closed) throw CloseOfClosedChannelException();
+}
+
+// the status API is noexcept when moving and copying T cannot throw,
 template<typename T>
-class ChanData {
-private:
-    // data buffer for buffered channels.
-    Buffer<T> buffer;
-    
-    // queues for waiting senders.
-    // sender creates a future-promise pair, pushes the promise to send_queue, 
-    // and waits until it get_value() from the future.
-    // a receiver pops from the send_queue, and set_value() the promise,
-    // thereby waking up the waiting sender.
-    std::queue<std::promise<void>> send_queue;
+constexpr bool nothrow_transfer = std::is_nothrow_move_constructible_v<T> && std::is_nothrow_move_assignable_v<T>
+    && (!std::is_copy_constructible_v<T> || std::is_nothrow_copy_constructible_v<T>)
+    && (!std::is_copy_assignable_v<T> || std::is_nothrow_copy_assignable_v<T>);
+// and neither the storage (ex. Unbounded growing) nor the instrument (ex. CHAN_TRACE buffers)
+// may allocate on the way, since a bad_alloc there would be std::terminate.
+template<typename T, typename Config>
+constexpr bool nothrow_ops = nothrow_transfer<T> && !Config::storage::allocates && !Config::instrument::allocates;
+
+// why a parked sender or receiver was released.
+enum class WakeReason : uint32_t {
+    waiting,        // still parked.
+    completed,      // the other side completed our send or recv.
+    closed,         // released by close().
+    destructed,     // released by ~ChanData().
+};
 
-    // sender passes the data of type T to the receiver thru sender_data_queue.
-    std::queue<T> send_data_queue;
+// the part of a parked thread that its waker touches: why it was released.
+struct Parker {
+    // links the sender's hand-off to this wake-up in CHAN_TRACE builds.
+    uint64_t flow_id{0};
+    std::atomic<WakeReason> state{WakeReason::waiting};
+
+    // called by the owner, without chan_lock. Wait is the channel's wait policy.
+    template<typename Wait>
+    WakeReason park() {
+        WakeReason r;
+        while ((r = state.load(std::memory_order_acquire)) == WakeReason::waiting) {
+            Wait::wait(state, WakeReason::waiting);
+        }
+        return r;
+    }
 
-    // same logic as send_promise_queue,
-    // but the data of type T is sent via promise, not a separate queue.
-    std::queue<std::promise<T>> recv_queue;
+    // called under chan_lock. once state is stored, the owner may return and pop this Waiter
+    // off its stack; notify_one() only uses the address of state to wake it, not the object.
+    template<typename Wait>
+    void wake(WakeReason r) {
+        state.store(r, std::memory_order_release);
+        if constexpr (Wait::notifies) state.notify_one();
+    }
+};
 
-    // is_closed is atomic to enable lock-free fast-track condition in chan_recv.
-    // note that assignment and operator= on cur_size are atomic.
-    std::atomic<bool> is_closed{false};
-    
-    std::mutex chan_lock;
+// where a receive puts its value: assigned to the caller's T (recv(T&)),
+// or constructed in the caller's optional (recv_optional()), so T needs no default constructor
+// and the value is built once, straight from the buffer slot or the sender.
+template<typename T>
+class RecvDst {
+private:
+    T* value{nullptr};
+    std::optional<T>* optional{nullptr};
+public:
+    explicit RecvDst(T& v) : value(&v) {
+        static_assert(std::is_move_assignable_v<T>, "recv(T&) assigns to dst; use recv_optional() for a non-assignable T");
+    }
+    explicit RecvDst(std::optional<T>& o) : optional(&o) {}
+
+    // exactly one of value and optional is set.
+    template<typename U>
+    void put(U&& v) {
+        if (value) {
+            if constexpr (std::is_assignable_v<T&, U&&>) {
+                *value = std::forward<U>(v);
+            } else if constexpr (std::is_move_assignable_v<T>) {
+                // a copy into a T that is only move-assignable (RecvDst(T&) requires that much).
+                *value = T(std::forward<U>(v));
+            }
+        } else {
+            optional->emplace(std::forward<U>(v));
+        }
+    }
+};
 
-    bool chan_send(const T& src, bool is_blocking);
-    std::pair<bool, bool> chan_recv(T& dst, bool is_blocking);
+// a thread parked on a channel, like sudog in Go's runtime.
+// a Waiter lives on the parked thread's stack and is linked into the channel's WaitQueue,
+// so blocking does not allocate (unlike the promise/future pair it replaces).
+template<typename T>
+struct Waiter : Parker {
+    // from chan.go: elem points to the sender's value or the receiver's destination,
+    // which stay valid because their owner is parked.
+    const T* src{nullptr};
+    RecvDst<T>* dst{nullptr};
+    // src may be moved from (the sender called send(T&&)).
+    bool movable{false};
+    Waiter* next{nullptr};
+
+    // copy or move the parked sender's value.
+    // a move-only T can only have been sent by send(T&&), so the copy is never needed.
+    void take(RecvDst<T>& out) {
+        if constexpr (std::is_copy_constructible_v<T>) {
+            if (!movable) {
+                out.put(*src);
+                return;
+            }
+        }
+        out.put(std::move(*const_cast<T*>(src)));
+    }
+    template<typename B>
+    void take(B& buffer) {
+        if constexpr (std::is_copy_constructible_v<T>) {
+            if (!movable) {
+                buffer.push(*src);
+                return;
+            }
+        }
+        buffer.push(std::move(*const_cast<T*>(src)));
+    }
+    // call f on the parked sender's value: in place if it may be moved from, else on a copy.
+    template<typename F>
+    void visit(F& f) {
+        if constexpr (std::is_copy_constructible_v<T>) {
+            if (!movable) {
+                T copy(*src);
+                f(copy);
+                return;
+            }
+        }
+        f(*const_cast<T*>(src));
+    }
+};
 
+// intrusive FIFO of parked waiters (Waiter<T>, or anything with a next pointer).
+// all methods except empty() are called under chan_lock.
+template<typename W>
+class WaitQueue {
+private:
+    W* first{nullptr};
+    W* last{nullptr};
+    // atomic so the lock-free fast paths can ask empty().
+    std::atomic<size_t> n{0};
 public:
-    explicit ChanData(size_t n = 0);
+    bool empty() const {return n.load(std::memory_order_relaxed) == 0;}
+
+    void push(W* w) {
+        w->next = nullptr;
+        if (last) last->next = w;
+        else first = w;
+        last = w;
+        n.store(n.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
 
-    // destructor is required to release the promises before destruction of queues.
-    // while user definition of Destructor calls for user definition of copy and move,
-    // we forgo because only the Chan wrapper class should access ChanData,
-    // and therefore copy and move are never called.
-    ~ChanData();
+    W* pop() {
+        W* w = first;
+        first = w->next;
+        if (!first) last = nullptr;
+        n.store(n.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        return w;
+    }
+};
+
+using DefaultChanConfig = chan_policy::make_config<>::type;
 
+// the public operations of a channel of T, built on the backend's (Derived's)
+//     ChanStatus chan_send(U&& src, bool is_blocking)     U is const T& or T
+//     ChanStatus chan_recv(RecvDst<T> dst, bool is_blocking)
+//     ChanStatus chan_close()
+//     ChanStatus chan_recv_with(F& f, bool is_blocking)   calls f(T&) on the element, then destroys it
+// so every backend has the same throwing and status APIs. the status API is noexcept(Nothrow).
+template<typename Derived, typename T, bool Nothrow = nothrow_transfer<T>>
+class ChanOps {
+private:
+    Derived& self() {return static_cast<Derived&>(*this);}
+public:
     // blocking send (ex. chan <- 1) does not return a boolean
-    void send(const T& src);
+    void send(const T& src)                 {throw_send_status(self().chan_send(src, true));}
+    // move-in send, for move-only and expensive-to-copy types.
+    void send(T&& src)                      {throw_send_status(self().chan_send(std::move(src), true));}
 
     // return value indicates whether the communication succeeded
     // the value is true if the value received was delivered by a successful send operation to the channel,
     // or false if it is a zero value generated because the channel is closed and empty
-    bool recv(T& dst);
+    bool recv(T& dst) {
+        ChanStatus s = self().chan_recv(RecvDst<T>(dst), true);
+        throw_recv_status(s);
+        return s == ChanStatus::ok;
+    }
     // Assignment recv
-    T recv();
+    T recv() {
+        std::optional<T> temp = recv_optional();
+        return temp ? std::move(*temp) : T();
+    }
+    // the received value, or nullopt once the channel is closed and drained.
+    // unlike recv(), T need not be default-constructible or assignable.
+    std::optional<T> recv_optional() {
+        std::optional<T> dst;
+        throw_recv_status(self().chan_recv(RecvDst<T>(dst), true));
+        return dst;
+    }
 
     // non-blocking versions of send and recv.
     // we expose the non-blocking versions to the user,
     // who can combine them in if/else block to simulate the select stmt.
     // the return values indicate whether the send or recv was successful.
-    bool send_nonblocking(const T& src);
-    bool recv_nonblocking(T& dst);
+    bool send_nonblocking(const T& src) {
+        ChanStatus s = self().chan_send(src, false);
+        throw_send_status(s);
+        return s == ChanStatus::ok;
+    }
+    // src is left untouched if the send fails.
+    bool send_nonblocking(T&& src) {
+        ChanStatus s = self().chan_send(std::move(src), false);
+        throw_send_status(s);
+        return s == ChanStatus::ok;
+    }
+    // true if selected: a value was received, or the channel is closed and drained.
+    bool recv_nonblocking(T& dst) {
+        return self().chan_recv(RecvDst<T>(dst), false) != ChanStatus::would_block;
+    }
+    // nullopt if no value is ready (or the channel is closed and drained).
+    std::optional<T> recv_nonblocking_optional() {
+        std::optional<T> dst;
+        self().chan_recv(RecvDst<T>(dst), false);
+        return dst;
+    }
+
+    // status API: the same operations, reporting failures as a ChanStatus instead of throwing.
+    // try_ variants never block.
+    ChanStatus send_status(const T& src) noexcept(Nothrow)  {return self().chan_send(src, true);}
+    ChanStatus send_status(T&& src) noexcept(Nothrow)       {return self().chan_send(std::move(src), true);}
+    ChanStatus try_send(const T& src) noexcept(Nothrow)     {return self().chan_send(src, false);}
+    ChanStatus try_send(T&& src) noexcept(Nothrow)          {return self().chan_send(std::move(src), false);}
+    ChanStatus recv_status(T& dst) noexcept(Nothrow)        {return self().chan_recv(RecvDst<T>(dst), true);}
+    ChanStatus recv_status(std::optional<T>& dst) noexcept(Nothrow) {
+        return self().chan_recv(RecvDst<T>(dst), true);
+    }
+    ChanStatus try_recv(T& dst) noexcept(Nothrow)           {return self().chan_recv(RecvDst<T>(dst), false);}
+    ChanStatus try_recv(std::optional<T>& dst) noexcept(Nothrow) {
+        return self().chan_recv(RecvDst<T>(dst), false);
+    }
 
     // for-each semantics
-    void foreach(std::function<void(T)> f);
+    void foreach(std::function<void(T)> f) {
+        while (std::optional<T> cur_data = recv_optional()) {
+            f(std::move(*cur_data));
+        }
+    }
 
-    // Prevent sending to the channel
-    void close();
+    // receive by calling f(T&) on the element where it lies, usually its buffer slot, then
+    // destroying it there; nothing is copied or moved out. the element is consumed even if f throws.
+    // returns false, without calling f, once the channel is closed and drained.
+    // the lock-based backend holds chan_lock while f runs, so f must be short and must not use
+    // this channel; the Spsc backend calls f without a lock.
+    template<typename F>
+    bool recv_with(F&& f) {
+        ChanStatus s = self().chan_recv_with(f, true);
+        throw_recv_status(s);
+        return s == ChanStatus::ok;
+    }
+    // nonblocking; would_block, closed, or ok once f was called.
+    template<typename F>
+    ChanStatus try_recv_with(F&& f)         {return self().chan_recv_with(f, false);}
+    // foreach() with recv_with(): f(T&) on every element until the channel is closed and drained.
+    template<typename F>
+    void drain_with(F&& f) {
+        while (recv_with(f)) {}
+    }
 
+    // Prevent sending to the channel
+    void close()                            {throw_close_status(self().chan_close());}
+    ChanStatus close_status() noexcept      {return self().chan_close();}
 };
 
-template<typename T>
-ChanData<T>::ChanData(size_t n) : buffer(n) {};
 
-template<typename T>
-ChanData<T>::~ChanData() {
-    // release all receivers.
-    // unlike ChannelClosedDuringRecvException, 
-    // ChannelDestructedDuringRecvException is rethrown by the receiver.
-    while (!recv_queue.empty()) {
-        recv_queue.front().set_exception(std::make_exception_ptr(ChannelDestructedDuringRecvException()));
-        recv_queue.pop();
+// the lock-based channel: any number of senders and receivers (sync policy Mutex or Spinlock).
+template<typename T, typename Config = DefaultChanConfig>
+class ChanData : public ChanOps<ChanData<T, Config>, T, nothrow_ops<T, Config>> {
+private:
+    friend class ChanOps<ChanData<T, Config>, T, nothrow_ops<T, Config>>;
+    using Wait = typename Config::wait;
+
+    // data buffer for buffered channels.
+    typename Config::template buffer_type<T> buffer;
+
+    // queues of parked senders and receivers.
+    // a parked sender's Waiter points at the value it is sending;
+    // a receiver pops it, takes the value, and wakes the sender.
+    // a parked receiver's Waiter points at its destination;
+    // a sender pops it, stores the value there directly, and wakes the receiver.
+    WaitQueue<Waiter<T>> send_queue;
+    WaitQueue<Waiter<T>> recv_queue;
+
+    // is_closed is atomic to enable lock-free fast-track condition in chan_recv.
+    // note that assignment and operator= on cur_size are atomic.
+    std::atomic<bool> is_closed{false};
+    
+    typename Config::sync::lock_type chan_lock;
+
+    [[no_unique_address]] typename Config::instrument instrument;
+
+    // told about readiness changes, under chan_lock; see readiness.h. eventfds is the observer
+    // made by recv_fd() and send_fd() (Linux only).
+    ReadinessObserver* observer{nullptr};
+#ifdef __linux__
+    std::unique_ptr<EventFdReadiness> eventfds;
+#endif
+
+    // sees each send that goes through, under chan_lock; see tap.h.
+    SendTap<T>* tap{nullptr};
+
+    bool recv_ready() {return buffer.current_size() > 0 || !send_queue.empty() || is_closed;}
+    bool send_ready() {return is_closed || !recv_queue.empty() || (buffer.capacity() > 0 && !buffer.is_full());}
+    // called under chan_lock after every change of the buffer, the queues or is_closed.
+    void readiness_changed() {
+        if (observer) observer->update(recv_ready(), send_ready());
     }
 
-    // release all senders.
-    while (!send_queue.empty()) {
-        send_queue.front().set_exception(std::make_exception_ptr(ChannelDestructedDuringSendException()));
-        send_queue.pop();
-        send_data_queue.pop();
+    // U is const T& or T; the value is only copied or moved from once the send succeeds.
+    template<typename U>
+    ChanStatus chan_send(U&& src, bool is_blocking) noexcept(nothrow_ops<T, Config>);
+    ChanStatus chan_recv(RecvDst<T> dst, bool is_blocking) noexcept(nothrow_ops<T, Config>);
+    ChanStatus chan_close() noexcept;
+    template<typename F>
+    ChanStatus chan_recv_with(F& f, bool is_blocking);
+
+public:
+    // args (ex. SpillOptions) go to the buffer.
+    template<typename... Args>
+    explicit ChanData(size_t n = 0, Args&&... args);
+
+    // destructor is required to release the parked threads before destruction of queues.
+    // while user definition of Destructor calls for user definition of copy and move,
+    // we forgo because only the Chan wrapper class should access ChanData,
+    // and therefore copy and move are never called.
+    ~ChanData();
+
+    // send, recv, their nonblocking and status variants, foreach and close come from ChanOps.
+
+    // sets (or with nullptr, removes) the one readiness observer, which is told the current
+    // readiness right away. throws std::logic_error if recv_fd() or send_fd() made one.
+    void set_observer(ReadinessObserver* o);
+#ifdef __linux__
+    // eventfds for event loops, made on first use; see EventFdReadiness.
+    int recv_fd();
+    int send_fd();
+#endif
+
+    // sets (or with nullptr, removes) the one send tap. once set_tap() returns, no send is
+    // still in the tap's sent().
+    void set_tap(SendTap<T>* t) {
+        std::unique_lock<typename Config::sync::lock_type> lck{chan_lock};
+        tap = t;
     }
-}
 
-template<typename T>
-void ChanData<T>::send(const T& src) {
-    chan_send(src, true);
-}
+    const typename Config::instrument& instrumentation() const {return instrument;}
+    const typename Config::template buffer_type<T>& storage() const {return buffer;}
+};
 
-template<typename T>
-T ChanData<T>::recv() {
-    T temp;
-    recv(temp);
-    return temp;
+template<typename T, typename Config>
+template<typename... Args>
+ChanData<T, Config>::ChanData(size_t n, Args&&... args) : buffer(n, std::forward<Args>(args)...) {};
+
+template<typename T, typename Config>
+void ChanData<T, Config>::set_observer(ReadinessObserver* o) {
+    std::unique_lock<typename Config::sync::lock_type> lck{chan_lock};
+#ifdef __linux__
+    if (eventfds) {
+        throw std::logic_error("the channel's readiness is already observed by its eventfds");
+    }
+#endif
+    observer = o;
+    readiness_changed();
 }
 
-template<typename T>
-bool ChanData<T>::recv(T& dst) {
-    std::pair<bool, bool> selected_received = chan_recv(dst, true);
-    return selected_received.second;
+#ifdef __linux__
+template<typename T, typename Config>
+int ChanData<T, Config>::recv_fd() {
+    std::unique_lock<typename Config::sync::lock_type> lck{chan_lock};
+    if (!eventfds) {
+        if (observer) {
+            throw std::logic_error("the channel already has a readiness observer");
+        }
+        eventfds = std::make_unique<EventFdReadiness>();
+        observer = eventfds.get();
+        readiness_changed();
+    }
+    return eventfds->recv_fd();
 }
 
-template<typename T>
-bool ChanData<T>::send_nonblocking(const T& src) {
-    return chan_send(src, false);
+template<typename T, typename Config>
+int ChanData<T, Config>::send_fd() {
+    recv_fd();
+    return eventfds->send_fd();
 }
+#endif
 
-template<typename T>
-bool ChanData<T>::recv_nonblocking(T& dst) {
-    std::pair<bool, bool> selected_received = chan_recv(dst, false);
-    return selected_received.first;
+template<typename T, typename Config>
+ChanData<T, Config>::~ChanData() {
+    // release all receivers.
+    // unlike a close(), the receiver throws ChannelDestructedDuringRecvException.
+    while (!recv_queue.empty()) {
+        Waiter<T>* w = recv_queue.pop();
+        instrument.handoff(this, w->flow_id);
+        w->template wake<Wait>(WakeReason::destructed);
+    }
+
+    // release all senders. they throw ChannelDestructedDuringSendException.
+    while (!send_queue.empty()) {
+        Waiter<T>* w = send_queue.pop();
+        instrument.handoff(this, w->flow_id);
+        w->template wake<Wait>(WakeReason::destructed);
+    }
 }
 
-template<typename T>
-bool ChanData<T>::chan_send(const T& src, bool is_blocking) {
+template<typename T, typename Config>
+template<typename U>
+ChanStatus ChanData<T, Config>::chan_send(U&& src, bool is_blocking) noexcept(nothrow_ops<T, Config>) {
+    auto trace = instrument.scope(this, chan_trace::Kind::send, is_blocking);
+
     // Fast path: check for failed non-blocking operation without acquiring the lock.
     if (!is_blocking
         && !is_closed
-        && ((buffer.capacity() == 0 && recv_queue.empty()) || (buffer.capacity() > 0 && buffer.is_full())))
-        return false;
+        && ((buffer.capacity() == 0 && recv_queue.empty()) || (buffer.capacity() > 0 && buffer.is_full()))) {
+        trace.failed();
+        return ChanStatus::would_block;
+    }
 
-    // scoped_lock can't be used b/c we must .unlock() prior to future.get()
-    std::unique_lock<std::mutex> lck{chan_lock};
+    // scoped_lock can't be used b/c we must .unlock() prior to parking
+    std::unique_lock<typename Config::sync::lock_type> lck{chan_lock};
 
     // sending to a closed channel is an error.
     if (is_closed) {
-        throw SendOnClosedChannelException();
+        return ChanStatus::closed;
+    }
+
+    // the send is delivered below, or parks; only a failed nonblocking send is not tapped.
+    if (tap && (is_blocking || !recv_queue.empty() || !buffer.is_full())) {
+        tap->sent(std::as_const(src));
     }
 
     // if a waiting receiver exists,
     // pass the value we want to send directly to the receiver,
     // bypassing the buffer (if any).
     if (!recv_queue.empty()) {
-        recv_queue.front().set_value(src);
-        recv_queue.pop();
-        return true;
+        Waiter<T>* w = recv_queue.pop();
+        w->dst->put(std::forward<U>(src));
+        instrument.handoff(this, w->flow_id);
+        w->template wake<Wait>(WakeReason::completed);
+        readiness_changed();
+        return ChanStatus::ok;
     }
 
     // if space is available in the buffer, enqueue the element to send.
     if (!buffer.is_full()) {
-        buffer.push(src);
-        return true;
+        buffer.push(std::forward<U>(src));
+        readiness_changed();
+        return ChanStatus::ok;
     }
 
     // if not blocking (select stmt), return false.
     if (!is_blocking) {
-        return false;
+        trace.failed();
+        return ChanStatus::would_block;
     }
 
     // block on the channel. Some receiver will complete our operation for us.
-    std::promise<void> promise;
-    std::future<void> future = promise.get_future();
-    send_queue.push(std::move(promise));
-    send_data_queue.push(src);
+    Waiter<T> w;
+    w.src = &src;
+    w.movable = !std::is_lvalue_reference_v<U>;
+    w.flow_id = instrument.new_flow_id();
+    send_queue.push(&w);
+    uint64_t parked_at = trace.parking();
+    readiness_changed();
 
     lck.unlock();
 
-    // if close() passes an exception, rethrow to user.
-    future.get();
+    WakeReason reason;
+    {
+        [[maybe_unused]] auto parked = instrument.parked(this, chan_watchdog::Op::send);
+        reason = w.template park<Wait>();
+    }
+    trace.woken(w.flow_id, parked_at);
 
-    return true;
+    // By Go semantics, a close() while we wait is an error.
+    if (reason == WakeReason::closed) {
+        return ChanStatus::closed_while_blocked;
+    }
+    if (reason == WakeReason::destructed) {
+        return ChanStatus::destructed;
+    }
+
+    return ChanStatus::ok;
 }
 
 // receives on channel c and writes the received data to dst.
@@ -224,8 +597,10 @@ bool ChanData<T>::chan_send(const T& src, bool is_blocking) {
 // else, fills in dst with an element and returns (true, true).
 // A non-nil dst must refer to the heap or the caller's stack.
 // two bools in a pair are (selected, received).
-template<typename T>
-std::pair<bool, bool> ChanData<T>::chan_recv(T& dst, bool is_blocking) {
+template<typename T, typename Config>
+ChanStatus ChanData<T, Config>::chan_recv(RecvDst<T> dst, bool is_blocking) noexcept(nothrow_ops<T, Config>) {
+    auto trace = instrument.scope(this, chan_trace::Kind::recv, is_blocking);
+
     // from chan.go:
     // Fast path: check for failed non-blocking operation without acquiring the lock.
     // The order of operations is important here: reversing the operations can lead to
@@ -236,14 +611,16 @@ std::pair<bool, bool> ChanData<T>::chan_recv(T& dst, bool is_blocking) {
     if (!is_blocking
         && ((buffer.capacity() == 0 && send_queue.empty()) || (buffer.capacity() > 0 && buffer.current_size() == 0))
         && !is_closed) {
-        return std::pair<bool, bool>(false, false);
+        trace.failed();
+        return ChanStatus::would_block;
     }
 
-    std::unique_lock<std::mutex> lck{chan_lock};
+    std::unique_lock<typename Config::sync::lock_type> lck{chan_lock};
 
     // else if c is closed, returns (true, false).
     if (is_closed && buffer.current_size() == 0) {
-        return std::pair<bool, bool>(true, false);
+        trace.failed();
+        return ChanStatus::closed;
     }
 
     // from chan.go:
@@ -252,109 +629,1009 @@ std::pair<bool, bool> ChanData<T>::chan_recv(T& dst, bool is_blocking) {
     // (both map to the same buffer slot because the queue (buffer) is full,
     // i.e. if buffer was not full, no sender would be waiting)
     if (!send_queue.empty()) {
+        Waiter<T>* w = send_queue.pop();
         if (buffer.capacity() == 0) {
-            dst = send_data_queue.front();
+            w->take(dst);
         } else {
-            dst = buffer.front();
+            dst.put(std::move(buffer.front()));
             buffer.pop();
-            buffer.push(send_data_queue.front());
+            w->take(buffer);
         }
-        send_queue.front().set_value(); // sender is unblocked.
-        send_data_queue.pop();
-        send_queue.pop();
-        return std::pair<bool, bool>(true, true);
+        instrument.handoff(this, w->flow_id);
+        w->template wake<Wait>(WakeReason::completed); // sender is unblocked.
+        readiness_changed();
+        return ChanStatus::ok;
     }
 
     // if buffer is not empty, recv from buffer.
     if (buffer.current_size() > 0) {
-        dst = buffer.front();
+        dst.put(std::move(buffer.front()));
         buffer.pop();
-        return std::pair<bool, bool>(true, true);
+        readiness_changed();
+        return ChanStatus::ok;
     }
 
     // if not blocking (select stmt), return false.
     if (!is_blocking) {
-        return std::pair<bool, bool>(false, true);
+        trace.failed();
+        return ChanStatus::would_block;
     }
 
-    // block on the channel.
-    std::promise<T> promise;
-    std::future<T> future = promise.get_future();
-    recv_queue.push(std::move(promise));
+    // block on the channel. Some sender will store into dst for us.
+    Waiter<T> w;
+    w.dst = &dst;
+    w.flow_id = instrument.new_flow_id();
+    recv_queue.push(&w);
+    uint64_t parked_at = trace.parking();
+    readiness_changed();
 
     lck.unlock();
 
-    try {
-        // if close() passes exception, dst is not set, because future.get() throws the exception.
-        dst = future.get();
-    } 
-    catch (ChannelClosedDuringRecvException) {
-        // ignore exception passed by close(), b/c !is_closed indicator is returned to user.
+    WakeReason reason;
+    {
+        [[maybe_unused]] auto parked = instrument.parked(this, chan_watchdog::Op::recv);
+        reason = w.template park<Wait>();
+    }
+    trace.woken(w.flow_id, parked_at);
+
+    if (reason == WakeReason::destructed) {
+        return ChanStatus::destructed;
     }
 
-    return std::pair<bool, bool>(true, !is_closed);
+    // if close() released us, dst is not set, and the !received indicator is returned to user.
+    return reason == WakeReason::completed ? ChanStatus::ok : ChanStatus::closed;
 }
 
-template<typename T>
-void ChanData<T>::foreach(std::function<void(T)> f){
-    T cur_data;
-    bool received = recv(cur_data);
-    while (received) {
-        f(cur_data);
-        received = recv(cur_data);
+// chan_recv, but f is called on the element instead of moving it to a destination.
+template<typename T, typename Config>
+template<typename F>
+ChanStatus ChanData<T, Config>::chan_recv_with(F& f, bool is_blocking) {
+    auto trace = instrument.scope(this, chan_trace::Kind::recv, is_blocking);
+
+    if (!is_blocking
+        && ((buffer.capacity() == 0 && send_queue.empty()) || (buffer.capacity() > 0 && buffer.current_size() == 0))
+        && !is_closed) {
+        trace.failed();
+        return ChanStatus::would_block;
+    }
+
+    std::unique_lock<typename Config::sync::lock_type> lck{chan_lock};
+
+    if (is_closed && buffer.current_size() == 0) {
+        trace.failed();
+        return ChanStatus::closed;
+    }
+
+    // unbuffered: f sees the parked sender's value, and the sender is released after f returns.
+    if (buffer.capacity() == 0 && !send_queue.empty()) {
+        Waiter<T>* w = send_queue.pop();
+        auto release = [&]() {
+            instrument.handoff(this, w->flow_id);
+            w->template wake<Wait>(WakeReason::completed);
+            readiness_changed();
+        };
+        try {
+            w->visit(f);
+        } catch (...) {
+            release();
+            throw;
+        }
+        release();
+        return ChanStatus::ok;
+    }
+
+    // buffered: f sees the head slot. popping it makes room for a parked sender, if any.
+    if (buffer.current_size() > 0) {
+        auto pop = [&]() {
+            buffer.pop();
+            if (!send_queue.empty()) {
+                Waiter<T>* w = send_queue.pop();
+                w->take(buffer);
+                instrument.handoff(this, w->flow_id);
+                w->template wake<Wait>(WakeReason::completed);
+            }
+            readiness_changed();
+        };
+        try {
+            f(buffer.front());
+        } catch (...) {
+            pop();
+            throw;
+        }
+        pop();
+        return ChanStatus::ok;
+    }
+
+    if (!is_blocking) {
+        trace.failed();
+        return ChanStatus::would_block;
+    }
+
+    // nothing to read in place: park like chan_recv, then call f outside the lock.
+    std::optional<T> value;
+    RecvDst<T> dst(value);
+    Waiter<T> w;
+    w.dst = &dst;
+    w.flow_id = instrument.new_flow_id();
+    recv_queue.push(&w);
+    uint64_t parked_at = trace.parking();
+    readiness_changed();
+
+    lck.unlock();
+
+    WakeReason reason;
+    {
+        [[maybe_unused]] auto parked = instrument.parked(this, chan_watchdog::Op::recv);
+        reason = w.template park<Wait>();
+    }
+    trace.woken(w.flow_id, parked_at);
+
+    if (reason == WakeReason::destructed) {
+        return ChanStatus::destructed;
     }
+    if (reason != WakeReason::completed) {
+        return ChanStatus::closed;
+    }
+    f(*value);
+    return ChanStatus::ok;
 }
 
-template<typename T>
-void ChanData<T>::close(){
-    std::unique_lock<std::mutex> lck{chan_lock};
+template<typename T, typename Config>
+ChanStatus ChanData<T, Config>::chan_close() noexcept {
+    [[maybe_unused]] auto trace = instrument.scope(this, chan_trace::Kind::close);
+    std::unique_lock<typename Config::sync::lock_type> lck{chan_lock};
 
     if (is_closed) {
-        throw CloseOfClosedChannelException();
+        return ChanStatus::closed;
     }
 
     is_closed = true;
 
-    // release all receivers.
+    // release all receivers. they return false, without throwing.
     while (!recv_queue.empty()) {
-        // the waiting receiver should not throw this exception.
-        recv_queue.front().set_exception(std::make_exception_ptr(ChannelClosedDuringRecvException()));
-        recv_queue.pop();
+        Waiter<T>* w = recv_queue.pop();
+        instrument.handoff(this, w->flow_id);
+        w->template wake<Wait>(WakeReason::closed);
     }
 
     // release all senders.
-    // By Go semantics, senders should throw exception to users.
+    // By Go semantics, senders should throw ChannelClosedDuringSendException to users.
     while (!send_queue.empty()) {
-        // the waiting sender should rethrow this exception.
-        send_queue.front().set_exception(std::make_exception_ptr(ChannelClosedDuringSendException()));
-        send_queue.pop();
-        send_data_queue.pop();
+        Waiter<T>* w = send_queue.pop();
+        instrument.handoff(this, w->flow_id);
+        w->template wake<Wait>(WakeReason::closed);
     }
+
+    readiness_changed();
+    return ChanStatus::ok;
 }
 
-template<typename T>
-class Chan {
+// a blocked side of an SPSC channel sleeps on an eventcount: it announces itself,
+// re-checks its condition, and only then waits. the other side pays for a wake-up
+// only when the flag says someone is (about to be) asleep.
+template<typename Wait>
+class EventCount {
 private:
-    std::shared_ptr<ChanData<T>> chan_data_shared_ptr;
+    std::atomic<uint32_t> epoch{0};
+    std::atomic<bool> waiting{false};
 public:
-    Chan(size_t n = 0) : chan_data_shared_ptr(new ChanData<T>(n)) {}
+    // returns the epoch to pass to wait(). the caller must re-check its condition after this.
+    uint32_t prepare() {
+        waiting.store(true, std::memory_order_seq_cst);
+        return epoch.load(std::memory_order_seq_cst);
+    }
+    void cancel() {
+        waiting.store(false, std::memory_order_relaxed);
+    }
+    void wait(uint32_t e) {
+        Wait::wait(epoch, e);
+        waiting.store(false, std::memory_order_relaxed);
+    }
+
+    // called after publishing the change the waiter is waiting for.
+    void notify() {
+        // pairs with the seq_cst store in prepare(): either we see waiting,
+        // or the waiter's re-check sees our change.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed)) wake();
+    }
+    void wake() {
+        waiting.store(false, std::memory_order_relaxed);
+        epoch.fetch_add(1, std::memory_order_release);
+        if constexpr (Wait::notifies) epoch.notify_all();
+    }
+};
+
+// two-phase send: a slot of a channel's ring, held by the sender to construct an element
+// in place, so a large element is written once instead of built locally and then copied in.
+//     auto slot = chan.reserve();      // waits for a free slot, like send()
+//     read_frame(slot.fill());         // or slot.emplace(args...)
+//     slot.commit();                   // the element is now sent
+// destroying a SendSlot before commit() abandons it: nothing is sent, an element constructed
+// in it is destroyed, and the slot is reused by the next send or reserve.
+// a SendSlot must not outlive its channel, and the sender holds at most one and does not
+// send() while it does.
+template<typename T, typename Data>
+class SendSlot {
+private:
+    friend Data;
+    Data* chan{nullptr};
+    T* slot{nullptr};
+    bool constructed{false};
+    ChanStatus s;
+
+    SendSlot(Data* c, T* p, ChanStatus s) : chan(c), slot(p), s(s) {}
+    void abandon() noexcept;
+public:
+    SendSlot(SendSlot&& o) noexcept : chan(o.chan), slot(std::exchange(o.slot, nullptr)), constructed(o.constructed), s(o.s) {}
+    SendSlot& operator=(SendSlot&&) = delete;
+    ~SendSlot() {abandon();}
+
+    // whether a slot is held; if not, status() says why (would_block or closed).
+    explicit operator bool() const {return slot != nullptr;}
+    ChanStatus status() const {return s;}
+
+    // constructs the element in the slot, replacing one constructed before.
+    template<typename... Args>
+    T& emplace(Args&&... args);
+    // default-initializes the element (for a trivial T, leaves the bytes as they are)
+    // for the caller to write in place.
+    T& fill();
+    T& operator*()  {assert(constructed); return *slot;}
+    T* operator->() {assert(constructed); return slot;}
+
+    // sends the element. if the channel was closed since reserve(), the element is destroyed
+    // instead, and commit() throws SendOnClosedChannelException (commit_status() returns closed).
+    void commit()                   {throw_send_status(commit_status());}
+    ChanStatus commit_status() noexcept;
+};
+
+template<typename T, typename Data>
+template<typename... Args>
+T& SendSlot<T, Data>::emplace(Args&&... args) {
+    assert(slot);
+    if (constructed) std::destroy_at(slot);
+    constructed = false;
+    std::construct_at(slot, std::forward<Args>(args)...);
+    constructed = true;
+    return *slot;
+}
+
+template<typename T, typename Data>
+T& SendSlot<T, Data>::fill() {
+    assert(slot);
+    if (constructed) std::destroy_at(slot);
+    constructed = false;
+    ::new (static_cast<void*>(slot)) T;
+    constructed = true;
+    return *slot;
+}
+
+template<typename T, typename Data>
+ChanStatus SendSlot<T, Data>::commit_status() noexcept {
+    assert(slot && constructed);
+    s = chan->chan_commit();
+    slot = nullptr;
+    return s;
+}
+
+template<typename T, typename Data>
+void SendSlot<T, Data>::abandon() noexcept {
+    if (!slot) return;
+    if (constructed) std::destroy_at(slot);
+    slot = nullptr;
+    chan->chan_abandon();
+}
+
+// two-phase receive: the element at the head of a channel, read in place by the receiver.
+// release() destroys it in its slot and frees the slot for the sender.
+// destroying a RecvSlot before release() leaves the element at the head, to be received
+// by the next recv or peek. a RecvSlot must not outlive its channel, and the receiver holds
+// at most one and does not recv() while it does.
+// buffered elements survive close(), so a RecvSlot stays valid across it.
+template<typename T, typename Data>
+class RecvSlot {
+private:
+    friend Data;
+    Data* chan{nullptr};
+    T* elem{nullptr};
+    ChanStatus s;
+
+    RecvSlot(Data* c, T* p, ChanStatus s) : chan(c), elem(p), s(s) {}
+public:
+    RecvSlot(RecvSlot&& o) noexcept : chan(o.chan), elem(std::exchange(o.elem, nullptr)), s(o.s) {}
+    RecvSlot& operator=(RecvSlot&&) = delete;
+    ~RecvSlot() {
+        if (elem) chan->chan_unpeek();
+    }
+
+    // whether an element is held; if not, status() says why (would_block, or closed once drained).
+    explicit operator bool() const {return elem != nullptr;}
+    ChanStatus status() const {return s;}
+
+    T& operator*()  {assert(elem); return *elem;}
+    T* operator->() {assert(elem); return elem;}
+
+    void release() noexcept {
+        assert(elem);
+        chan->chan_release();
+        elem = nullptr;
+    }
+};
+
+// the lock-free channel for exactly one sender thread and one receiver thread (sync policy Spsc).
+// the buffer is a ring indexed by two counters that only grow: the sender owns tail,
+// the receiver owns head, and tail - head is the number of buffered elements.
+// there is no rendezvous mode, so the capacity must be positive.
+template<typename T, typename Config>
+class SpscChanData : public ChanOps<SpscChanData<T, Config>, T, nothrow_ops<T, Config>> {
+private:
+    friend class ChanOps<SpscChanData<T, Config>, T, nothrow_ops<T, Config>>;
+    using Wait = typename Config::wait;
+
+    typename Config::storage::template slots<T, typename Config::template allocator_type<T>> slots;
+
+    // written by the sender and by the receiver respectively; on separate cache lines
+    // so that neither side's writes invalidate the line the other side writes.
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<bool> is_closed{false};
+    EventCount<Wait> not_empty;
+    EventCount<Wait> not_full;
+
+    [[no_unique_address]] typename Config::instrument instrument;
+
+    // set while the sender holds a SendSlot and the receiver a RecvSlot; each is touched
+    // only by its own side, and only checked by asserts.
+    bool is_reserved{false};
+    bool is_peeked{false};
+
+    T* slot(size_t i) {return slots.at(i % slots.size());}
+
+    // wait until slot t is free for the sender, or slot h holds an element for the receiver.
+    template<typename Trace>
+    ChanStatus wait_not_full(size_t t, bool is_blocking, Trace& trace) noexcept;
+    template<typename Trace>
+    ChanStatus wait_not_empty(size_t h, bool is_blocking, Trace& trace) noexcept;
+
+    template<typename U>
+    ChanStatus chan_send(U&& src, bool is_blocking) noexcept(nothrow_ops<T, Config>);
+    ChanStatus chan_recv(RecvDst<T> dst, bool is_blocking) noexcept(nothrow_ops<T, Config>);
+    ChanStatus chan_close() noexcept;
+    template<typename F>
+    ChanStatus chan_recv_with(F& f, bool is_blocking);
+
+    friend class SendSlot<T, SpscChanData>;
+    friend class RecvSlot<T, SpscChanData>;
+    SendSlot<T, SpscChanData> chan_reserve(bool is_blocking) noexcept;
+    ChanStatus chan_commit() noexcept;
+    void chan_abandon() noexcept {is_reserved = false;}
+    RecvSlot<T, SpscChanData> chan_peek(bool is_blocking) noexcept;
+    void chan_release() noexcept;
+    void chan_unpeek() noexcept {is_peeked = false;}
+
+public:
+    explicit SpscChanData(size_t n = 0);
+    ~SpscChanData();
+
+    // two-phase send and receive in the ring's slots; see SendSlot and RecvSlot.
+    // reserve() waits and throws like send(); peek() waits like recv() and returns an empty
+    // RecvSlot once the channel is closed and drained. the try_ variants never block or throw.
+    SendSlot<T, SpscChanData> reserve() {
+        auto r = chan_reserve(true);
+        if (!r) throw_send_status(r.status());
+        return r;
+    }
+    SendSlot<T, SpscChanData> try_reserve() noexcept    {return chan_reserve(false);}
+    RecvSlot<T, SpscChanData> peek() noexcept           {return chan_peek(true);}
+    RecvSlot<T, SpscChanData> try_peek() noexcept       {return chan_peek(false);}
+
+    const typename Config::instrument& instrumentation() const {return instrument;}
+};
+
+template<typename T, typename Config>
+SpscChanData<T, Config>::SpscChanData(size_t n) : slots(n) {
+    if (slots.size() == 0) {
+        throw std::invalid_argument("chan_policy::Spsc needs a positive capacity");
+    }
+}
+
+template<typename T, typename Config>
+SpscChanData<T, Config>::~SpscChanData() {
+    for (size_t i = head; i != tail; ++i) {
+        std::destroy_at(slot(i));
+    }
+}
+
+template<typename T, typename Config>
+template<typename Trace>
+ChanStatus SpscChanData<T, Config>::wait_not_full(size_t t, bool is_blocking, Trace& trace) noexcept {
+    // sending to a closed channel is an error.
+    if (is_closed.load(std::memory_order_acquire)) {
+        return ChanStatus::closed;
+    }
+
+    if (t - head.load(std::memory_order_acquire) == slots.size()) {
+        if (!is_blocking) {
+            trace.failed();
+            return ChanStatus::would_block;
+        }
+        uint64_t parked_at = trace.parking();
+        [[maybe_unused]] auto parked = instrument.parked(this, chan_watchdog::Op::send);
+        while (t - head.load(std::memory_order_acquire) == slots.size()) {
+            uint32_t e = not_full.prepare();
+            if (t - head.load(std::memory_order_seq_cst) != slots.size()) {
+                not_full.cancel();
+                break;
+            }
+            // By Go semantics, a close() while we wait is an error.
+            if (is_closed.load(std::memory_order_seq_cst)) {
+                not_full.cancel();
+                return ChanStatus::closed_while_blocked;
+            }
+            not_full.wait(e);
+        }
+        trace.woken(0, parked_at);
+    }
+    return ChanStatus::ok;
+}
+
+template<typename T, typename Config>
+template<typename Trace>
+ChanStatus SpscChanData<T, Config>::wait_not_empty(size_t h, bool is_blocking, Trace& trace) noexcept {
+    if (tail.load(std::memory_order_acquire) == h) {
+        // close() happens after the last send, so once is_closed is seen, tail is final.
+        if (is_closed.load(std::memory_order_acquire) && tail.load(std::memory_order_acquire) == h) {
+            trace.failed();
+            return ChanStatus::closed;
+        }
+        if (!is_blocking) {
+            trace.failed();
+            return ChanStatus::would_block;
+        }
+        uint64_t parked_at = trace.parking();
+        [[maybe_unused]] auto parked = instrument.parked(this, chan_watchdog::Op::recv);
+        while (tail.load(std::memory_order_acquire) == h) {
+            uint32_t e = not_empty.prepare();
+            if (tail.load(std::memory_order_seq_cst) != h) {
+                not_empty.cancel();
+                break;
+            }
+            if (is_closed.load(std::memory_order_seq_cst)) {
+                not_empty.cancel();
+                if (tail.load(std::memory_order_acquire) != h) break;
+                trace.woken(0, parked_at);
+                return ChanStatus::closed;
+            }
+            not_empty.wait(e);
+        }
+        trace.woken(0, parked_at);
+    }
+    return ChanStatus::ok;
+}
+
+template<typename T, typename Config>
+template<typename U>
+ChanStatus SpscChanData<T, Config>::chan_send(U&& src, bool is_blocking) noexcept(nothrow_ops<T, Config>) {
+    assert(!is_reserved && "send() while holding a SendSlot");
+    auto trace = instrument.scope(this, chan_trace::Kind::send, is_blocking);
+
+    size_t t = tail.load(std::memory_order_relaxed);
+    ChanStatus s = wait_not_full(t, is_blocking, trace);
+    if (s != ChanStatus::ok) return s;
+
+    std::construct_at(slot(t), std::forward<U>(src));
+    tail.store(t + 1, std::memory_order_release);
+    not_empty.notify();
+    return ChanStatus::ok;
+}
+
+// same contract as ChanData::chan_recv.
+template<typename T, typename Config>
+ChanStatus SpscChanData<T, Config>::chan_recv(RecvDst<T> dst, bool is_blocking) noexcept(nothrow_ops<T, Config>) {
+    assert(!is_peeked && "recv() while holding a RecvSlot");
+    auto trace = instrument.scope(this, chan_trace::Kind::recv, is_blocking);
+
+    size_t h = head.load(std::memory_order_relaxed);
+    ChanStatus s = wait_not_empty(h, is_blocking, trace);
+    if (s != ChanStatus::ok) return s;
+
+    T* p = slot(h);
+    dst.put(std::move(*p));
+    std::destroy_at(p);
+    head.store(h + 1, std::memory_order_release);
+    not_full.notify();
+    return ChanStatus::ok;
+}
+
+// f runs on the slot with no lock; the sender can't reuse the slot until head moves past it.
+template<typename T, typename Config>
+template<typename F>
+ChanStatus SpscChanData<T, Config>::chan_recv_with(F& f, bool is_blocking) {
+    assert(!is_peeked && "recv_with() while holding a RecvSlot");
+    auto trace = instrument.scope(this, chan_trace::Kind::recv, is_blocking);
+
+    size_t h = head.load(std::memory_order_relaxed);
+    ChanStatus s = wait_not_empty(h, is_blocking, trace);
+    if (s != ChanStatus::ok) return s;
+
+    auto pop = [&]() {
+        std::destroy_at(slot(h));
+        head.store(h + 1, std::memory_order_release);
+        not_full.notify();
+    };
+    try {
+        f(*slot(h));
+    } catch (...) {
+        pop();
+        throw;
+    }
+    pop();
+    return ChanStatus::ok;
+}
+
+// the instrument sees a reservation as the send: it may block or fail there,
+// and an abandoned one is still counted.
+template<typename T, typename Config>
+SendSlot<T, SpscChanData<T, Config>> SpscChanData<T, Config>::chan_reserve(bool is_blocking) noexcept {
+    assert(!is_reserved && "reserve() while holding a SendSlot");
+    auto trace = instrument.scope(this, chan_trace::Kind::send, is_blocking);
+
+    size_t t = tail.load(std::memory_order_relaxed);
+    ChanStatus s = wait_not_full(t, is_blocking, trace);
+    if (s != ChanStatus::ok) return SendSlot<T, SpscChanData>(this, nullptr, s);
+    is_reserved = true;
+    return SendSlot<T, SpscChanData>(this, slot(t), s);
+}
+
+// a reservation that outlives close() is not sent: once the receiver has seen the channel
+// closed and drained, no element may appear after it.
+template<typename T, typename Config>
+ChanStatus SpscChanData<T, Config>::chan_commit() noexcept {
+    is_reserved = false;
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (is_closed.load(std::memory_order_acquire)) {
+        std::destroy_at(slot(t));
+        return ChanStatus::closed;
+    }
+    tail.store(t + 1, std::memory_order_release);
+    not_empty.notify();
+    return ChanStatus::ok;
+}
+
+template<typename T, typename Config>
+RecvSlot<T, SpscChanData<T, Config>> SpscChanData<T, Config>::chan_peek(bool is_blocking) noexcept {
+    assert(!is_peeked && "peek() while holding a RecvSlot");
+    auto trace = instrument.scope(this, chan_trace::Kind::recv, is_blocking);
+
+    size_t h = head.load(std::memory_order_relaxed);
+    ChanStatus s = wait_not_empty(h, is_blocking, trace);
+    if (s != ChanStatus::ok) return RecvSlot<T, SpscChanData>(this, nullptr, s);
+    is_peeked = true;
+    return RecvSlot<T, SpscChanData>(this, slot(h), s);
+}
+
+template<typename T, typename Config>
+void SpscChanData<T, Config>::chan_release() noexcept {
+    is_peeked = false;
+    size_t h = head.load(std::memory_order_relaxed);
+    std::destroy_at(slot(h));
+    head.store(h + 1, std::memory_order_release);
+    not_full.notify();
+}
+
+template<typename T, typename Config>
+ChanStatus SpscChanData<T, Config>::chan_close() noexcept {
+    [[maybe_unused]] auto trace = instrument.scope(this, chan_trace::Kind::close);
+    if (is_closed.exchange(true, std::memory_order_seq_cst)) {
+        return ChanStatus::closed;
+    }
+    // release a parked receiver (returns false once drained) and a parked sender (closed_while_blocked).
+    not_empty.wake();
+    not_full.wake();
+    return ChanStatus::ok;
+}
+
+// a payload-free channel for done/ready signals (Chan<void>): a counting semaphore
+// with Go channel semantics. a buffered signal is a count, not an element, and the whole
+// state (count, closed, and whether anyone is parked) is one atomic word, so an uncontended
+// send or recv is one compare-and-swap and never takes chan_lock.
+//
+// threads only park with chan_lock held and the has_waiters bit set; while it is set the
+// fast paths are disabled and every operation goes through the lock.
+template<typename Config>
+class SignalChanData {
+private:
+    using Wait = typename Config::wait;
+
+    static constexpr uint64_t closed_bit = uint64_t(1) << 63;
+    static constexpr uint64_t waiters_bit = uint64_t(1) << 62;
+    static constexpr uint64_t count_mask = waiters_bit - 1;
+
+    // closed_bit | waiters_bit | number of buffered signals.
+    std::atomic<uint64_t> state{0};
+    const uint64_t cap;
+
+    struct SignalWaiter : Parker {
+        SignalWaiter* next{nullptr};
+    };
+    WaitQueue<SignalWaiter> send_queue;
+    WaitQueue<SignalWaiter> recv_queue;
+
+    typename Config::sync::lock_type chan_lock;
+
+    [[no_unique_address]] typename Config::instrument instrument;
+
+    // called under chan_lock after popping a waiter.
+    void update_waiters_bit() {
+        if (send_queue.empty() && recv_queue.empty()) state.fetch_and(~waiters_bit);
+    }
+
+    ChanStatus chan_send(bool is_blocking) noexcept;
+    ChanStatus chan_recv(bool is_blocking) noexcept;
+    void release_all(WakeReason reason);
+
+public:
+    explicit SignalChanData(size_t n = 0);
+    ~SignalChanData() {release_all(WakeReason::destructed);}
+
+    void send()                             {throw_send_status(chan_send(true));}
+    bool recv() {
+        ChanStatus s = chan_recv(true);
+        throw_recv_status(s);
+        return s == ChanStatus::ok;
+    }
+    bool send_nonblocking() {
+        ChanStatus s = chan_send(false);
+        throw_send_status(s);
+        return s == ChanStatus::ok;
+    }
+    bool recv_nonblocking()                 {return chan_recv(false) != ChanStatus::would_block;}
+    void foreach(std::function<void()> f);
+    void close()                            {throw_close_status(close_status());}
+
+    ChanStatus send_status() noexcept       {return chan_send(true);}
+    ChanStatus try_send() noexcept          {return chan_send(false);}
+    ChanStatus recv_status() noexcept       {return chan_recv(true);}
+    ChanStatus try_recv() noexcept          {return chan_recv(false);}
+    ChanStatus close_status() noexcept;
+
+    const typename Config::instrument& instrumentation() const {return instrument;}
+};
+
+template<typename Config>
+SignalChanData<Config>::SignalChanData(size_t n) : cap([n]() -> uint64_t {
+    if constexpr (!Config::storage::bounded) return count_mask;
+    else if constexpr (Config::storage::runtime_capacity) return std::min<uint64_t>(n, count_mask);
+    else return Config::storage::capacity;
+}()) {}
+
+template<typename Config>
+ChanStatus SignalChanData<Config>::chan_send(bool is_blocking) noexcept {
+    auto trace = instrument.scope(this, chan_trace::Kind::send, is_blocking);
+
+    // Fast path: room in the buffer, nobody parked, not closed.
+    uint64_t s = state.load(std::memory_order_relaxed);
+    while (!(s & (closed_bit | waiters_bit))) {
+        if ((s & count_mask) >= cap) {
+            if (is_blocking) break;
+            trace.failed();
+            return ChanStatus::would_block;
+        }
+        if (state.compare_exchange_weak(s, s + 1, std::memory_order_release, std::memory_order_relaxed)) {
+            return ChanStatus::ok;
+        }
+    }
+
+    std::unique_lock<typename Config::sync::lock_type> lck{chan_lock};
+    s = state.load(std::memory_order_relaxed);
+
+    // sending to a closed channel is an error.
+    if (s & closed_bit) {
+        return ChanStatus::closed;
+    }
+
+    // a parked receiver means the buffer is empty: hand the signal over directly.
+    if (!recv_queue.empty()) {
+        SignalWaiter* w = recv_queue.pop();
+        update_waiters_bit();
+        instrument.handoff(this, w->flow_id);
+        w->template wake<Wait>(WakeReason::completed);
+        return ChanStatus::ok;
+    }
+
+    // room in the buffer. fast-path receivers may still take signals concurrently
+    // unless someone is parked, hence the CAS loop.
+    while ((s & count_mask) < cap) {
+        if (state.compare_exchange_weak(s, s + 1, std::memory_order_release, std::memory_order_relaxed)) {
+            return ChanStatus::ok;
+        }
+    }
+
+    if (!is_blocking) {
+        trace.failed();
+        return ChanStatus::would_block;
+    }
+
+    // park. setting waiters_bit only while the buffer is still full closes the race
+    // with a fast-path receiver that makes room.
+    while (!(s & waiters_bit)) {
+        if ((s & count_mask) < cap) {
+            if (state.compare_exchange_weak(s, s + 1, std::memory_order_release, std::memory_order_relaxed)) {
+                return ChanStatus::ok;
+            }
+        } else if (state.compare_exchange_weak(s, s | waiters_bit, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    SignalWaiter w;
+    w.flow_id = instrument.new_flow_id();
+    send_queue.push(&w);
+    uint64_t parked_at = trace.parking();
+
+    lck.unlock();
+
+    WakeReason reason;
+    {
+        [[maybe_unused]] auto parked = instrument.parked(this, chan_watchdog::Op::send);
+        reason = w.template park<Wait>();
+    }
+    trace.woken(w.flow_id, parked_at);
+
+    // By Go semantics, a close() while we wait is an error.
+    if (reason == WakeReason::closed) {
+        return ChanStatus::closed_while_blocked;
+    }
+    if (reason == WakeReason::destructed) {
+        return ChanStatus::destructed;
+    }
+    return ChanStatus::ok;
+}
+
+// (selected, received), as in ChanData::chan_recv.
+template<typename Config>
+ChanStatus SignalChanData<Config>::chan_recv(bool is_blocking) noexcept {
+    auto trace = instrument.scope(this, chan_trace::Kind::recv, is_blocking);
+
+    // Fast path: a buffered signal and nobody parked. a closed channel is still drained.
+    uint64_t s = state.load(std::memory_order_acquire);
+    while (!(s & waiters_bit)) {
+        if ((s & count_mask) == 0) {
+            if (s & closed_bit) {
+                trace.failed();
+                return ChanStatus::closed;
+            }
+            if (is_blocking) break;
+            trace.failed();
+            return ChanStatus::would_block;
+        }
+        if (state.compare_exchange_weak(s, s - 1, std::memory_order_acquire, std::memory_order_acquire)) {
+            return ChanStatus::ok;
+        }
+    }
+
+    std::unique_lock<typename Config::sync::lock_type> lck{chan_lock};
+    s = state.load(std::memory_order_acquire);
+
+    // from chan.go: a parked sender means the buffer is full (or unbuffered).
+    // take the head of the buffer and move the sender's signal into its place,
+    // which leaves the count unchanged; or, unbuffered, take the sender's signal directly.
+    if (!send_queue.empty()) {
+        SignalWaiter* w = send_queue.pop();
+        update_waiters_bit();
+        instrument.handoff(this, w->flow_id);
+        w->template wake<Wait>(WakeReason::completed);
+        return ChanStatus::ok;
+    }
+
+    while ((s & count_mask) > 0) {
+        if (state.compare_exchange_weak(s, s - 1, std::memory_order_acquire, std::memory_order_acquire)) {
+            return ChanStatus::ok;
+        }
+    }
+
+    if (s & closed_bit) {
+        trace.failed();
+        return ChanStatus::closed;
+    }
+
+    if (!is_blocking) {
+        trace.failed();
+        return ChanStatus::would_block;
+    }
+
+    // park, once no fast-path sender can have added a signal.
+    while (!(s & waiters_bit)) {
+        if ((s & count_mask) > 0) {
+            if (state.compare_exchange_weak(s, s - 1, std::memory_order_acquire, std::memory_order_acquire)) {
+                return ChanStatus::ok;
+            }
+        } else if (state.compare_exchange_weak(s, s | waiters_bit, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    SignalWaiter w;
+    w.flow_id = instrument.new_flow_id();
+    recv_queue.push(&w);
+    uint64_t parked_at = trace.parking();
+
+    lck.unlock();
+
+    WakeReason reason;
+    {
+        [[maybe_unused]] auto parked = instrument.parked(this, chan_watchdog::Op::recv);
+        reason = w.template park<Wait>();
+    }
+    trace.woken(w.flow_id, parked_at);
+
+    if (reason == WakeReason::destructed) {
+        return ChanStatus::destructed;
+    }
+    return reason == WakeReason::completed ? ChanStatus::ok : ChanStatus::closed;
+}
+
+template<typename Config>
+void SignalChanData<Config>::foreach(std::function<void()> f) {
+    while (recv()) {
+        f();
+    }
+}
+
+template<typename Config>
+void SignalChanData<Config>::release_all(WakeReason reason) {
+    while (!recv_queue.empty()) {
+        SignalWaiter* w = recv_queue.pop();
+        instrument.handoff(this, w->flow_id);
+        w->template wake<Wait>(reason);
+    }
+    while (!send_queue.empty()) {
+        SignalWaiter* w = send_queue.pop();
+        instrument.handoff(this, w->flow_id);
+        w->template wake<Wait>(reason);
+    }
+    state.fetch_and(~waiters_bit);
+}
+
+template<typename Config>
+ChanStatus SignalChanData<Config>::close_status() noexcept {
+    [[maybe_unused]] auto trace = instrument.scope(this, chan_trace::Kind::close);
+    std::unique_lock<typename Config::sync::lock_type> lck{chan_lock};
+
+    if (state.fetch_or(closed_bit, std::memory_order_release) & closed_bit) {
+        return ChanStatus::closed;
+    }
+
+    // receivers return false; by Go semantics, senders throw ChannelClosedDuringSendException.
+    release_all(WakeReason::closed);
+    return ChanStatus::ok;
+}
+
+// the handle users pass around; copies share one channel.
+// Config comes from chan_policy::make_config; use the Chan alias below to spell one.
+template<typename T, typename Config>
+class BasicChan {
+private:
+    static_assert(!std::is_reference_v<T> && !std::is_const_v<T>, "Chan: element type must be a non-const object type");
+    static_assert(std::is_default_constructible_v<typename Config::template allocator_type<T>>,
+        "chan_policy::Allocator<A>: A<T> must be default-constructible");
+
+    using Data = std::conditional_t<Config::sync::spsc, SpscChanData<T, Config>, ChanData<T, Config>>;
+    std::shared_ptr<Data> chan_data_shared_ptr;
+
+    // one allocation holds both the control block and the channel.
+    template<typename... Args>
+    static std::shared_ptr<Data> make(size_t n, Args&&... args) {
+        return std::allocate_shared<Data>(typename Config::template allocator_type<Data>(), n, std::forward<Args>(args)...);
+    }
+public:
+    // n is the capacity of a Bounded channel, the initial slots of an Unbounded one,
+    // or the ring of a Spill one.
+    BasicChan(size_t n = 0) requires Config::storage::runtime_capacity : chan_data_shared_ptr(make(n)) {}
+    BasicChan(size_t n, SpillOptions options) requires std::is_same_v<typename Config::storage, chan_policy::Spill>
+        : chan_data_shared_ptr(make(n, std::move(options))) {}
+    BasicChan() requires (!Config::storage::runtime_capacity) : chan_data_shared_ptr(make(0)) {}
     
     // rule of 5.
     // default method calls that of std::shared_ptr.
-    ~Chan()                                 = default;
-    Chan(const Chan& c)                     = default;
-    Chan& operator=(const Chan& c)          = default;
-    Chan(Chan&& c)                          = default;
-    Chan& operator=(Chan&& c)               = default;
+    ~BasicChan()                                    = default;
+    BasicChan(const BasicChan& c)                   = default;
+    BasicChan& operator=(const BasicChan& c)        = default;
+    BasicChan(BasicChan&& c)                        = default;
+    BasicChan& operator=(BasicChan&& c)             = default;
 
     // forward methods
     void send(const T& src)                 {chan_data_shared_ptr->send(src);}
+    void send(T&& src)                      {chan_data_shared_ptr->send(std::move(src));}
     bool recv(T& dst)                       {return chan_data_shared_ptr->recv(dst);}
     T recv()                                {return chan_data_shared_ptr->recv();}
+    std::optional<T> recv_optional()        {return chan_data_shared_ptr->recv_optional();}
     bool send_nonblocking(const T& src)     {return chan_data_shared_ptr->send_nonblocking(src);}
+    bool send_nonblocking(T&& src)          {return chan_data_shared_ptr->send_nonblocking(std::move(src));}
     bool recv_nonblocking(T& dst)           {return chan_data_shared_ptr->recv_nonblocking(dst);}
+    std::optional<T> recv_nonblocking_optional() {return chan_data_shared_ptr->recv_nonblocking_optional();}
     void foreach(std::function<void(T)> f)  {chan_data_shared_ptr->foreach(f);}
     void close()                            {chan_data_shared_ptr->close();}
+
+    // consume in place; see ChanOps::recv_with.
+    template<typename F> bool recv_with(F&& f)              {return chan_data_shared_ptr->recv_with(std::forward<F>(f));}
+    template<typename F> ChanStatus try_recv_with(F&& f)    {return chan_data_shared_ptr->try_recv_with(std::forward<F>(f));}
+    template<typename F> void drain_with(F&& f)             {chan_data_shared_ptr->drain_with(std::forward<F>(f));}
+
+    // noexcept status API; see ChanStatus.
+    ChanStatus send_status(const T& src) noexcept(nothrow_ops<T, Config>)  {return chan_data_shared_ptr->send_status(src);}
+    ChanStatus send_status(T&& src) noexcept(nothrow_ops<T, Config>)       {return chan_data_shared_ptr->send_status(std::move(src));}
+    ChanStatus try_send(const T& src) noexcept(nothrow_ops<T, Config>)     {return chan_data_shared_ptr->try_send(src);}
+    ChanStatus try_send(T&& src) noexcept(nothrow_ops<T, Config>)          {return chan_data_shared_ptr->try_send(std::move(src));}
+    ChanStatus recv_status(T& dst) noexcept(nothrow_ops<T, Config>)        {return chan_data_shared_ptr->recv_status(dst);}
+    ChanStatus recv_status(std::optional<T>& dst) noexcept(nothrow_ops<T, Config>) {return chan_data_shared_ptr->recv_status(dst);}
+    ChanStatus try_recv(T& dst) noexcept(nothrow_ops<T, Config>)           {return chan_data_shared_ptr->try_recv(dst);}
+    ChanStatus try_recv(std::optional<T>& dst) noexcept(nothrow_ops<T, Config>) {return chan_data_shared_ptr->try_recv(dst);}
+    ChanStatus close_status() noexcept      {return chan_data_shared_ptr->close_status();}
+
+    // readiness for event loops; not with chan_policy::Spsc. see readiness.h.
+#ifdef __linux__
+    int recv_fd() requires (!Config::sync::spsc)                 {return chan_data_shared_ptr->recv_fd();}
+    int send_fd() requires (!Config::sync::spsc)                 {return chan_data_shared_ptr->send_fd();}
+#endif
+    void set_observer(ReadinessObserver* o) requires (!Config::sync::spsc) {chan_data_shared_ptr->set_observer(o);}
+    void set_tap(SendTap<T>* t) requires (!Config::sync::spsc)   {chan_data_shared_ptr->set_tap(t);}
+
+    // two-phase send and receive in place; only with chan_policy::Spsc. see SendSlot and RecvSlot.
+    using send_slot = SendSlot<T, Data>;
+    using recv_slot = RecvSlot<T, Data>;
+    send_slot reserve() requires Config::sync::spsc             {return chan_data_shared_ptr->reserve();}
+    send_slot try_reserve() noexcept requires Config::sync::spsc {return chan_data_shared_ptr->try_reserve();}
+    recv_slot peek() noexcept requires Config::sync::spsc        {return chan_data_shared_ptr->peek();}
+    recv_slot try_peek() noexcept requires Config::sync::spsc    {return chan_data_shared_ptr->try_peek();}
+
+    // only with the chan_policy::Stats instrument.
+    chan_policy::ChanStats stats() const requires requires(const typename Config::instrument& i) {i.stats();} {
+        return chan_data_shared_ptr->instrumentation().stats();
+    }
+    // only with chan_policy::Spill.
+    SpillDepth spill_depth() const requires std::is_same_v<typename Config::storage, chan_policy::Spill> {
+        return chan_data_shared_ptr->storage().depth();
+    }
 };
 
+// Chan<void>: signals without a payload. send() and recv() follow Chan<T>,
+// including close(): buffered signals are still received, then recv() returns false.
+template<typename Config>
+class BasicChan<void, Config> {
+private:
+    static_assert(!Config::sync::spsc, "Chan<void> has no Spsc variant; its uncontended path is already lock-free");
+
+    using Data = SignalChanData<Config>;
+    std::shared_ptr<Data> chan_data_shared_ptr;
+
+    static std::shared_ptr<Data> make(size_t n) {
+        return std::allocate_shared<Data>(typename Config::template allocator_type<Data>(), n);
+    }
+public:
+    // n is the number of signals that can be sent without a receiver.
+    BasicChan(size_t n = 0) requires Config::storage::runtime_capacity : chan_data_shared_ptr(make(n)) {}
+    BasicChan() requires (!Config::storage::runtime_capacity) : chan_data_shared_ptr(make(0)) {}
+
+    void send()                             {chan_data_shared_ptr->send();}
+    bool recv()                             {return chan_data_shared_ptr->recv();}
+    bool send_nonblocking()                 {return chan_data_shared_ptr->send_nonblocking();}
+    bool recv_nonblocking()                 {return chan_data_shared_ptr->recv_nonblocking();}
+    void foreach(std::function<void()> f)   {chan_data_shared_ptr->foreach(f);}
+    void close()                            {chan_data_shared_ptr->close();}
+
+    ChanStatus send_status() noexcept       {return chan_data_shared_ptr->send_status();}
+    ChanStatus try_send() noexcept          {return chan_data_shared_ptr->try_send();}
+    ChanStatus recv_status() noexcept       {return chan_data_shared_ptr->recv_status();}
+    ChanStatus try_recv() noexcept          {return chan_data_shared_ptr->try_recv();}
+    ChanStatus close_status() noexcept      {return chan_data_shared_ptr->close_status();}
+
+    chan_policy::ChanStats stats() const requires requires(const typename Config::instrument& i) {i.stats();} {
+        return chan_data_shared_ptr->instrumentation().stats();
+    }
+};
+
+// Chan<T> is the Go-like default; see policies.h for the other configurations.
+template<typename T, typename... Policies>
+using Chan = BasicChan<T, typename chan_policy::make_config<Policies...>::type>;
+
 #endif
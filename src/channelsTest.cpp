@@ -1,6 +1,22 @@
 #define CATCH_CONFIG_MAIN
 #include "libs/catch.hpp"
 #include "chan.h"
+#include "persistent_chan.h"
+#include "pipeline.h"
+#include "merge.h"
+#include "partitioned_chan.h"
+#define ALLOC_COUNTER_IMPLEMENTATION
+#include "measurement/bench/alloc_counter.h"
+#ifdef __linux__
+#include "shm_chan.h"
+#endif
+
+#include <array>
+#include <filesystem>
+#include <numeric>
+#include <sstream>
+#include <poll.h>
+#include <sys/wait.h>
 
 void send_n_to_channel(Chan<int> chan, int n) {
     for (int i = 0; i < n; i++) {
@@ -345,3 +361,1482 @@ TEST_CASE("test close") {
 TEST_CASE( "parallel send and recv" ) {
     parallel_send_and_recv();
 }
+
+TEST_CASE("move-only elements") {
+    SECTION("buffered") {
+        Chan<std::unique_ptr<int>> chan(2);
+        chan.send(std::make_unique<int>(1));
+        auto p = std::make_unique<int>(2);
+        REQUIRE(chan.send_nonblocking(std::move(p)) == true);
+        REQUIRE(p == nullptr);
+
+        // a failed nonblocking send leaves the element with the caller.
+        auto q = std::make_unique<int>(3);
+        REQUIRE(chan.send_nonblocking(std::move(q)) == false);
+        REQUIRE(*q == 3);
+
+        REQUIRE(*chan.recv() == 1);
+        std::unique_ptr<int> r;
+        REQUIRE(chan.recv(r));
+        REQUIRE(*r == 2);
+    }
+    SECTION("unbuffered, both directions of blocking") {
+        Chan<std::unique_ptr<int>> chan;
+        std::thread t1{[chan]() mutable {
+            chan.send(std::make_unique<int>(7));
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        REQUIRE(*chan.recv() == 7);
+        t1.join();
+
+        std::thread t2{[chan]() mutable {
+            REQUIRE(*chan.recv() == 8);
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        chan.send(std::make_unique<int>(8));
+        t2.join();
+    }
+    SECTION("foreach") {
+        Chan<std::unique_ptr<int>> chan(3);
+        for (int i = 0; i < 3; ++i) {
+            chan.send(std::make_unique<int>(i));
+        }
+        chan.close();
+        int sum = 0;
+        chan.foreach([&](std::unique_ptr<int> p) {sum += *p;});
+        REQUIRE(sum == 3);
+    }
+}
+
+TEST_CASE("zero allocations in steady state") {
+    REQUIRE(bench::alloc::hooked());
+    const int n = 1000;
+
+    SECTION("buffered") {
+        Chan<int> chan(4);
+        int num;
+        chan.send(0);
+        chan.recv(num);
+
+        auto before = bench::alloc::snapshot();
+        for (int i = 0; i < n; ++i) {
+            chan.send(i);
+            chan.recv(num);
+        }
+        auto delta = bench::alloc::snapshot() - before;
+        REQUIRE(delta.allocations == 0);
+    }
+    SECTION("unbuffered, with blocking on both sides") {
+        Chan<int> chan;
+        Chan<int> done(1);
+        std::thread partner{[chan, done]() mutable {
+            int num;
+            while (chan.recv(num)) {
+                chan.send(num + 1);
+            }
+            done.send(0);
+        }};
+        // warm up the partner's thread-local state (trace buffer, watchdog slot).
+        chan.send(0);
+        chan.recv();
+
+        auto before = bench::alloc::snapshot();
+        int sum = 0;
+        for (int i = 0; i < n; ++i) {
+            chan.send(i);
+            int num;
+            chan.recv(num);
+            sum += num;
+        }
+        auto delta = bench::alloc::snapshot() - before;
+
+        chan.close();
+        done.recv();
+        partner.join();
+        REQUIRE(sum == n * (n + 1) / 2);
+        REQUIRE(delta.allocations == 0);
+    }
+    SECTION("nonblocking success and failure") {
+        Chan<int> chan(1);
+        int num;
+        chan.send_nonblocking(0);
+        chan.recv_nonblocking(num);
+
+        auto before = bench::alloc::snapshot();
+        int failures = 0;
+        for (int i = 0; i < n; ++i) {
+            failures += !chan.recv_nonblocking(num);
+            failures += !chan.send_nonblocking(i);
+            failures += !chan.send_nonblocking(i);
+            failures += !chan.recv_nonblocking(num);
+        }
+        auto delta = bench::alloc::snapshot() - before;
+        REQUIRE(failures == 2 * n);
+        REQUIRE(delta.allocations == 0);
+    }
+    SECTION("fill to capacity and drain") {
+        const int cap = 64;
+        Chan<std::string> chan(cap);
+        std::string s;
+        chan.send("");
+        chan.recv(s);
+
+        auto before = bench::alloc::snapshot();
+        for (int round = 0; round < 10; ++round) {
+            for (int i = 0; i < cap; ++i) {
+                // short strings live in the small-string buffer, so only the channel could allocate.
+                chan.send("x");
+            }
+            for (int i = 0; i < cap; ++i) {
+                chan.recv(s);
+            }
+        }
+        auto delta = bench::alloc::snapshot() - before;
+        REQUIRE(delta.allocations == 0);
+    }
+}
+
+// counts the bytes it hands out, to check that the allocator policy is used.
+inline std::atomic<size_t> counted_bytes{0};
+
+template<typename T>
+struct CountingAllocator {
+    using value_type = T;
+    CountingAllocator() = default;
+    template<typename U> CountingAllocator(const CountingAllocator<U>&) {}
+    T* allocate(size_t n) {
+        counted_bytes += n * sizeof(T);
+        return std::allocator<T>().allocate(n);
+    }
+    void deallocate(T* p, size_t n) {
+        counted_bytes -= n * sizeof(T);
+        std::allocator<T>().deallocate(p, n);
+    }
+    template<typename U> bool operator==(const CountingAllocator<U>&) const {return true;}
+};
+
+// one producer sends 0..n-1 and closes; the consumer checks order and completeness.
+template<typename C>
+void check_producer_consumer(C chan, int n) {
+    std::thread producer{[chan, n]() mutable {
+        for (int i = 0; i < n; ++i) {
+            chan.send(i);
+        }
+        chan.close();
+    }};
+    int expected = 0;
+    int num;
+    while (chan.recv(num)) {
+        REQUIRE(num == expected);
+        expected++;
+    }
+    producer.join();
+    REQUIRE(expected == n);
+}
+
+TEST_CASE("policy-based configuration") {
+    using namespace chan_policy;
+    static_assert(std::is_same_v<Chan<int>, Chan<int, Bounded, Mutex, Block, Hooks, Allocator<std::allocator>>>);
+    static_assert(std::is_same_v<Chan<int, Spin, Fixed<4>>, Chan<int, Fixed<4>, Spin>>);
+
+    SECTION("fixed capacity") {
+        Chan<int, Fixed<2>> chan;
+        REQUIRE(chan.send_nonblocking(1));
+        REQUIRE(chan.send_nonblocking(2));
+        REQUIRE_FALSE(chan.send_nonblocking(3));
+        REQUIRE(chan.recv() == 1);
+        REQUIRE(chan.recv() == 2);
+        check_producer_consumer(chan, 1000);
+    }
+    SECTION("unbounded never blocks a sender") {
+        Chan<std::string, Unbounded> chan;
+        for (int i = 0; i < 1000; ++i) {
+            REQUIRE(chan.send_nonblocking(std::to_string(i)));
+        }
+        chan.close();
+        int expected = 0;
+        chan.foreach([&](std::string s) {REQUIRE(s == std::to_string(expected++));});
+        REQUIRE(expected == 1000);
+    }
+    SECTION("spinlock and spinning waiters, unbuffered and buffered") {
+        check_producer_consumer(Chan<int, Spinlock, Spin>(), 1000);
+        check_producer_consumer(Chan<int, Spinlock, SpinThenBlock<100>>(8), 1000);
+    }
+    SECTION("spsc") {
+        check_producer_consumer(Chan<int, Spsc>(4), 10000);
+        check_producer_consumer(Chan<int, Spsc, Fixed<64>, Spin>(), 10000);
+        REQUIRE_THROWS_AS((Chan<int, Spsc>(0)), std::invalid_argument);
+
+        Chan<int, Spsc, Fixed<1>> chan;
+        REQUIRE(chan.send_nonblocking(1));
+        REQUIRE_FALSE(chan.send_nonblocking(2));
+        int num;
+        REQUIRE(chan.recv_nonblocking(num));
+        REQUIRE_FALSE(chan.recv_nonblocking(num));
+        chan.close();
+        REQUIRE_FALSE(chan.recv(num));
+        REQUIRE_THROWS_AS(chan.send(1), SendOnClosedChannelException);
+    }
+    SECTION("spsc sender blocked by close throws") {
+        Chan<int, Spsc, Fixed<1>> chan;
+        chan.send(1);
+        std::thread t{[chan]() mutable {
+            REQUIRE_THROWS_AS(chan.send(2), ChannelClosedDuringSendException);
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        chan.close();
+        t.join();
+    }
+    SECTION("stats") {
+        Chan<int, Stats> chan(1);
+        int num;
+        chan.send(1);
+        chan.send_nonblocking(2);
+        chan.recv(num);
+        chan.recv_nonblocking(num);
+        // the second send blocks on the full buffer.
+        std::thread t{[chan]() mutable {
+            chan.send(3);
+            chan.send(4);
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        chan.send_nonblocking(5);
+        chan.recv(num);
+        chan.recv(num);
+        t.join();
+
+        auto stats = chan.stats();
+        REQUIRE(stats.sends == 3);
+        REQUIRE(stats.recvs == 3);
+        REQUIRE(stats.blocked_sends == 1);
+        REQUIRE(stats.blocked_recvs == 0);
+        REQUIRE(stats.failed_sends == 2);
+        REQUIRE(stats.failed_recvs == 1);
+    }
+    SECTION("allocator") {
+        {
+            Chan<int, Allocator<CountingAllocator>> chan(100);
+            REQUIRE(counted_bytes >= 100 * sizeof(int));
+            check_producer_consumer(chan, 1000);
+        }
+        REQUIRE(counted_bytes == 0);
+    }
+}
+
+TEST_CASE("signal channel (Chan<void>)") {
+    SECTION("buffered signals are counted") {
+        Chan<void> chan(2);
+        chan.send();
+        REQUIRE(chan.send_nonblocking());
+        REQUIRE_FALSE(chan.send_nonblocking());
+        REQUIRE(chan.recv());
+        REQUIRE(chan.recv_nonblocking());
+        REQUIRE_FALSE(chan.recv_nonblocking());
+    }
+    SECTION("unbuffered send waits for a receiver") {
+        // goSamples/channel-synchronization.go: wait for a worker to signal done.
+        Chan<void> done;
+        REQUIRE_FALSE(done.send_nonblocking());
+        bool worked = false;
+        std::thread worker{[done, &worked]() mutable {
+            worked = true;
+            done.send();
+        }};
+        REQUIRE(done.recv());
+        REQUIRE(worked);
+        worker.join();
+    }
+    SECTION("a full buffer blocks the sender until a recv") {
+        Chan<void> chan(1);
+        chan.send();
+        std::atomic<bool> sent{false};
+        std::thread t{[chan, &sent]() mutable {
+            chan.send();
+            sent = true;
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        REQUIRE_FALSE(sent);
+        REQUIRE(chan.recv());
+        t.join();
+        REQUIRE(sent);
+        REQUIRE(chan.recv_nonblocking());
+    }
+    SECTION("close") {
+        Chan<void> chan(3);
+        chan.send();
+        chan.send();
+        chan.close();
+        REQUIRE_THROWS_AS(chan.send(), SendOnClosedChannelException);
+        REQUIRE_THROWS_AS(chan.close(), CloseOfClosedChannelException);
+        int n = 0;
+        chan.foreach([&]() {n++;});
+        REQUIRE(n == 2);
+        REQUIRE_FALSE(chan.recv());
+    }
+    SECTION("close releases parked receivers and senders") {
+        Chan<void> ready;
+        std::thread recver{[ready]() mutable {
+            REQUIRE_FALSE(ready.recv());
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        ready.close();
+        recver.join();
+
+        Chan<void> chan;
+        std::thread sender{[chan]() mutable {
+            REQUIRE_THROWS_AS(chan.send(), ChannelClosedDuringSendException);
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        chan.close();
+        sender.join();
+    }
+    SECTION("many senders and receivers") {
+        Chan<void> chan(4);
+        const int n = 10000;
+        std::vector<std::thread> threads;
+        std::atomic<int> received{0};
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([chan]() mutable {
+                for (int m = 0; m < n; ++m) chan.send();
+            });
+            threads.emplace_back([chan, &received]() mutable {
+                for (int m = 0; m < n; ++m) {
+                    if (chan.recv()) received++;
+                }
+            });
+        }
+        for (auto& t : threads) t.join();
+        REQUIRE(received == 4 * n);
+        REQUIRE_FALSE(chan.recv_nonblocking());
+    }
+    SECTION("a signal does not allocate") {
+        Chan<void> chan(1);
+        chan.send();
+        chan.recv();
+        auto before = bench::alloc::snapshot();
+        for (int i = 0; i < 1000; ++i) {
+            chan.send();
+            chan.recv();
+        }
+        auto delta = bench::alloc::snapshot() - before;
+        REQUIRE(delta.allocations == 0);
+    }
+}
+
+// no default constructor, and counts how often it is constructed.
+struct Frame {
+    static inline int constructions = 0;
+    int id;
+    explicit Frame(int i) : id(i) {constructions++;}
+    Frame(const Frame& o) : id(o.id) {constructions++;}
+    Frame(Frame&& o) noexcept : id(o.id) {constructions++;}
+    Frame& operator=(const Frame&) = delete;
+    Frame& operator=(Frame&&) = delete;
+};
+
+TEST_CASE("recv_optional") {
+    SECTION("buffered, non-default-constructible and non-assignable") {
+        Chan<Frame> chan(2);
+        chan.send(Frame(1));
+        chan.send(Frame(2));
+        chan.close();
+
+        Frame::constructions = 0;
+        std::optional<Frame> f = chan.recv_optional();
+        REQUIRE(f);
+        REQUIRE(f->id == 1);
+        // built once, straight from the buffer slot.
+        REQUIRE(Frame::constructions == 1);
+
+        REQUIRE(chan.recv_nonblocking_optional()->id == 2);
+        REQUIRE_FALSE(chan.recv_optional());
+        REQUIRE_FALSE(chan.recv_nonblocking_optional());
+    }
+    SECTION("from a parked sender, and to a parked receiver") {
+        Chan<Frame> chan;
+        std::thread sender{[chan]() mutable {
+            chan.send(Frame(3));
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        REQUIRE(chan.recv_optional()->id == 3);
+        sender.join();
+
+        std::thread recver{[chan]() mutable {
+            REQUIRE(chan.recv_optional()->id == 4);
+            REQUIRE_FALSE(chan.recv_optional());
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        chan.send(Frame(4));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        chan.close();
+        recver.join();
+    }
+    SECTION("recv(T&) of a copy into a T that is only move-assignable") {
+        struct MoveAssignOnly {
+            int id{0};
+            MoveAssignOnly() = default;
+            explicit MoveAssignOnly(int i) : id(i) {}
+            MoveAssignOnly(const MoveAssignOnly&) = default;
+            MoveAssignOnly(MoveAssignOnly&&) = default;
+            MoveAssignOnly& operator=(const MoveAssignOnly&) = delete;
+            MoveAssignOnly& operator=(MoveAssignOnly&&) = default;
+        };
+        Chan<MoveAssignOnly> chan;
+        const MoveAssignOnly three(3);
+        const MoveAssignOnly four(4);
+        // the sender parks, sending by const T&.
+        std::thread sender{[chan, &three]() mutable {
+            chan.send(three);
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        MoveAssignOnly got;
+        REQUIRE(chan.recv(got));
+        REQUIRE(got.id == 3);
+        sender.join();
+
+        // the receiver parks.
+        std::thread recver{[chan]() mutable {
+            MoveAssignOnly dst;
+            REQUIRE(chan.recv(dst));
+            REQUIRE(dst.id == 4);
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        chan.send(four);
+        recver.join();
+        REQUIRE(three.id == 3);
+    }
+    SECTION("nonblocking with nothing ready") {
+        Chan<Frame> chan(1);
+        REQUIRE_FALSE(chan.recv_nonblocking_optional());
+    }
+    SECTION("foreach and spsc") {
+        Chan<Frame, chan_policy::Spsc> chan(4);
+        chan.send(Frame(1));
+        chan.send(Frame(2));
+        REQUIRE(chan.recv_optional()->id == 1);
+        chan.close();
+        int sum = 0;
+        chan.foreach([&](Frame f) {sum += f.id;});
+        REQUIRE(sum == 2);
+        REQUIRE_FALSE(chan.recv_optional());
+    }
+}
+
+TEST_CASE("status API") {
+    static_assert(noexcept(std::declval<Chan<int>&>().send_status(1)));
+    static_assert(noexcept(std::declval<Chan<int>&>().try_recv(std::declval<int&>())));
+    static_assert(!noexcept(std::declval<Chan<std::string>&>().send_status(std::declval<const std::string&>())));
+    // growing the buffer may throw bad_alloc.
+    static_assert(!noexcept(std::declval<Chan<int, chan_policy::Unbounded>&>().send_status(1)));
+
+    SECTION("nonblocking and closed") {
+        Chan<int> chan(1);
+        int num = 0;
+        REQUIRE(chan.try_recv(num) == ChanStatus::would_block);
+        REQUIRE(chan.try_send(1) == ChanStatus::ok);
+        REQUIRE(chan.try_send(2) == ChanStatus::would_block);
+        REQUIRE(chan.close_status() == ChanStatus::ok);
+        REQUIRE(chan.close_status() == ChanStatus::closed);
+        REQUIRE(chan.send_status(3) == ChanStatus::closed);
+        REQUIRE(chan.recv_status(num) == ChanStatus::ok);
+        REQUIRE(num == 1);
+        std::optional<int> v;
+        REQUIRE(chan.recv_status(v) == ChanStatus::closed);
+        REQUIRE_FALSE(v);
+        REQUIRE(chan.try_recv(v) == ChanStatus::closed);
+    }
+    SECTION("close releases blocked senders and receivers with a status") {
+        for (size_t buffer_size : {0, 1}) {
+            Chan<int> chan(buffer_size);
+            if (buffer_size > 0) chan.send(0);
+            std::vector<std::thread> senders;
+            std::atomic<int> released{0};
+            for (int i = 0; i < 8; ++i) {
+                senders.emplace_back([chan, &released]() mutable {
+                    if (chan.send_status(1) == ChanStatus::closed_while_blocked) released++;
+                });
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            chan.close();
+            for (auto& t : senders) t.join();
+            REQUIRE(released == 8);
+        }
+
+        Chan<int> chan;
+        std::thread recver{[chan]() mutable {
+            int num;
+            REQUIRE(chan.recv_status(num) == ChanStatus::closed);
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        chan.close();
+        recver.join();
+    }
+    SECTION("spsc and signal channels") {
+        Chan<int, chan_policy::Spsc> spsc(1);
+        REQUIRE(spsc.try_send(1) == ChanStatus::ok);
+        REQUIRE(spsc.try_send(2) == ChanStatus::would_block);
+        REQUIRE(spsc.close_status() == ChanStatus::ok);
+        REQUIRE(spsc.send_status(3) == ChanStatus::closed);
+
+        Chan<void> signal;
+        REQUIRE(signal.try_send() == ChanStatus::would_block);
+        REQUIRE(signal.close_status() == ChanStatus::ok);
+        REQUIRE(signal.recv_status() == ChanStatus::closed);
+        REQUIRE(signal.send_status() == ChanStatus::closed);
+        REQUIRE(signal.close_status() == ChanStatus::closed);
+    }
+}
+
+// counts live instances, to check that abandoned and released slots are destroyed.
+struct Packet {
+    static inline int live = 0;
+    int a;
+    int b;
+    Packet(int a, int b) : a(a), b(b) {live++;}
+    Packet(const Packet& o) : a(o.a), b(o.b) {live++;}
+    ~Packet() {live--;}
+};
+
+TEST_CASE("reserve/commit and peek/release") {
+    using SpscChan = Chan<Packet, chan_policy::Spsc>;
+
+    SECTION("in place, in order") {
+        SpscChan chan(2);
+        auto slot = chan.reserve();
+        REQUIRE(slot);
+        slot.emplace(1, 2);
+        slot->a = 3;
+        slot.commit();
+        REQUIRE_FALSE(slot);
+        chan.send(Packet(4, 5));
+
+        REQUIRE_FALSE(chan.try_reserve());
+        REQUIRE(chan.try_reserve().status() == ChanStatus::would_block);
+
+        auto peeked = chan.peek();
+        REQUIRE(peeked);
+        REQUIRE(peeked->a == 3);
+        REQUIRE(peeked->b == 2);
+        peeked.release();
+        REQUIRE(chan.recv_optional()->a == 4);
+        REQUIRE(chan.try_peek().status() == ChanStatus::would_block);
+    }
+    SECTION("abandoned reservations and peeks") {
+        SpscChan chan(1);
+        int live = Packet::live;
+        {
+            auto slot = chan.reserve();
+            slot.emplace(1, 1);
+            REQUIRE(Packet::live == live + 1);
+        }
+        // nothing was sent, and the element was destroyed.
+        REQUIRE(Packet::live == live);
+        REQUIRE(chan.try_peek().status() == ChanStatus::would_block);
+
+        chan.send(Packet(2, 2));
+        {
+            auto peeked = chan.peek();
+            REQUIRE(peeked->a == 2);
+        }
+        // not released: still at the head.
+        REQUIRE(chan.peek()->a == 2);
+        REQUIRE(chan.recv_optional()->a == 2);
+        REQUIRE(Packet::live == live);
+    }
+    SECTION("close") {
+        SpscChan chan(2);
+        chan.send(Packet(1, 1));
+        auto slot = chan.reserve();
+        slot.emplace(2, 2);
+        chan.close();
+        // a reservation outstanding at close() is not sent.
+        REQUIRE(slot.commit_status() == ChanStatus::closed);
+        REQUIRE_THROWS_AS(chan.reserve(), SendOnClosedChannelException);
+        REQUIRE(chan.try_reserve().status() == ChanStatus::closed);
+
+        // buffered elements are still received, then peek() reports closed.
+        auto peeked = chan.peek();
+        REQUIRE(peeked->a == 1);
+        peeked.release();
+        auto last = chan.peek();
+        REQUIRE_FALSE(last);
+        REQUIRE(last.status() == ChanStatus::closed);
+    }
+    SECTION("blocked reserve and peek") {
+        Chan<std::array<char, 4096>, chan_policy::Spsc> chan(4);
+        const int n = 1000;
+        std::thread sender{[chan]() mutable {
+            for (int i = 0; i < n; ++i) {
+                auto slot = chan.reserve();
+                auto& frame = slot.fill();
+                frame[0] = static_cast<char>(i);
+                frame[4095] = static_cast<char>(i + 1);
+                slot.commit();
+            }
+            chan.close();
+        }};
+        int received = 0;
+        while (auto frame = chan.peek()) {
+            REQUIRE((*frame)[0] == static_cast<char>(received));
+            REQUIRE((*frame)[4095] == static_cast<char>(received + 1));
+            frame.release();
+            received++;
+        }
+        sender.join();
+        REQUIRE(received == n);
+    }
+}
+
+TEST_CASE("recv_with and drain_with") {
+    SECTION("buffered: in place, no copies") {
+        Chan<Packet> chan(4);
+        chan.send(Packet(1, 2));
+        chan.send(Packet(3, 4));
+        chan.close();
+        int live = Packet::live;
+        int sum = 0;
+        REQUIRE(chan.recv_with([&](Packet& p) {
+            // the element is still in its slot: no other Packet exists.
+            REQUIRE(Packet::live == live);
+            sum += p.a + p.b;
+        }));
+        REQUIRE(Packet::live == live - 1);
+        chan.drain_with([&](Packet& p) {sum += p.a + p.b;});
+        REQUIRE(sum == 10);
+        REQUIRE(Packet::live == live - 2);
+        REQUIRE_FALSE(chan.recv_with([](Packet&) {FAIL("called on a closed, drained channel");}));
+        REQUIRE(chan.try_recv_with([](Packet&) {}) == ChanStatus::closed);
+    }
+    SECTION("unbuffered and parked") {
+        Chan<int> chan;
+        REQUIRE(chan.try_recv_with([](int&) {}) == ChanStatus::would_block);
+        std::thread sender{[chan]() mutable {
+            int lvalue = 1;
+            chan.send(lvalue);
+            chan.send(2);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            chan.send(3);
+            chan.close();
+        }};
+        std::vector<int> got;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        chan.drain_with([&](int& v) {got.push_back(v);});
+        sender.join();
+        REQUIRE(got == std::vector<int>{1, 2, 3});
+    }
+    SECTION("f throws: the element is consumed and parked senders move up") {
+        Chan<int> chan(1);
+        chan.send(1);
+        std::thread sender{[chan]() mutable {chan.send(2);}};
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        REQUIRE_THROWS_AS(chan.recv_with([](int&) {throw std::runtime_error("f");}), std::runtime_error);
+        sender.join();
+        int v = 0;
+        REQUIRE(chan.recv_with([&](int& x) {v = x;}));
+        REQUIRE(v == 2);
+    }
+    SECTION("spsc") {
+        Chan<std::array<char, 1024>, chan_policy::Spsc> chan(8);
+        const int n = 1000;
+        std::thread sender{[chan]() mutable {
+            for (int i = 0; i < n; ++i) {
+                std::array<char, 1024> a;
+                a[0] = static_cast<char>(i);
+                chan.send(a);
+            }
+            chan.close();
+        }};
+        int received = 0;
+        chan.drain_with([&](std::array<char, 1024>& a) {
+            REQUIRE(a[0] == static_cast<char>(received));
+            received++;
+        });
+        sender.join();
+        REQUIRE(received == n);
+    }
+}
+
+#ifdef __linux__
+TEST_CASE("ShmChan") {
+    SECTION("same semantics as Chan<T>") {
+        std::string name = "/chan_test_" + std::to_string(getpid());
+        auto chan = ShmChan<int>::create(name, 2);
+        auto other = ShmChan<int>::open(name);
+        ShmChan<int>::unlink(name);
+        REQUIRE(chan.capacity() == 2);
+        REQUIRE_THROWS_AS(ShmChan<long>::create_anonymous(0), std::invalid_argument);
+
+        int num = 0;
+        REQUIRE(chan.try_recv(num) == ChanStatus::would_block);
+        chan.send(1);
+        REQUIRE(other.try_send(2) == ChanStatus::ok);
+        REQUIRE(other.try_send(3) == ChanStatus::would_block);
+        REQUIRE(other.size() == 2);
+        REQUIRE(other.recv() == 1);
+        other.close();
+        REQUIRE_THROWS_AS(chan.send(4), SendOnClosedChannelException);
+        REQUIRE_THROWS_AS(chan.close(), CloseOfClosedChannelException);
+        REQUIRE(chan.recv_with([](int& v) {REQUIRE(v == 2);}));
+        REQUIRE_FALSE(chan.recv(num));
+        REQUIRE_FALSE(chan.peer_crashed());
+    }
+    SECTION("threads of one process, blocking") {
+        auto chan = ShmChan<int>::create_anonymous(4);
+        std::thread sender{[&chan]() {
+            for (int i = 0; i < 1000; ++i) chan.send(i);
+            chan.close();
+        }};
+        int expected = 0;
+        chan.foreach([&](int v) {REQUIRE(v == expected++);});
+        sender.join();
+        REQUIRE(expected == 1000);
+    }
+    SECTION("two processes") {
+        auto chan = ShmChan<long>::create_anonymous(16);
+        auto sums = ShmChan<long>::create_anonymous(1);
+        pid_t pid = fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0) {
+            auto in = ShmChan<long>::from_fd(chan.fd());
+            auto out = ShmChan<long>::from_fd(sums.fd());
+            long sum = 0;
+            long v;
+            while (in.recv(v)) sum += v;
+            out.send(sum);
+            _exit(0);
+        }
+        for (long i = 1; i <= 10000; ++i) chan.send(i);
+        chan.close();
+        REQUIRE(sums.recv() == 10000L * 10001 / 2);
+        int status;
+        waitpid(pid, &status, 0);
+        REQUIRE(WIFEXITED(status));
+        REQUIRE(WEXITSTATUS(status) == 0);
+    }
+    SECTION("liveness from /proc: only a missing entry or a zombie is dead") {
+        uint64_t self = shm_chan::process_start_time(static_cast<uint32_t>(getpid()));
+        REQUIRE(self != 0);
+        REQUIRE(self != shm_chan::unknown_start_time);
+        pid_t pid = fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0) _exit(0);
+        // a zombie until reaped, then no entry at all.
+        for (int i = 0; i < 1000 && shm_chan::process_start_time(static_cast<uint32_t>(pid)) != 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        REQUIRE(shm_chan::process_start_time(static_cast<uint32_t>(pid)) == 0);
+        waitpid(pid, nullptr, 0);
+        REQUIRE(shm_chan::process_start_time(static_cast<uint32_t>(pid)) == 0);
+    }
+    SECTION("a crashed peer closes the channel") {
+        auto chan = ShmChan<int>::create_anonymous(1);
+        pid_t pid = fork();
+        REQUIRE(pid >= 0);
+        if (pid == 0) {
+            // attach, send one value, and die without detaching.
+            auto c = ShmChan<int>::from_fd(chan.fd());
+            c.send(7);
+            _exit(1);
+        }
+        // the value sent before the crash is still received; then recv reports closed.
+        REQUIRE(chan.recv() == 7);
+        int num;
+        REQUIRE_FALSE(chan.recv(num));
+        REQUIRE(chan.peer_crashed());
+        REQUIRE(chan.send_status(1) == ChanStatus::closed);
+        waitpid(pid, nullptr, 0);
+    }
+}
+
+bool fd_readable(int fd) {
+    pollfd p{fd, POLLIN, 0};
+    return poll(&p, 1, 0) == 1 && (p.revents & POLLIN);
+}
+
+// the value of an eventfd's counter: how many times it was signaled since it was last cleared.
+uint64_t fd_signals(int fd) {
+    uint64_t count = 0;
+    return read(fd, &count, sizeof(count)) == sizeof(count) ? count : 0;
+}
+#endif
+
+TEST_CASE("readiness fds") {
+#ifdef __linux__
+    SECTION("buffered: signaled on rising edges only") {
+        Chan<int> chan(2);
+        int rfd = chan.recv_fd();
+        int sfd = chan.send_fd();
+        REQUIRE_FALSE(fd_readable(rfd));
+        REQUIRE(fd_readable(sfd));
+        clear_ready_fd(sfd);
+
+        chan.send(1);
+        chan.send(2);
+        REQUIRE_FALSE(fd_readable(sfd));
+        // two sends, one empty -> non-empty transition.
+        REQUIRE(fd_signals(rfd) == 1);
+
+        int num;
+        while (chan.try_recv(num) == ChanStatus::ok) {}
+        // full -> not full, once.
+        REQUIRE(fd_signals(sfd) == 1);
+        REQUIRE_FALSE(fd_readable(rfd));
+
+        chan.send(3);
+        REQUIRE(fd_readable(rfd));
+        clear_ready_fd(rfd);
+        chan.recv(num);
+        chan.close();
+        REQUIRE(fd_readable(rfd));
+        REQUIRE(chan.try_recv(num) == ChanStatus::closed);
+    }
+    SECTION("unbuffered: a parked peer makes the other side ready") {
+        Chan<int> chan;
+        int rfd = chan.recv_fd();
+        std::thread sender{[chan]() mutable {chan.send(1);}};
+        pollfd p{rfd, POLLIN, 0};
+        REQUIRE(poll(&p, 1, 5000) == 1);
+        clear_ready_fd(rfd);
+        int num = 0;
+        REQUIRE(chan.try_recv(num) == ChanStatus::ok);
+        REQUIRE(num == 1);
+        sender.join();
+    }
+#endif
+    SECTION("one observer") {
+        struct Recorder : ReadinessObserver {
+            std::vector<std::pair<bool, bool>> seen;
+            void update(bool r, bool s) noexcept override {seen.emplace_back(r, s);}
+        } recorder;
+        Chan<int> chan(1);
+        chan.set_observer(&recorder);
+        chan.send(1);
+        REQUIRE(recorder.seen.front() == std::make_pair(false, true));
+        REQUIRE(recorder.seen.back() == std::make_pair(true, false));
+#ifdef __linux__
+        REQUIRE_THROWS_AS(chan.recv_fd(), std::logic_error);
+#endif
+        chan.set_observer(nullptr);
+        chan.recv();
+        REQUIRE(recorder.seen.size() == 2);
+    }
+}
+
+// a codec for a type that is not trivially copyable.
+template<>
+struct SpillCodec<std::string> {
+    static size_t size(const std::string& v) {return v.size();}
+    static void write(const std::string& v, std::byte* out) {std::memcpy(out, v.data(), v.size());}
+    static std::string read(const std::byte* in, size_t n) {return std::string(reinterpret_cast<const char*>(in), n);}
+};
+
+TEST_CASE("spill to disk") {
+    // a send may allocate (in-memory overflow, segments), so bad_alloc must be able to reach the caller.
+    static_assert(!noexcept(std::declval<Chan<int, chan_policy::Spill>&>().send_status(1)));
+    auto dir = std::filesystem::temp_directory_path() / ("chan_spill_test_" + std::to_string(getpid()));
+    std::filesystem::create_directories(dir);
+    auto files = [&]() {return std::distance(std::filesystem::directory_iterator(dir), {});};
+
+    SECTION("FIFO through the ring and the segments") {
+        {
+            Chan<int, chan_policy::Spill> chan(4, SpillOptions{dir.string(), 4096, 1});
+            const int n = 10000;
+            for (int i = 0; i < n; ++i) chan.send(i);
+            SpillDepth d = chan.spill_depth();
+            REQUIRE(d.in_memory == 4);
+            REQUIRE(d.on_disk == n - 4);
+            REQUIRE(d.segments > 1);
+            REQUIRE(files() == static_cast<long>(d.segments));
+
+            // new sends go behind the backlog on disk.
+            for (int i = 0; i < n / 2; ++i) REQUIRE(chan.recv() == i);
+            for (int i = n; i < n + 100; ++i) chan.send(i);
+            chan.close();
+            int expected = n / 2;
+            chan.foreach([&](int v) {REQUIRE(v == expected++);});
+            REQUIRE(expected == n + 100);
+
+            d = chan.spill_depth();
+            REQUIRE(d.in_memory == 0);
+            REQUIRE(d.on_disk == 0);
+            // read-out segments were deleted, except the one spare.
+            REQUIRE(d.segments == 1);
+            REQUIRE(d.failures == 0);
+        }
+        REQUIRE(files() == 0);
+    }
+    SECTION("codec, and a blocked receiver") {
+        Chan<std::string, chan_policy::Spill> chan(2, SpillOptions{dir.string(), 4096, 0});
+        std::thread recver{[chan]() mutable {
+            REQUIRE(chan.recv() == "first");
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        chan.send("first");
+        recver.join();
+        for (int i = 0; i < 500; ++i) chan.send(std::string(i % 50, 'x') + std::to_string(i));
+        REQUIRE(chan.spill_depth().on_disk == 498);
+        for (int i = 0; i < 500; ++i) REQUIRE(chan.recv() == std::string(i % 50, 'x') + std::to_string(i));
+    }
+    SECTION("no segment can be made: kept in memory, in order") {
+        Chan<int, chan_policy::Spill> chan(2, SpillOptions{(dir / "missing").string(), 4096, 0});
+        for (int i = 0; i < 100; ++i) chan.send(i);
+        SpillDepth d = chan.spill_depth();
+        REQUIRE(d.in_memory == 100);
+        REQUIRE(d.failures == 98);
+        for (int i = 0; i < 100; ++i) REQUIRE(chan.recv() == i);
+    }
+    REQUIRE_THROWS_AS((Chan<int, chan_policy::Spill>(0)), std::invalid_argument);
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("persistent channel") {
+    auto dir = std::filesystem::temp_directory_path() / ("chan_wal_test_" + std::to_string(getpid()));
+    std::filesystem::remove_all(dir);
+    auto segment_files = [&]() {
+        long n = 0;
+        for (auto& e : std::filesystem::directory_iterator(dir)) n += e.path().extension() == ".log";
+        return n;
+    };
+
+    SECTION("unacknowledged elements are replayed after a restart") {
+        {
+            PersistentChan<int> chan(dir.string());
+            for (int i = 0; i < 10; ++i) REQUIRE(chan.send(i) == static_cast<uint64_t>(i + 1));
+            for (int i = 0; i < 4; ++i) {
+                auto d = chan.recv();
+                REQUIRE(d->value == i);
+                chan.ack(d->seq);
+            }
+            // received, not acknowledged.
+            REQUIRE(chan.recv()->value == 4);
+            REQUIRE(chan.unacked() == 6);
+        }
+        PersistentChan<int> chan(dir.string());
+        REQUIRE(chan.unacked() == 6);
+        REQUIRE(chan.send(10) == 11);
+        chan.close();
+        int expected = 4;
+        while (auto d = chan.recv()) REQUIRE(d->value == expected++);
+        REQUIRE(expected == 11);
+        REQUIRE_THROWS_AS(chan.send(0), SendOnClosedChannelException);
+    }
+    SECTION("a torn record ends the log") {
+        std::string segment;
+        {
+            PersistentChan<std::string> chan(dir.string());
+            for (int i = 0; i < 3; ++i) chan.send("record " + std::to_string(i));
+        }
+        for (auto& e : std::filesystem::directory_iterator(dir)) {
+            if (e.path().extension() == ".log") segment = e.path().string();
+        }
+        // flip a byte of the last record's payload.
+        int fd = open(segment.c_str(), O_RDWR);
+        off_t last = 2 * static_cast<off_t>(wal::record_size(8));
+        char c;
+        REQUIRE(pread(fd, &c, 1, last + sizeof(wal::RecordHeader)) == 1);
+        c ^= 1;
+        REQUIRE(pwrite(fd, &c, 1, last + sizeof(wal::RecordHeader)) == 1);
+        close(fd);
+
+        PersistentChan<std::string> chan(dir.string());
+        REQUIRE(chan.unacked() == 2);
+        REQUIRE(chan.send("again") == 3);
+        REQUIRE(chan.recv()->value == "record 0");
+        REQUIRE(chan.recv()->value == "record 1");
+        REQUIRE(chan.recv()->value == "again");
+        REQUIRE(!chan.try_recv());
+    }
+    SECTION("acknowledged segments are deleted") {
+        PersistentChan<uint64_t> chan(dir.string(), PersistentOptions{4096});
+        for (uint64_t i = 0; i < 2000; ++i) chan.send_nowait(i);
+        chan.sync();
+        REQUIRE(segment_files() > 2);
+        REQUIRE(segment_files() == static_cast<long>(chan.segment_count()));
+        uint64_t last = 0;
+        for (uint64_t i = 0; i < 2000; ++i) {
+            auto d = chan.recv();
+            REQUIRE(d->value == i);
+            last = d->seq;
+        }
+        chan.ack(last);
+        chan.sync();
+        REQUIRE(segment_files() == 1);
+        REQUIRE(chan.unacked() == 0);
+    }
+    SECTION("group commit: concurrent senders") {
+        PersistentChan<int> chan(dir.string());
+        std::vector<std::thread> senders;
+        for (int t = 0; t < 4; ++t) {
+            senders.emplace_back([&chan, t]() {
+                for (int i = 0; i < 50; ++i) chan.send(t * 1000 + i);
+            });
+        }
+        std::vector<int> last(4, -1);
+        for (int i = 0; i < 200; ++i) {
+            int v = chan.recv()->value;
+            // each sender's elements stay in order.
+            REQUIRE(v % 1000 > last[v / 1000]);
+            last[v / 1000] = v % 1000;
+        }
+        for (auto& t : senders) t.join();
+    }
+    SECTION("close() delivers what was appended but not yet synced") {
+        for (int round = 0; round < 20; ++round) {
+            PersistentChan<int> chan(dir.string());
+            int received = 0;
+            std::thread receiver{[&]() {
+                while (auto d = chan.recv()) {
+                    received++;
+                    chan.ack(d->seq);
+                }
+            }};
+            for (int i = 0; i < 1000; ++i) chan.send_nowait(i);
+            chan.close();
+            receiver.join();
+            REQUIRE(received == 1000);
+        }
+    }
+    SECTION("one process at a time") {
+        PersistentChan<int> chan(dir.string());
+        pid_t pid = fork();
+        if (pid == 0) {
+            try {
+                PersistentChan<int> other(dir.string());
+            } catch (std::runtime_error&) {
+                _exit(0);
+            }
+            _exit(1);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        REQUIRE(WEXITSTATUS(status) == 0);
+    }
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("record and replay traffic") {
+    auto path = (std::filesystem::temp_directory_path() / ("chan_tap_test_" + std::to_string(getpid()))).string();
+
+    SECTION("recorded sends: times, sizes and payloads") {
+        Chan<std::string> chan(4);
+        TrafficRecorder<std::string> rec(path, true);
+        chan.set_tap(&rec);
+        chan.send("a");
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        chan.send("bcd");
+        // a send that finds no room is not traffic; one that parks is.
+        for (int i = 0; i < 2; ++i) chan.send(std::string(300, 'x'));
+        REQUIRE(!chan.send_nonblocking("dropped"));
+        std::thread sender{[chan]() mutable {chan.send("parked");}};
+        while (rec.count() < 5) std::this_thread::yield();
+        chan.set_tap(nullptr);
+        for (int i = 0; i < 5; ++i) chan.recv();
+        sender.join();
+        chan.send("untapped");
+        rec.flush();
+        REQUIRE(rec.count() == 5);
+
+        TrafficReader in(path);
+        REQUIRE(in.has_payloads());
+        std::vector<TrafficRecord> records;
+        TrafficRecord r;
+        while (in.next(r)) records.push_back(r);
+        REQUIRE(records.size() == 5);
+        REQUIRE(records[0].time_ns == 0);
+        REQUIRE(records[1].time_ns >= 20'000'000);
+        REQUIRE(records[4].time_ns >= records[3].time_ns);
+        REQUIRE(records[2].size == 300);
+        REQUIRE(payload_as<std::string>(records[1]) == "bcd");
+        REQUIRE(payload_as<std::string>(records[4]) == "parked");
+    }
+    SECTION("replay, scaled") {
+        {
+            TrafficRecorder<int> rec(path);
+            Chan<int, chan_policy::Unbounded> chan;
+            chan.set_tap(&rec);
+            for (int i = 0; i < 5; ++i) {
+                chan.send(i);
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+        TrafficReader in(path);
+        REQUIRE(!in.has_payloads());
+        Chan<uint64_t, chan_policy::Unbounded> test;
+        ReplayStats s = replay(in, test, [](const TrafficRecord& r) {return r.size;}, ReplayOptions{4.0});
+        REQUIRE(s.sent == 5);
+        // at least 40 ms recorded between the first and last send, at four times the speed.
+        REQUIRE(s.elapsed_ns >= 10'000'000);
+        REQUIRE(s.elapsed_ns < 40'000'000);
+        for (int i = 0; i < 5; ++i) REQUIRE(test.recv() == sizeof(int));
+
+        // a closed channel stops the replay.
+        TrafficReader again(path);
+        test.close();
+        REQUIRE(replay(again, test, [](const TrafficRecord& r) {return r.size;}, ReplayOptions{0}).sent == 0);
+    }
+    SECTION("many buffers through the writer thread, and a corrupt size") {
+        const uint64_t n = 100000;
+        {
+            TrafficRecorder<uint64_t> rec(path, true);
+            Chan<uint64_t, chan_policy::Unbounded> chan;
+            chan.set_tap(&rec);
+            for (uint64_t i = 0; i < n; ++i) chan.send(i);
+            chan.set_tap(nullptr);
+            rec.flush();
+            REQUIRE(rec.count() == n);
+        }
+        {
+            TrafficReader in(path);
+            TrafficRecord r;
+            uint64_t i = 0;
+            while (in.next(r)) REQUIRE(payload_as<uint64_t>(r) == i++);
+            REQUIRE(i == n);
+        }
+        // the first record's size (a one-byte varint after a one-byte dt of 0) claims 2^63 bytes.
+        {
+            std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+            f.seekp(sizeof(chan_tap::magic) + 8 + 1);
+            const char huge[] = {'\x80', '\x80', '\x80', '\x80', '\x80', '\x80', '\x80', '\x80', '\x80', '\x01'};
+            f.write(huge, sizeof(huge));
+        }
+        TrafficReader in(path);
+        TrafficRecord r;
+        REQUIRE_FALSE(in.next(r));
+    }
+    REQUIRE_THROWS_AS(TrafficReader("/nonexistent"), std::runtime_error);
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("pipeline") {
+    SECTION("stages close in turn when the source closes") {
+        Chan<int> source(8);
+        Pipeline p;
+        std::atomic<long> sum{0};
+        std::atomic<int> batches{0};
+        p.from(source)
+            .map([](int x) {return x * 2;}, {4, 16})
+            .filter([](const int& x) {return x % 4 == 0;}, {2, 0})
+            .flat_map([](int x) {return std::vector<int>{x, -x, x};}, {3, 16})
+            .batch(10)
+            .sink([&](std::vector<int> b) {
+                REQUIRE(b.size() <= 10);
+                batches++;
+                for (int x : b) sum += x;
+            }, {2});
+        for (int i = 1; i <= 1000; ++i) source.send(i);
+        source.close();
+        p.wait();
+        // 4k for every even i = 2k, each counted once (x - x + x).
+        REQUIRE(sum == 2 * 500 * 501);
+        REQUIRE(batches >= 150);
+    }
+    SECTION("reading the last stage's channel") {
+        Pipeline p;
+        Chan<std::string> out = p.from(std::vector<int>{1, 2, 3})
+            .map([](int x) {return std::to_string(x);})
+            .chan();
+        std::vector<std::string> got;
+        out.foreach([&](std::string s) {got.push_back(s);});
+        p.wait();
+        REQUIRE(got == std::vector<std::string>{"1", "2", "3"});
+    }
+    SECTION("a failing stage stops the stages before and after it") {
+        std::vector<int> values(100000);
+        std::iota(values.begin(), values.end(), 0);
+        Pipeline p;
+        std::atomic<int> sunk{0};
+        p.from(values, {1, 0})
+            .map([](int x) {
+                if (x == 100) throw std::runtime_error("bad element");
+                return x;
+            }, {2, 0})
+            .map([](int x) {return x + 1;}, {2, 0})
+            .sink([&](int) {sunk++;});
+        REQUIRE_THROWS_WITH(p.wait(), "bad element");
+        REQUIRE(sunk < 1000);
+    }
+    SECTION("a failing sink stops the source") {
+        Chan<int> source(0);
+        Pipeline p;
+        p.from(source).map([](int x) {return x;}, {1, 0}).sink([](int) {throw std::logic_error("sink");});
+        std::thread feeder{[source]() mutable {
+            int i = 0;
+            while (source.send_status(i++) == ChanStatus::ok) {}
+        }};
+        REQUIRE_THROWS_AS(p.wait(), std::logic_error);
+        feeder.join();
+    }
+    SECTION("ordered_map keeps the input order") {
+        std::vector<int> values(2000);
+        std::iota(values.begin(), values.end(), 0);
+        Pipeline p;
+        std::vector<int> got;
+        p.from(values)
+            .ordered_map([](int x) {
+                if (x % 97 == 0) std::this_thread::sleep_for(std::chrono::microseconds(200));
+                return x * 3;
+            }, {4, 8}, 16)
+            .sink([&](int x) {got.push_back(x);});
+        p.wait();
+        REQUIRE(got.size() == values.size());
+        for (size_t i = 0; i < got.size(); ++i) REQUIRE(got[i] == static_cast<int>(3 * i));
+    }
+    SECTION("ordered_map: a slow element holds up the window") {
+        std::vector<int> values(200);
+        std::iota(values.begin(), values.end(), 0);
+        Pipeline p;
+        std::atomic<int> started{0};
+        int started_at_first = -1;
+        p.from(values)
+            .ordered_map([&](int x) {
+                started++;
+                if (x == 0) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                return x;
+            }, {4, 0}, 8)
+            .sink([&](int) {
+                if (started_at_first < 0) started_at_first = started;
+            });
+        p.wait();
+        // the other workers take no more than the window while element 0 is mapped.
+        REQUIRE(started_at_first <= 8);
+    }
+    SECTION("ordered_map: a failing element stops the stage") {
+        std::vector<int> values(10000);
+        std::iota(values.begin(), values.end(), 0);
+        Pipeline p;
+        std::vector<int> got;
+        p.from(values)
+            .ordered_map([](int x) {
+                if (x == 50) throw std::runtime_error("bad element");
+                return x;
+            }, {3, 0}, 4)
+            .sink([&](int x) {got.push_back(x);});
+        REQUIRE_THROWS_WITH(p.wait(), "bad element");
+        // in order, and nothing from after the failed element.
+        REQUIRE(got.size() <= 50);
+        for (size_t i = 0; i < got.size(); ++i) REQUIRE(got[i] == static_cast<int>(i));
+    }
+    SECTION("stateless stages with as many workers are fused") {
+        std::vector<int> values(1000);
+        std::iota(values.begin(), values.end(), 0);
+        Pipeline p;
+        std::atomic<long> sum{0};
+        p.from(values, {1, 16})
+            .map([](int x) {return x + 1;}, {2})
+            .filter([](const int& x) {return x % 2 == 0;}, {2, 8})
+            .flat_map([](int x) {return std::vector<long>{x, x};}, {2, 32})
+            .batch(4)
+            .map([](std::vector<long> b) {return b.size();})
+            .map([](size_t n) {return static_cast<long>(n);}, {1, 64, false})
+            .sink([&](long n) {sum += n;});
+        p.wait();
+        REQUIRE(sum == 1000);
+        REQUIRE(p.plan() ==
+            "source: 1 worker -> chan(16)\n"
+            "map > filter > flat_map: 2 workers -> chan(32)\n"
+            "batch: 1 worker -> chan(64)\n"
+            "map: 1 worker -> chan(64)\n"
+            "map > sink: 1 worker\n");
+        auto plan = p.physical_plan();
+        REQUIRE(plan.size() == 5);
+        REQUIRE(!plan.back().has_output);
+
+        Pipeline q;
+        q.from(values)
+            .flat_map([](int x) {return std::vector<int>{x};}, {2, 256})
+            .map([](int x) {return x;}, {2})
+            .batch(10)
+            .sink([](std::vector<int>) {});
+        q.wait();
+        REQUIRE(q.plan() ==
+            "source: 1 worker -> chan(64)\n"
+            "flat_map > map: 2 workers -> chan(256)\n"
+            "batch: 1 worker -> chan(64)\n"
+            "sink: 1 worker\n");
+    }
+    SECTION("a fused stage failing stops its input") {
+        Chan<int> source(0);
+        Pipeline p;
+        std::atomic<int> sunk{0};
+        p.from(source)
+            .filter([](const int& x) {
+                if (x == 10) throw std::runtime_error("bad element");
+                return true;
+            })
+            .map([](int x) {return x;})
+            .sink([&](int) {sunk++;});
+        std::thread feeder{[source]() mutable {
+            int i = 0;
+            while (source.send_status(i++) == ChanStatus::ok) {}
+        }};
+        REQUIRE_THROWS_WITH(p.wait(), "bad element");
+        feeder.join();
+        REQUIRE(sunk == 10);
+        REQUIRE(p.plan() == "filter > map > sink: 1 worker\n");
+    }
+    Pipeline p;
+    REQUIRE_THROWS_AS(p.from(std::vector<int>{}).map([](int x) {return x;}, {0, 1}), std::invalid_argument);
+    REQUIRE_THROWS_AS(p.from(std::vector<int>{}).batch(0), std::invalid_argument);
+}
+
+TEST_CASE("merge") {
+    SECTION("ready inputs are served round robin") {
+        std::vector<Chan<int>> inputs;
+        for (int i = 0; i < 1000; ++i) inputs.emplace_back(10);
+        for (int i = 0; i < 1000; ++i) {
+            for (int k = 0; k < 10; ++k) inputs[i].send(i * 100 + k);
+        }
+        Merge merged(inputs);
+        REQUIRE(merged.size() == 1000);
+        // each input once before any input twice, and each input's elements in order.
+        std::vector<int> next(1000, 0);
+        for (int round = 0; round < 10; ++round) {
+            std::vector<bool> seen(1000, false);
+            for (int i = 0; i < 1000; ++i) {
+                int v = merged.recv();
+                REQUIRE(!seen[v / 100]);
+                seen[v / 100] = true;
+                REQUIRE(v % 100 == next[v / 100]++);
+            }
+        }
+        int v;
+        REQUIRE(merged.try_recv(v) == ChanStatus::would_block);
+        for (auto& c : inputs) c.close();
+        REQUIRE(!merged.recv(v));
+        REQUIRE(merged.try_recv(v) == ChanStatus::closed);
+    }
+    SECTION("a parked consumer is woken by any input") {
+        std::vector<Chan<int>> inputs(100);
+        Merge merged(inputs);
+        std::thread sender{[&inputs]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            // unbuffered: the send parks until the merge takes it.
+            inputs[73].send(73);
+            inputs[5].send(5);
+            for (auto& c : inputs) c.close();
+        }};
+        std::vector<int> got;
+        merged.foreach([&](int x) {got.push_back(x);});
+        sender.join();
+        REQUIRE(got == std::vector<int>{73, 5});
+    }
+    SECTION("the inputs are released with the merge") {
+        Chan<int> a(1);
+        {
+            Merge merged(std::vector<Chan<int>>{a});
+#ifdef __linux__
+            REQUIRE_THROWS_AS(a.recv_fd(), std::logic_error);
+#endif
+            merged.close();
+            a.send(1);
+            REQUIRE(!merged.recv_optional());
+        }
+        REQUIRE(a.recv() == 1);
+#ifdef __linux__
+        REQUIRE(a.recv_fd() >= 0);
+        REQUIRE_THROWS_AS(Merge(std::vector<Chan<int>>{a}), std::logic_error);
+#endif
+    }
+    SECTION("no inputs") {
+        Merge merged(std::vector<Chan<int>>{});
+        REQUIRE(!merged.recv_optional());
+    }
+}
+
+struct ThrowingHashKey {
+    int key;
+};
+
+template<>
+struct std::hash<ThrowingHashKey> {
+    size_t operator()(const ThrowingHashKey& k) const {return std::hash<int>{}(k.key);}
+};
+
+TEST_CASE("partitioned channel") {
+    struct Event {
+        int key;
+        int seq;
+    };
+    auto key_of = [](const Event& e) {return e.key;};
+
+    SECTION("each key goes to one partition, in order") {
+        PartitionedChan<Event, decltype(key_of)> events(4, 1000, key_of);
+        REQUIRE(events.partitions() == 4);
+        for (int seq = 0; seq < 10; ++seq) {
+            for (int key = 0; key < 100; ++key) events.send(Event{key, seq});
+        }
+        events.close();
+        REQUIRE_THROWS_AS(events.close(), CloseOfClosedChannelException);
+        REQUIRE_THROWS_AS(events.send(Event{0, 0}), SendOnClosedChannelException);
+
+        std::vector<int> partition_of_key(100, -1);
+        std::vector<int> next(100, 0);
+        std::vector<size_t> sizes;
+        for (size_t i = 0; i < events.partitions(); ++i) {
+            size_t n = 0;
+            events.partition(i).foreach([&](Event e) {
+                if (partition_of_key[e.key] < 0) partition_of_key[e.key] = static_cast<int>(i);
+                REQUIRE(partition_of_key[e.key] == static_cast<int>(i));
+                REQUIRE(e.seq == next[e.key]++);
+                n++;
+            });
+            sizes.push_back(n);
+        }
+        for (int key = 0; key < 100; ++key) {
+            REQUIRE(next[key] == 10);
+            REQUIRE(events.partition_of(Event{key, 0}) == static_cast<size_t>(partition_of_key[key]));
+        }
+        // consecutive keys spread over every partition.
+        for (size_t n : sizes) REQUIRE(n > 0);
+        REQUIRE_THROWS_AS(events.partition(4), std::out_of_range);
+    }
+    SECTION("keys that differ only in high bits spread too") {
+        PartitionedChan<Event, decltype(key_of)> events(8, 1, key_of);
+        std::vector<bool> used(8, false);
+        for (int key = 0; key < 64; ++key) used[events.partition_of(Event{key << 16, 0})] = true;
+        for (bool u : used) REQUIRE(u);
+    }
+    SECTION("one consumer per partition, with unshared per-key state") {
+        PartitionedChan<Event, decltype(key_of)> events(3, 16, key_of);
+        std::vector<std::vector<int>> counts(3, std::vector<int>(50, 0));
+        std::vector<std::thread> consumers;
+        for (size_t i = 0; i < 3; ++i) {
+            consumers.emplace_back([&events, &counts, i]() {
+                events.partition(i).foreach([&](Event e) {counts[i][e.key]++;});
+            });
+        }
+        std::vector<std::thread> producers;
+        for (int p = 0; p < 2; ++p) {
+            producers.emplace_back([events]() mutable {
+                for (int seq = 0; seq < 100; ++seq) {
+                    for (int key = 0; key < 50; ++key) events.send(Event{key, seq});
+                }
+            });
+        }
+        for (auto& t : producers) t.join();
+        events.close();
+        for (auto& t : consumers) t.join();
+        for (int key = 0; key < 50; ++key) {
+            int total = 0;
+            int holders = 0;
+            for (size_t i = 0; i < 3; ++i) {
+                total += counts[i][key];
+                if (counts[i][key] > 0) holders++;
+            }
+            REQUIRE(total == 200);
+            REQUIRE(holders == 1);
+        }
+    }
+    SECTION("the status API is noexcept only if key_of and the hash are") {
+        auto nothrow_key = [](const Event& e) noexcept {return e.key;};
+        static_assert(noexcept(std::declval<PartitionedChan<Event, decltype(nothrow_key)>&>().try_send(Event{0, 0})));
+        // key_of may throw.
+        static_assert(!noexcept(std::declval<PartitionedChan<Event, decltype(key_of)>&>().try_send(Event{0, 0})));
+        // std::hash<ThrowingHashKey> may throw.
+        auto hashed_key = [](const Event& e) noexcept {return ThrowingHashKey{e.key};};
+        static_assert(!noexcept(std::declval<PartitionedChan<Event, decltype(hashed_key)>&>().try_send(Event{0, 0})));
+    }
+    SECTION("no partitions") {
+        REQUIRE_THROWS_AS((PartitionedChan<Event, decltype(key_of)>(0, 1, key_of)), std::invalid_argument);
+    }
+}
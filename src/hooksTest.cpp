@@ -0,0 +1,151 @@
+#define CATCH_CONFIG_MAIN
+// the chan_trace and chan_watchdog hooks are compiled in here only: chan.h must be built the same
+// way in every translation unit of a binary, and channelsTest.cpp covers the default, hook-free build.
+#define CHAN_TRACE
+#define CHAN_WATCHDOG
+#include "libs/catch.hpp"
+#include "chan.h"
+
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+void recv_n(Chan<int> chan, int n) {
+    int num;
+    chan.recv(num);
+    REQUIRE(num == n);
+}
+
+// the hooks allocate a thread's buffers on first use, so their channels' status API may throw.
+static_assert(!noexcept(std::declval<Chan<int>&>().send_status(1)));
+static_assert(noexcept(std::declval<Chan<int, chan_policy::NoHooks>&>().send_status(1)));
+
+TEST_CASE("chrome trace export") {
+    Chan<int> chan;
+
+    chan_trace::clear();
+    chan_trace::start();
+    // receiver parks first, so the send is a handoff to a blocked thread.
+    std::thread t1{recv_n, chan, 3};
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    chan.send(3);
+    t1.join();
+    chan.close();
+    chan_trace::stop();
+
+    std::ostringstream out;
+    chan_trace::write_json(out);
+    std::string json = out.str();
+
+    REQUIRE(json.find("\"traceEvents\"") != std::string::npos);
+    REQUIRE(json.find("\"name\":\"blocked\"") != std::string::npos);
+    REQUIRE(json.find("\"name\":\"close\"") != std::string::npos);
+
+    // the sender's flow start and the receiver's flow end share an id.
+    auto s = json.find("\"ph\":\"s\",\"id\":");
+    auto f = json.find("\"ph\":\"f\",\"bp\":\"e\",\"id\":");
+    REQUIRE(s != std::string::npos);
+    REQUIRE(f != std::string::npos);
+    auto id_at = [&](size_t pos) {
+        pos = json.find("\"id\":", pos) + 5;
+        return json.substr(pos, json.find(',', pos) - pos);
+    };
+    REQUIRE(id_at(s) == id_at(f));
+}
+
+TEST_CASE("chrome trace export: thread names and Spsc waits") {
+    Chan<int, chan_policy::Spsc> chan(1);
+
+    chan_trace::clear();
+    chan_trace::start();
+    // the Spsc receiver parks, and its waker records no flow.
+    std::thread t1{[chan]() mutable {
+        chan_trace::set_thread_name("a \"quoted\" \\ name\n");
+        REQUIRE(chan.recv() == 1);
+    }};
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    chan.send(1);
+    t1.join();
+    chan_trace::stop();
+
+    std::ostringstream out;
+    chan_trace::write_json(out);
+    std::string json = out.str();
+
+    REQUIRE(json.find("\"name\":\"a \\\"quoted\\\" \\\\ name\\u000a\"") != std::string::npos);
+    REQUIRE(json.find("\"name\":\"blocked\"") != std::string::npos);
+    REQUIRE(json.find("\"id\":0,") == std::string::npos);
+}
+
+TEST_CASE("deadlock watchdog") {
+    std::mutex report_lock;
+    std::vector<chan_watchdog::Report> deadlocks;
+    std::vector<chan_watchdog::Report> stalls;
+
+    chan_watchdog::Config config;
+    config.poll_interval = std::chrono::milliseconds(20);
+    config.stall_threshold = std::chrono::milliseconds(100);
+    config.on_deadlock = [&](const chan_watchdog::Report& r) {
+        std::scoped_lock lck{report_lock};
+        deadlocks.push_back(r);
+    };
+    config.on_stall = [&](const chan_watchdog::Report& r) {
+        std::scoped_lock lck{report_lock};
+        stalls.push_back(r);
+    };
+    chan_watchdog::start(config);
+
+    SECTION("all workers blocked is reported with the wait graph") {
+        Chan<int> a;
+        Chan<int> b;
+        // each worker waits for the other to send first.
+        auto worker = [](Chan<int> in, Chan<int> out, std::string name) {
+            chan_watchdog::WorkerScope scope{name};
+            int n;
+            if (in.recv(n)) out.send(n);
+        };
+        std::thread t1{worker, a, b, "worker a"};
+        std::thread t2{worker, b, a, "worker b"};
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+        {
+            std::scoped_lock lck{report_lock};
+            REQUIRE(deadlocks.size() == 1);
+            REQUIRE(deadlocks[0].deadlock);
+            REQUIRE(deadlocks[0].waiters.size() == 2);
+            for (auto& w : deadlocks[0].waiters) {
+                REQUIRE(w.is_worker);
+                REQUIRE(w.op == chan_watchdog::Op::recv);
+            }
+            REQUIRE(deadlocks[0].to_string().find("worker a [worker] -> recv on chan") != std::string::npos);
+            REQUIRE(stalls.size() == 1);
+            REQUIRE(stalls[0].waiters.size() == 2);
+        }
+
+        a.close();
+        b.close();
+        t1.join();
+        t2.join();
+    }
+    SECTION("a pending timer is not a deadlock") {
+        Chan<int> chan;
+        std::thread t1{[](Chan<int> chan) {
+            chan_watchdog::WorkerScope scope;
+            chan.recv();
+        }, chan};
+        {
+            chan_watchdog::TimerScope timer;
+            std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        }
+        chan.send(1);
+        t1.join();
+
+        std::scoped_lock lck{report_lock};
+        REQUIRE(deadlocks.empty());
+        REQUIRE(stalls.size() == 1);
+        REQUIRE(!stalls[0].deadlock);
+    }
+
+    chan_watchdog::stop();
+}
@@ -1,62 +1,104 @@
 #include "../chan.h"
+#include "bench/bench.h"
+#include "bench/perf_counters.h"
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <numeric>
 #include <random>
 #include <chrono>
+#include <string>
+#include <thread>
+
+////////////////////////////////////////////////////////////////////////////////
+// Payload types
+
+// a fixed-size, trivially copyable message, ex. a 64-byte struct or a 4 KB frame.
+template<size_t N>
+struct Bytes {
+    std::array<char, N> data;
+};
+
+// logical payload size of a message, for bytes/second.
+// a pointer counts as the frame it points to, so copy and pointer-passing designs compare directly.
+template<typename T>
+size_t payload_bytes(const T&) {
+    return sizeof(T);
+}
+
+inline size_t payload_bytes(const std::string& s) {
+    return s.size();
+}
+
+template<typename T>
+size_t payload_bytes(const std::unique_ptr<T>& p) {
+    return p ? payload_bytes(*p) : 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Send and Recv
 
 // probably, senders will exit earlier than the recvers.
+// sender_data is moved into the channel, so move-only types work,
+// and types that are cheap to move (std::string, std::unique_ptr) are not deep-copied.
 template<typename T>
 void do_send(
-	Chan<T>& chan,
-	std::vector<T>& sender_data,
-	std::chrono::microseconds& elapsed) {
+    Chan<T>& chan,
+    std::vector<T>& sender_data,
+    std::chrono::microseconds& elapsed) {
 
     auto start = std::chrono::high_resolution_clock::now();
-    for (auto data : sender_data) {
-        chan.send(data);
+    for (auto& data : sender_data) {
+        chan.send(std::move(data));
     }
     elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
-    	std::chrono::high_resolution_clock::now() - start);
+        std::chrono::high_resolution_clock::now() - start);
 }
 
 template<typename T>
 void do_recv(
-	Chan<T>& chan,
-	std::vector<T>& recver_data,
-	std::chrono::microseconds& elapsed,
-	std::atomic<unsigned>& recv_count,
-	unsigned& n_data,
-	std::condition_variable& all_recved_cond) {
-
-	T data;
-	bool received;
-	while (true) {
-		auto start = std::chrono::high_resolution_clock::now();
-		received = chan.recv(data);
-		elapsed += std::chrono::duration_cast<std::chrono::microseconds>(
-			std::chrono::high_resolution_clock::now() - start);
-		if (received) {
-			recver_data.push_back(data);
-			recv_count += 1;
-			// TODO non-atomic btw ++ and load ok?
-			if (recv_count == n_data) {
-				// last data recieved. notify main thread to close.
-				all_recved_cond.notify_one();
-				break;
-			}
-		} else { // channel closed
-			break;
-		}
-	}
+    Chan<T>& chan,
+    std::vector<T>& recver_data,
+    std::chrono::microseconds& elapsed,
+    std::atomic<unsigned>& recv_count,
+    unsigned& n_data,
+    std::mutex& all_recved_mutex,
+    std::condition_variable& all_recved_cond) {
+
+    T data;
+    bool received;
+    while (true) {
+        auto start = std::chrono::high_resolution_clock::now();
+        received = chan.recv(data);
+        elapsed += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::high_resolution_clock::now() - start);
+        if (received) {
+            recver_data.push_back(std::move(data));
+            if (++recv_count == n_data) {
+                // last data recieved. notify main thread to close.
+                // notify under the lock, so the main thread can't miss it between its check and its wait.
+                std::scoped_lock lck{all_recved_mutex};
+                all_recved_cond.notify_one();
+                break;
+            }
+        } else { // channel closed
+            break;
+        }
+    }
 }
 
 void print_duration_vector(std::vector<std::chrono::microseconds>& v) {
-	for (auto i = 0; i < v.size(); ++i) {
-		std::cout << v[i].count();
-		if (i < v.size() - 1) {
-			std::cout << ",";
-		}
-	}
-	std::cout << std::endl;
+    for (auto i = 0; i < v.size(); ++i) {
+        std::cout << v[i].count();
+        if (i < v.size() - 1) {
+            std::cout << ",";
+        }
+    }
+    std::cout << std::endl;
 }
 
 std::pair<double, double> get_mean_stdev(std::vector<std::chrono::microseconds>& v) {
@@ -81,18 +123,22 @@ double get_mean(std::vector<std::chrono::microseconds>& v) {
     return mean;
 }
 
+// PerfCounters names, in csv column order.
+const std::vector<std::string> perf_column_names{
+    "cycles", "instructions", "cache_misses", "branch_misses",
+    "context_switches", "cpu_migrations", "voluntary_switches", "involuntary_switches"};
+
 template<typename T, typename RandomFunctor>
 void measure_parallel_send_and_recv(
-	RandomFunctor random_functor,
-	// this sucks, but getting type name requires cxxabi.h or boost.
-	std::string name_of_T,
-	// be careful of argument order. TODO use strong types.
+    RandomFunctor random_functor,
+    // this sucks, but getting type name requires cxxabi.h or boost.
+    std::string name_of_T,
+    // be careful of argument order. TODO use strong types.
     unsigned buffer_sz = 0,
     unsigned n_senders = 3,
     unsigned n_recvers = 3,
     unsigned n_data = 100000,
     bool debug = true) {
-    // bool is_T_comparable = false) {
 
     assert((n_senders > 0 && n_recvers > 0 && n_data > 100));
 
@@ -101,24 +147,23 @@ void measure_parallel_send_and_recv(
     ////////////////////////////////////////////////////////////////////////////////
     // Data & Container Generation
 
-    // all_sender_data contains n_data of type T, each generated by random_functor.
-    std::vector<T> all_sender_data;
-    for (auto i = 0; i < n_data; ++i) {
-    	all_sender_data.push_back(random_functor());
-    }
-
-    // split it (almost) equally among (except for last) senders.
-    std::vector<std::vector<T>> each_sender_data;
-    const std::size_t each_sender_data_size = all_sender_data.size() / n_senders;
-    auto begin = all_sender_data.begin();
+    // n_data of type T, each generated by random_functor,
+    // split (almost) equally among (except for last) senders.
+    // generated in place rather than copied out of one big vector, so T may be move-only.
+    std::vector<std::vector<T>> each_sender_data(n_senders);
+    const std::size_t each_sender_data_size = n_data / n_senders;
+    size_t total_bytes = 0;
     for (auto i = 0; i < n_senders; ++i) {
-        auto end = i == n_senders - 1 ? all_sender_data.end() : begin + each_sender_data_size;
-        each_sender_data.push_back(std::vector<T>(begin, end));
-        begin = end;
+        auto size = i == n_senders - 1 ? n_data - each_sender_data_size * (n_senders - 1) : each_sender_data_size;
+        each_sender_data[i].reserve(size);
+        for (auto j = 0; j < size; ++j) {
+            each_sender_data[i].push_back(random_functor());
+            total_bytes += payload_bytes(each_sender_data[i].back());
+        }
     }
 
     // n_recvers vectors for recvers to fill.
-    std::vector<std::vector<T>> each_recver_data(n_recvers, std::vector<T>(0));
+    std::vector<std::vector<T>> each_recver_data(n_recvers);
 
     // elapsed time to be returned by threads.
     std::vector<std::chrono::microseconds> each_sender_duration(n_senders);
@@ -134,125 +179,410 @@ void measure_parallel_send_and_recv(
     // threads to join later.
     std::vector<std::thread> threads;
 
+    // counts the sender and recver threads too, once they are joined.
+    bench::PerfCounters perf;
+    perf.start();
+
+    auto start = std::chrono::high_resolution_clock::now();
+
     // launch all senders.
     for (auto i = 0; i < n_senders; ++i){
-    	std::thread t{
-        	do_send<int>,
-        	std::ref(chan),
-        	std::ref(each_sender_data[i]),
-        	std::ref(each_sender_duration[i])
+        std::thread t{
+            do_send<T>,
+            std::ref(chan),
+            std::ref(each_sender_data[i]),
+            std::ref(each_sender_duration[i])
         };
         threads.push_back(std::move(t));
     }
 
     // launch all recvers.
     for (auto i = 0; i < n_recvers; ++i) {
-        //std::thread t{recv_for_seconds, std::ref(chan), std::ref(each_recver_data[i]), std::ref(recv_for)};
         std::thread t{
-        	do_recv<int>,
-        	std::ref(chan),
-        	std::ref(each_recver_data[i]),
-        	std::ref(each_recver_duration[i]),
-        	std::ref(recv_count),
-        	std::ref(n_data),
-        	std::ref(all_recved_cond)
+            do_recv<T>,
+            std::ref(chan),
+            std::ref(each_recver_data[i]),
+            std::ref(each_recver_duration[i]),
+            std::ref(recv_count),
+            std::ref(n_data),
+            std::ref(all_recved_mutex),
+            std::ref(all_recved_cond)
         };
         threads.push_back(std::move(t));
     }
 
-    // one recver will recv last element, and increment recv_count to 1000.
+    // one recver will recv last element, and increment recv_count to n_data.
     // then, that recver will notify this main thread.
     // upon wakeup, the main thread closes the channel, so that other recvers can also exit.
     // why lock? condition variables require use of lock, and we can't use future/promise pair here.
     std::unique_lock<std::mutex> lck {all_recved_mutex};
-    all_recved_cond.wait(lck);
+    all_recved_cond.wait(lck, [&] {return recv_count == n_data;});
     lck.unlock();
 
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::high_resolution_clock::now() - start);
+
     chan.close();
 
     // wait for all senders and recvers to finish.
     for (auto i = 0; i < threads.size(); ++i) {
-    	threads[i].join();
+        threads[i].join();
     }
 
+    perf.stop();
+
     ////////////////////////////////////////////////////////////////////////////////
     // Sanity check
 
     if (debug == true) {
-    	int recved_data_count = 0;
-    	for (auto recver_data : each_recver_data) {
-    		recved_data_count += recver_data.size();
-    	}
-
-    	assert(recved_data_count == n_data);
-
-    	/* if T is not comparable, this will fail at compile time?
-    	if (is_T_comparable == true) {
-		    // merge each_recver_data
-		    std::vector<T> all_recver_data;
-		    for (auto recver_data : each_recver_data) {
-		        all_recver_data.insert(all_recver_data.end(), recver_data.begin(), recver_data.end());
-		    }
-
-		    std::sort(all_recver_data.begin(), all_recver_data.end());
-		    std::sort(all_sender_data.begin(), all_sender_data.end());
-		    assert(all_recver_data == all_sender_data);
-		}
-		*/
-	}
-
-	////////////////////////////////////////////////////////////////////////////////
-	// Output results for data collection in .csv
-	// ex: g++ -std=c++11 ParallelSendRecv.cpp -o psr; ./psr > out.csv
+        size_t recved_data_count = 0;
+        size_t recved_bytes = 0;
+        for (auto& recver_data : each_recver_data) {
+            recved_data_count += recver_data.size();
+            for (auto& data : recver_data) {
+                recved_bytes += payload_bytes(data);
+            }
+        }
+
+        // not assert(): benchmarks are built with NDEBUG.
+        // the byte count also catches a moved-from string or null pointer arriving instead of the payload.
+        if (recved_data_count != n_data || recved_bytes != total_bytes) {
+            std::cerr << name_of_T << ": received " << recved_data_count << " messages, " << recved_bytes
+                << " bytes; sent " << n_data << " messages, " << total_bytes << " bytes" << std::endl;
+            std::abort();
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Output results for data collection in .csv
+    // ex: ./bin/parallel_send_recv > out.csv
 
     auto send_mean = get_mean(each_sender_duration);
     auto recv_mean = get_mean(each_recver_duration);
+    double seconds = elapsed.count() / 1e6;
 
     std::cout << buffer_sz << ","
         << n_senders << ","
         << n_recvers << ","
         << n_data << ","
         << name_of_T << ","
+        << total_bytes / n_data << ","
         << send_mean << ","
-        << recv_mean << std::endl;
+        << recv_mean << ","
+        << elapsed.count() << ","
+        << static_cast<uint64_t>(n_data / seconds) << ","
+        << static_cast<uint64_t>(total_bytes / seconds);
+    // per message; empty where the counter is unavailable (ex. no PMU in a container).
+    auto counters = perf.results();
+    for (auto name : perf_column_names) {
+        std::cout << ",";
+        for (auto& [counter, value] : counters) {
+            if (counter == name) std::cout << value / n_data;
+        }
+    }
+    std::cout << std::endl;
         //<< send_mean_stdev.second << ","
         //<< recv_mean_stdev.second << ","
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// Open-loop Send and Recv
+//
+// do_send above is closed-loop: while chan.send blocks, the sender issues nothing,
+// so the time a message would have spent waiting is never measured (coordinated omission).
+// here senders follow a fixed schedule instead: message i of a sender is due at
+// start + offset + i * period, regardless of how long earlier sends blocked.
+// each message carries its due time, and recvers measure latency from it,
+// so queueing delay behind a blocked send is part of the latency.
+
+using OpenLoopClock = std::chrono::steady_clock;
+
+template<typename T>
+struct Timed {
+    OpenLoopClock::time_point intended;
+    T payload;
+};
+
+template<typename T>
+void do_send_open_loop(
+    Chan<Timed<T>>& chan,
+    std::vector<T>& sender_data,
+    OpenLoopClock::time_point first,
+    OpenLoopClock::duration period) {
+
+    for (size_t i = 0; i < sender_data.size(); ++i) {
+        auto intended = first + i * period;
+        // if a blocked send put us behind schedule, send right away: the message is already late.
+        chan_tap::wait_until(intended);
+        chan.send(Timed<T>{intended, std::move(sender_data[i])});
+    }
+}
+
+template<typename T>
+void do_recv_open_loop(
+    Chan<Timed<T>>& chan,
+    std::vector<double>& latencies_us,
+    OpenLoopClock::time_point& last_recv,
+    std::atomic<unsigned>& recv_count,
+    unsigned& n_data,
+    std::mutex& all_recved_mutex,
+    std::condition_variable& all_recved_cond) {
+
+    Timed<T> data;
+    while (chan.recv(data)) {
+        auto now = OpenLoopClock::now();
+        latencies_us.push_back(std::chrono::duration<double, std::micro>(now - data.intended).count());
+        last_recv = now;
+        if (++recv_count == n_data) {
+            std::scoped_lock lck{all_recved_mutex};
+            all_recved_cond.notify_one();
+            break;
+        }
+    }
+}
+
+// offers `rate` messages per second in total, spread evenly over the senders, for `seconds`.
+template<typename T, typename RandomFunctor>
+void measure_open_loop_send_and_recv(
+    RandomFunctor random_functor,
+    std::string name_of_T,
+    unsigned buffer_sz,
+    unsigned n_senders,
+    unsigned n_recvers,
+    double rate,
+    double seconds) {
+
+    unsigned n_data = static_cast<unsigned>(rate * seconds);
+    assert((n_senders > 0 && n_recvers > 0 && n_data >= n_senders));
+
+    Chan<Timed<T>> chan(buffer_sz);
+
+    std::vector<std::vector<T>> each_sender_data(n_senders);
+    for (unsigned i = 0; i < n_data; ++i) {
+        each_sender_data[i % n_senders].push_back(random_functor());
+    }
+
+    std::vector<std::vector<double>> each_recver_latencies(n_recvers);
+    std::vector<OpenLoopClock::time_point> each_recver_last(n_recvers);
+    std::atomic<unsigned> recv_count{0};
+    std::condition_variable all_recved_cond;
+    std::mutex all_recved_mutex;
+    std::vector<std::thread> threads;
+
+    for (unsigned i = 0; i < n_recvers; ++i) {
+        threads.emplace_back(
+            do_recv_open_loop<T>,
+            std::ref(chan),
+            std::ref(each_recver_latencies[i]),
+            std::ref(each_recver_last[i]),
+            std::ref(recv_count),
+            std::ref(n_data),
+            std::ref(all_recved_mutex),
+            std::ref(all_recved_cond));
+    }
+
+    // each sender offers rate / n_senders, interleaved with the others by offset.
+    auto period = std::chrono::duration_cast<OpenLoopClock::duration>(
+        std::chrono::duration<double>(n_senders / rate));
+    // a little slack so every sender is running before its first message is due.
+    auto start = OpenLoopClock::now() + std::chrono::milliseconds(10);
+    for (unsigned i = 0; i < n_senders; ++i) {
+        threads.emplace_back(
+            do_send_open_loop<T>,
+            std::ref(chan),
+            std::ref(each_sender_data[i]),
+            start + i * period / n_senders,
+            period);
+    }
+
+    std::unique_lock<std::mutex> lck {all_recved_mutex};
+    all_recved_cond.wait(lck, [&] {return recv_count == n_data;});
+    lck.unlock();
+
+    chan.close();
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    std::vector<double> latencies;
+    for (auto& l : each_recver_latencies) {
+        latencies.insert(latencies.end(), l.begin(), l.end());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto end = *std::max_element(each_recver_last.begin(), each_recver_last.end());
+    double achieved = n_data / std::chrono::duration<double>(end - start).count();
+
+    std::cout << buffer_sz << ","
+        << n_senders << ","
+        << n_recvers << ","
+        << name_of_T << ","
+        << static_cast<uint64_t>(rate) << ","
+        << static_cast<uint64_t>(achieved) << ","
+        << bench::percentile(latencies, 50) << ","
+        << bench::percentile(latencies, 90) << ","
+        << bench::percentile(latencies, 99) << ","
+        << bench::percentile(latencies, 99.9) << ","
+        << latencies.back() << ","
+        // past the knee, the channel can't keep up and latency grows with the run length.
+        << (achieved < 0.95 * rate ? "saturated" : "ok") << std::endl;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Replay of recorded traffic
+//
+// like the open-loop experiment, but the schedule and the sizes come from a recording made with
+// TrafficRecorder (tap.h) instead of a fixed rate and random values. payloads are replayed as
+// strings of their recorded bytes, or of their recorded size if the file has none.
+
+void measure_replay(const std::string& path, double speed, unsigned buffer_sz, unsigned n_recvers) {
+    Chan<Timed<std::string>> chan(buffer_sz);
+
+    std::vector<std::vector<double>> each_recver_latencies(n_recvers);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < n_recvers; ++i) {
+        threads.emplace_back([&chan, &latencies_us = each_recver_latencies[i]]() {
+            Timed<std::string> data;
+            while (chan.recv(data)) {
+                latencies_us.push_back(std::chrono::duration<double, std::micro>(OpenLoopClock::now() - data.intended).count());
+            }
+        });
+    }
+
+    TrafficReader in(path);
+    uint64_t last_ns = 0;
+    ReplayStats stats = replay(in, chan, [&](const TrafficRecord& r, OpenLoopClock::time_point due) {
+        last_ns = r.time_ns;
+        std::string payload = r.payload.empty()
+            ? std::string(r.size, 'x')
+            : std::string(reinterpret_cast<const char*>(r.payload.data()), r.payload.size());
+        return Timed<std::string>{due, std::move(payload)};
+    }, ReplayOptions{speed});
+    chan.close();
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    std::vector<double> latencies;
+    for (auto& l : each_recver_latencies) {
+        latencies.insert(latencies.end(), l.begin(), l.end());
+    }
+    if (latencies.empty()) return;
+    std::sort(latencies.begin(), latencies.end());
+    double offered = speed > 0 && last_ns > 0 ? stats.sent / (last_ns / speed / 1e9) : 0;
+
+    std::cout << buffer_sz << ","
+        << n_recvers << ","
+        << stats.sent << ","
+        << speed << ","
+        << static_cast<uint64_t>(offered) << ","
+        << static_cast<uint64_t>(stats.sent / (stats.elapsed_ns / 1e9)) << ","
+        << stats.mean_lateness_ns / 1000 << ","
+        << bench::percentile(latencies, 50) << ","
+        << bench::percentile(latencies, 90) << ","
+        << bench::percentile(latencies, 99) << ","
+        << bench::percentile(latencies, 99.9) << ","
+        << latencies.back() << std::endl;
+}
+
+void sweep_replay(const std::string& path, double speed) {
+    std::cout << "buffer size,"
+        "number of recvers,"
+        "records,"
+        "speed,"
+        "offered rate,"
+        "achieved rate,"
+        "mean lateness us,"
+        "latency p50 us,"
+        "latency p90 us,"
+        "latency p99 us,"
+        "latency p99.9 us,"
+        "latency max us" << std::endl;
+
+    for (unsigned buffer_size : {0u, 64u, 1024u}) {
+        measure_replay(path, speed, buffer_size, 2);
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Random Functors
 
 // 1. int (see textbook 14.5)
 class Rand_int {
 private:
-	std::default_random_engine random_engine;
-	std::uniform_int_distribution<> distribution;
+    std::default_random_engine random_engine;
+    std::uniform_int_distribution<> distribution;
 public:
-	Rand_int(int low, int high) : distribution{low, high} {
-		random_engine.seed(std::chrono::system_clock::now().time_since_epoch().count());
-	}
-	int operator()() {
-		return distribution(random_engine);
-	}
+    Rand_int(int low, int high) : distribution{low, high} {
+        random_engine.seed(std::chrono::system_clock::now().time_since_epoch().count());
+    }
+    int operator()() {
+        return distribution(random_engine);
+    }
+};
+
+// 2. fixed-size trivially copyable struct.
+template<size_t N>
+class Rand_bytes {
+private:
+    Rand_int rnd {0, 255};
+public:
+    Bytes<N> operator()() {
+        Bytes<N> b;
+        std::memset(b.data.data(), rnd(), N);
+        return b;
+    }
+};
+
+// 3. std::string of a given length: non-trivially copyable, heap-allocated beyond the SSO size.
+class Rand_string {
+private:
+    Rand_int rnd {'a', 'z'};
+    size_t length;
+public:
+    explicit Rand_string(size_t n) : length(n) {}
+    std::string operator()() {
+        return std::string(length, static_cast<char>(rnd()));
+    }
+};
+
+// 4. move-only pointer to a frame: the pointer-passing alternative to Bytes<N>.
+template<size_t N>
+class Rand_unique_bytes {
+private:
+    Rand_bytes<N> rnd;
+public:
+    std::unique_ptr<Bytes<N>> operator()() {
+        return std::make_unique<Bytes<N>>(rnd());
+    }
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 // Experiments
 
-int main() {
-    // column titles.
+void print_column_titles() {
     std::cout << "buffer size,"
         "number of senders,"
         "number of recvers,"
         "number of data,"
         "data type,"
+        "payload bytes,"
         "sender duartion mean,"
-        "recver duartion mean" << std::endl;
+        "recver duartion mean,"
+        "elapsed,"
+        "messages per second,"
+        "bytes per second";
+    for (auto& name : perf_column_names) {
+        std::cout << "," << name << " per message";
+    }
+    std::cout << std::endl;
         //"sender duartion standard deviation,"
         //"recver duartion standard deviation" << std::endl;
+}
 
-	// be careful of argument order.
-	Rand_int rnd {0, 100000000};
+// senders x recvers x data size x buffer size, for ints.
+void sweep_threads() {
+    // be careful of argument order.
+    Rand_int rnd {0, 100000000};
 
     std::vector<unsigned> data_sizes{100'000, 200'000, 400'000, 800'000, 1'600'000};
     std::vector<unsigned> buffer_sizes{0, 10, 20, 30, 40, 50};
@@ -272,7 +602,88 @@ int main() {
             }
         }
     }
+}
+
+// payload type and size x buffer size, for picking copy vs pointer-passing designs.
+void sweep_payloads() {
+    std::vector<unsigned> buffer_sizes{0, 64};
+    const unsigned n_senders = 2;
+    const unsigned n_recvers = 2;
+    // fewer large messages, so a run holds at most ~100 MB of payload.
+    const unsigned n_small = 400'000;
+    const unsigned n_large = 25'000;
+
+    for (auto buffer_size : buffer_sizes) {
+        measure_parallel_send_and_recv<int>(
+            Rand_int{0, 100000000}, "int", buffer_size, n_senders, n_recvers, n_small);
+        measure_parallel_send_and_recv<Bytes<64>>(
+            Rand_bytes<64>{}, "struct64", buffer_size, n_senders, n_recvers, n_small);
+        measure_parallel_send_and_recv<std::string>(
+            Rand_string{64}, "string64", buffer_size, n_senders, n_recvers, n_small);
+        measure_parallel_send_and_recv<Bytes<4096>>(
+            Rand_bytes<4096>{}, "frame4096", buffer_size, n_senders, n_recvers, n_large);
+        measure_parallel_send_and_recv<std::string>(
+            Rand_string{4096}, "string4096", buffer_size, n_senders, n_recvers, n_large);
+        measure_parallel_send_and_recv<std::unique_ptr<Bytes<4096>>>(
+            Rand_unique_bytes<4096>{}, "unique_ptr_frame4096", buffer_size, n_senders, n_recvers, n_large);
+    }
+}
+
+// offered load x buffer size, open-loop: throughput-vs-latency curves to find each configuration's knee.
+void sweep_open_loop() {
+    std::cout << "buffer size,"
+        "number of senders,"
+        "number of recvers,"
+        "data type,"
+        "offered rate,"
+        "achieved rate,"
+        "latency p50 us,"
+        "latency p90 us,"
+        "latency p99 us,"
+        "latency p99.9 us,"
+        "latency max us,"
+        "status" << std::endl;
+
+    std::vector<unsigned> buffer_sizes{0, 64};
+    std::vector<double> rates{10'000, 20'000, 50'000, 100'000, 200'000, 500'000, 1'000'000};
+    const double seconds = 1;
+
+    for (auto buffer_size : buffer_sizes) {
+        for (auto rate : rates) {
+            measure_open_loop_send_and_recv<int>(
+                Rand_int{0, 100000000}, "int", buffer_size, 2, 2, rate, seconds);
+        }
+    }
+}
+
+// usage: parallel_send_recv [threads|payload|open-loop|replay FILE [SPEED]]
+int main(int argc, char** argv) {
+    std::string experiment = argc > 1 ? argv[1] : "threads";
+    if (experiment != "threads" && experiment != "payload" && experiment != "open-loop"
+        && !(experiment == "replay" && argc > 2)) {
+        std::cerr << "usage: " << argv[0] << " [threads|payload|open-loop|replay FILE [SPEED]]" << std::endl;
+        return 2;
+    }
+
+    if (experiment == "replay") {
+        sweep_replay(argv[2], argc > 3 ? std::stod(argv[3]) : 1.0);
+        return 0;
+    }
+
+    if (experiment == "open-loop") {
+        sweep_open_loop();
+        return 0;
+    }
+
+    // column titles.
+    print_column_titles();
+
+    if (experiment == "payload") {
+        sweep_payloads();
+    } else {
+        sweep_threads();
+    }
 
-	//measure_parallel_send_and_recv<int>(rnd, "int");
-	//measure_parallel_send_and_recv<int>(rnd, "int", 0, 3, 3, 1000);
+    //measure_parallel_send_and_recv<int>(rnd, "int");
+    //measure_parallel_send_and_recv<int>(rnd, "int", 0, 3, 3, 1000);
 }
@@ -0,0 +1,205 @@
+#include "../chan.h"
+#include "bench/affinity.h"
+#include "bench/bench.h"
+#include <functional>
+#include <iostream>
+#include <latch>
+#include <thread>
+
+// Sweeps producers x consumers from 1 up to hardware_concurrency and beyond (oversubscription),
+// under each pinning policy, for each backend, with repeated trials,
+// and writes one tidy CSV row per configuration with a 95% confidence interval of throughput.
+//
+// usage: scalability_matrix [--trials=N] [--messages=N] [--max-oversubscription=N]
+//                           [--pinning=none,compact,scatter,numa] [--symmetric] [--out=PATH]
+
+////////////////////////////////////////////////////////////////////////////////
+// Backends
+
+// one trial: n_producers send n_messages in total, n_consumers drain them.
+// thread i of the producers, then of the consumers, pins itself to plan[i].
+// returns elapsed seconds from the start signal until the last consumer is done.
+using Trial = std::function<double(unsigned n_producers, unsigned n_consumers, unsigned n_messages,
+    const std::vector<std::vector<int>>& plan)>;
+
+struct Backend {
+    std::string name;
+    Trial trial;
+};
+
+double chan_trial(size_t buffer_size, unsigned n_producers, unsigned n_consumers, unsigned n_messages,
+    const std::vector<std::vector<int>>& plan) {
+
+    Chan<int> chan(buffer_size);
+    std::latch ready(n_producers + n_consumers + 1);
+    std::vector<std::thread> producers;
+    std::vector<std::thread> consumers;
+
+    for (unsigned i = 0; i < n_producers; ++i) {
+        unsigned count = n_messages / n_producers + (i < n_messages % n_producers ? 1 : 0);
+        producers.emplace_back([&, i, count] {
+            if (!plan[i].empty()) bench::pin_this_thread(plan[i]);
+            ready.arrive_and_wait();
+            for (unsigned m = 0; m < count; ++m) {
+                chan.send(static_cast<int>(m));
+            }
+        });
+    }
+    for (unsigned i = 0; i < n_consumers; ++i) {
+        consumers.emplace_back([&, i] {
+            if (!plan[n_producers + i].empty()) bench::pin_this_thread(plan[n_producers + i]);
+            ready.arrive_and_wait();
+            int num;
+            while (chan.recv(num)) {}
+        });
+    }
+
+    ready.arrive_and_wait();
+    auto start = bench::Clock::now();
+    for (auto& t : producers) t.join();
+    // everything is sent; consumers exit once the buffer is drained.
+    chan.close();
+    for (auto& t : consumers) t.join();
+    return std::chrono::duration<double>(bench::Clock::now() - start).count();
+}
+
+std::vector<Backend> backends() {
+    using namespace std::placeholders;
+    return {
+        {"chan_unbuffered", std::bind(chan_trial, 0, _1, _2, _3, _4)},
+        {"chan_buffered_64", std::bind(chan_trial, 64, _1, _2, _3, _4)},
+        {"chan_buffered_1024", std::bind(chan_trial, 1024, _1, _2, _3, _4)},
+    };
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Statistics
+
+// two-sided 95% Student's t critical values, by degrees of freedom.
+double t_critical_95(size_t df) {
+    static const double table[] = {
+        0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df == 0) return 0;
+    return df < std::size(table) ? table[df] : 1.96;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Runner
+
+struct Options {
+    unsigned trials{5};
+    unsigned messages{200'000};
+    unsigned max_oversubscription{4};
+    std::vector<bench::PinPolicy> pinning{
+        bench::PinPolicy::none, bench::PinPolicy::compact, bench::PinPolicy::scatter, bench::PinPolicy::numa};
+    bool symmetric{false};
+    std::string out;
+};
+
+// 1, 2, 4, ... up to hardware_concurrency, then multiples of it for oversubscription.
+std::vector<unsigned> thread_counts(unsigned hw, unsigned max_oversubscription) {
+    std::vector<unsigned> counts;
+    for (unsigned n = 1; n < hw; n *= 2) counts.push_back(n);
+    for (unsigned k = 1; k <= max_oversubscription; k *= 2) counts.push_back(hw * k);
+    return counts;
+}
+
+bool parse_options(int argc, char** argv, Options& o) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](const std::string& flag, std::string& out) {
+            if (arg.rfind(flag + "=", 0) != 0) return false;
+            out = arg.substr(flag.size() + 1);
+            return true;
+        };
+        std::string v;
+        if (value("--trials", v)) o.trials = std::max(1, std::stoi(v));
+        else if (value("--messages", v)) o.messages = std::stoul(v);
+        else if (value("--max-oversubscription", v)) o.max_oversubscription = std::max(1, std::stoi(v));
+        else if (value("--out", v)) o.out = v;
+        else if (arg == "--symmetric") o.symmetric = true;
+        else if (value("--pinning", v)) {
+            o.pinning.clear();
+            std::stringstream ss(v);
+            std::string name;
+            while (std::getline(ss, name, ',')) {
+                auto p = bench::parse_pin_policy(name);
+                if (!p) return false;
+                o.pinning.push_back(*p);
+            }
+        }
+        else return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cerr << "usage: " << argv[0] << " [--trials=N] [--messages=N] [--max-oversubscription=N]"
+            " [--pinning=none,compact,scatter,numa] [--symmetric] [--out=PATH]" << std::endl;
+        return 2;
+    }
+
+    std::ofstream file;
+    if (!options.out.empty()) {
+        file.open(options.out);
+        if (!file.is_open()) {
+            std::cerr << argv[0] << ": cannot open " << options.out << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& os = options.out.empty() ? std::cout : file;
+
+    auto cpus = bench::cpu_topology();
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    auto counts = thread_counts(hw, options.max_oversubscription);
+
+    os << "backend,pinning,producers,consumers,threads,oversubscription,messages,trials,"
+          "throughput_mean,throughput_stdev,throughput_ci95_low,throughput_ci95_high,"
+          "seconds_median" << std::endl;
+
+    for (auto& backend : backends()) {
+        for (auto policy : options.pinning) {
+            if (policy != bench::PinPolicy::none && cpus.empty()) {
+                std::cerr << "skipping pinning=" << bench::pin_policy_name(policy) << ": no cpu topology" << std::endl;
+                continue;
+            }
+            for (auto n_producers : counts) {
+                for (auto n_consumers : counts) {
+                    if (options.symmetric && n_producers != n_consumers) continue;
+                    std::cerr << backend.name << " " << bench::pin_policy_name(policy)
+                        << " " << n_producers << "x" << n_consumers << std::endl;
+
+                    unsigned n_threads = n_producers + n_consumers;
+                    auto plan = bench::pin_plan(cpus, policy, n_threads);
+                    std::vector<double> throughputs;
+                    std::vector<double> seconds;
+                    for (unsigned t = 0; t < options.trials; ++t) {
+                        double s = backend.trial(n_producers, n_consumers, options.messages, plan);
+                        seconds.push_back(s);
+                        throughputs.push_back(options.messages / s);
+                    }
+
+                    auto summary = bench::summarize(throughputs);
+                    double half_width = t_critical_95(summary.count - 1) * summary.stdev / std::sqrt(summary.count);
+                    os << backend.name << ","
+                        << bench::pin_policy_name(policy) << ","
+                        << n_producers << ","
+                        << n_consumers << ","
+                        << n_threads << ","
+                        << static_cast<double>(n_threads) / hw << ","
+                        << options.messages << ","
+                        << options.trials << ","
+                        << summary.mean << ","
+                        << summary.stdev << ","
+                        << summary.mean - half_width << ","
+                        << summary.mean + half_width << ","
+                        << bench::summarize(seconds).median << std::endl;
+                }
+            }
+        }
+    }
+}
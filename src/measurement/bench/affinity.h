@@ -0,0 +1,228 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+// CPU topology discovery and thread pinning for benchmarks.
+// topology comes from /sys/devices/system/cpu, so pinning is only supported on Linux;
+// elsewhere cpu_topology() is empty and callers should skip pinned variants.
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace bench {
+
+struct CpuInfo {
+    int cpu;        // logical cpu number.
+    int core;       // core_id, unique within a package.
+    int package;    // physical_package_id, i.e. socket.
+    int node;       // NUMA node, 0 if unknown.
+};
+
+// thread placements for a pair of communicating threads.
+enum class Placement {
+    unpinned,
+    same_cpu,       // both threads on one logical cpu: every handoff is a context switch.
+    smt_sibling,    // two hyperthreads of one core.
+    cross_core,     // two cores of one socket.
+    cross_socket,   // two sockets.
+};
+
+inline const char* placement_name(Placement p) {
+    switch (p) {
+        case Placement::unpinned:       return "unpinned";
+        case Placement::same_cpu:       return "same_cpu";
+        case Placement::smt_sibling:    return "smt_sibling";
+        case Placement::cross_core:     return "cross_core";
+        default:                        return "cross_socket";
+    }
+}
+
+inline int read_int_file(const std::string& path, int fallback) {
+    std::ifstream f(path);
+    int v;
+    return (f >> v) ? v : fallback;
+}
+
+// cpus this process may run on, with their topology.
+inline std::vector<CpuInfo> cpu_topology() {
+    std::vector<CpuInfo> cpus;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+        std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+        int node = 0;
+        for (int n = 0; n < 64; ++n) {
+            if (std::ifstream(dir + "/node" + std::to_string(n) + "/cpumap")) {
+                node = n;
+                break;
+            }
+        }
+        cpus.push_back({cpu,
+            read_int_file(dir + "/topology/core_id", cpu),
+            read_int_file(dir + "/topology/physical_package_id", 0),
+            node});
+    }
+#endif
+    return cpus;
+}
+
+// two cpus satisfying the placement, or nullopt if this machine has none.
+inline std::optional<std::pair<int, int>> pick_pair(const std::vector<CpuInfo>& cpus, Placement p) {
+    for (auto& a : cpus) {
+        for (auto& b : cpus) {
+            bool same_core = a.package == b.package && a.core == b.core;
+            bool match = false;
+            switch (p) {
+                case Placement::same_cpu:       match = a.cpu == b.cpu; break;
+                case Placement::smt_sibling:    match = a.cpu != b.cpu && same_core; break;
+                case Placement::cross_core:     match = a.package == b.package && a.core != b.core; break;
+                case Placement::cross_socket:   match = a.package != b.package; break;
+                default:                        break;
+            }
+            if (match) return std::make_pair(a.cpu, b.cpu);
+        }
+    }
+    return std::nullopt;
+}
+
+#ifdef __linux__
+using CpuMask = cpu_set_t;
+
+inline CpuMask this_thread_affinity() {
+    CpuMask mask;
+    CPU_ZERO(&mask);
+    pthread_getaffinity_np(pthread_self(), sizeof(mask), &mask);
+    return mask;
+}
+
+inline bool set_this_thread_affinity(const CpuMask& mask) {
+    return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+}
+
+inline bool pin_this_thread(int cpu) {
+    CpuMask mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    return set_this_thread_affinity(mask);
+}
+
+// allow the calling thread on any of cpus.
+inline bool pin_this_thread(const std::vector<int>& cpus) {
+    CpuMask mask;
+    CPU_ZERO(&mask);
+    for (int cpu : cpus) CPU_SET(cpu, &mask);
+    return set_this_thread_affinity(mask);
+}
+#else
+struct CpuMask {};
+inline CpuMask this_thread_affinity() {return {};}
+inline bool set_this_thread_affinity(const CpuMask&) {return false;}
+inline bool pin_this_thread(int) {return false;}
+inline bool pin_this_thread(const std::vector<int>&) {return false;}
+#endif
+
+// how a group of threads is spread over the machine.
+enum class PinPolicy {
+    none,       // let the scheduler decide.
+    compact,    // fill one core's hyperthreads, then the next core, then the next socket.
+    scatter,    // one thread per socket, then per core, before doubling up on hyperthreads.
+    numa,       // each thread may run anywhere on one NUMA node; nodes are assigned round robin.
+};
+
+inline const char* pin_policy_name(PinPolicy p) {
+    switch (p) {
+        case PinPolicy::none:       return "none";
+        case PinPolicy::compact:    return "compact";
+        case PinPolicy::scatter:    return "scatter";
+        default:                    return "numa";
+    }
+}
+
+inline std::optional<PinPolicy> parse_pin_policy(const std::string& s) {
+    for (PinPolicy p : {PinPolicy::none, PinPolicy::compact, PinPolicy::scatter, PinPolicy::numa}) {
+        if (s == pin_policy_name(p)) return p;
+    }
+    return std::nullopt;
+}
+
+// allowed cpus for each of n_threads threads; an empty list means unpinned.
+// with more threads than cpus, the plan wraps around (oversubscription).
+inline std::vector<std::vector<int>> pin_plan(const std::vector<CpuInfo>& cpus, PinPolicy policy, size_t n_threads) {
+    std::vector<std::vector<int>> plan(n_threads);
+    if (policy == PinPolicy::none || cpus.empty()) return plan;
+
+    if (policy == PinPolicy::numa) {
+        std::map<int, std::vector<int>> nodes;
+        for (auto& c : cpus) nodes[c.node].push_back(c.cpu);
+        std::vector<std::vector<int>> node_cpus;
+        for (auto& kv : nodes) node_cpus.push_back(kv.second);
+        for (size_t i = 0; i < n_threads; ++i) plan[i] = node_cpus[i % node_cpus.size()];
+        return plan;
+    }
+
+    std::vector<CpuInfo> order = cpus;
+    if (policy == PinPolicy::compact) {
+        std::sort(order.begin(), order.end(), [](const CpuInfo& a, const CpuInfo& b) {
+            return std::tie(a.package, a.core, a.cpu) < std::tie(b.package, b.core, b.cpu);
+        });
+    } else {
+        // rank each cpu among the hyperthreads of its core, and each core among the cores of its socket,
+        // then take the first hyperthread of the first core of every socket, and so on.
+        std::map<std::pair<int, int>, int> smt_rank;
+        std::map<int, std::map<int, int>> core_rank;
+        std::vector<std::tuple<int, int, int, int>> keys;
+        std::vector<CpuInfo> by_topology = cpus;
+        std::sort(by_topology.begin(), by_topology.end(), [](const CpuInfo& a, const CpuInfo& b) {
+            return std::tie(a.package, a.core, a.cpu) < std::tie(b.package, b.core, b.cpu);
+        });
+        for (auto& c : by_topology) {
+            auto& cores = core_rank[c.package];
+            if (!cores.count(c.core)) {
+                int rank = static_cast<int>(cores.size());
+                cores[c.core] = rank;
+            }
+            int smt = smt_rank[{c.package, c.core}]++;
+            keys.emplace_back(smt, cores[c.core], c.package, c.cpu);
+        }
+        std::sort(keys.begin(), keys.end());
+        order.clear();
+        for (auto& k : keys) {
+            int cpu = std::get<3>(k);
+            order.push_back(*std::find_if(cpus.begin(), cpus.end(), [cpu](const CpuInfo& c) {return c.cpu == cpu;}));
+        }
+    }
+    for (size_t i = 0; i < n_threads; ++i) plan[i] = {order[i % order.size()].cpu};
+    return plan;
+}
+
+// pins the calling thread for its lifetime, then restores the previous affinity.
+class ScopedPin {
+private:
+    CpuMask saved;
+    bool pinned;
+public:
+    explicit ScopedPin(int cpu) : saved(this_thread_affinity()), pinned(cpu >= 0 && pin_this_thread(cpu)) {}
+    ScopedPin(const ScopedPin&) = delete;
+    ScopedPin& operator=(const ScopedPin&) = delete;
+    ~ScopedPin() {
+        if (pinned) set_this_thread_affinity(saved);
+    }
+    bool ok() const {return pinned;}
+};
+
+} // namespace bench
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+// Process-wide heap allocation counting, like Go's b.ReportAllocs().
+//
+// exactly one translation unit of a program defines ALLOC_COUNTER_IMPLEMENTATION before
+// including this header; that replaces the global operator new and delete with versions
+// that count every allocation (of any thread) before calling malloc.
+// without it, counts stay at zero and hooked() is false.
+//
+//     auto before = bench::alloc::snapshot();
+//     ... code under test ...
+//     auto delta = bench::alloc::snapshot() - before;
+//     // delta.allocations == 0 means the code never touched the heap.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace bench {
+namespace alloc {
+
+struct Counts {
+    uint64_t allocations{0};
+    uint64_t bytes{0};
+
+    Counts operator-(const Counts& o) const {return {allocations - o.allocations, bytes - o.bytes};}
+};
+
+inline std::atomic<uint64_t> allocations{0};
+inline std::atomic<uint64_t> bytes{0};
+inline std::atomic<bool> hooked_flag{false};
+
+// true if the counting operator new is linked in.
+inline bool hooked() {return hooked_flag.load(std::memory_order_relaxed);}
+
+inline Counts snapshot() {
+    return {allocations.load(std::memory_order_relaxed), bytes.load(std::memory_order_relaxed)};
+}
+
+} // namespace alloc
+} // namespace bench
+
+#ifdef ALLOC_COUNTER_IMPLEMENTATION
+
+#include <cstdlib>
+#include <new>
+
+namespace bench {
+namespace alloc {
+namespace detail {
+
+inline void* allocate(std::size_t size, std::size_t align) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(size, std::memory_order_relaxed);
+    if (size == 0) size = 1;
+    if (align <= alignof(std::max_align_t)) return std::malloc(size);
+    // aligned_alloc wants a size that is a multiple of the alignment.
+    return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+inline void* allocate_or_throw(std::size_t size, std::size_t align) {
+    void* p = allocate(size, align);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+[[maybe_unused]] static const bool registered = (hooked_flag = true);
+
+} // namespace detail
+} // namespace alloc
+} // namespace bench
+
+void* operator new(std::size_t size) {
+    return bench::alloc::detail::allocate_or_throw(size, 0);
+}
+void* operator new[](std::size_t size) {
+    return bench::alloc::detail::allocate_or_throw(size, 0);
+}
+void* operator new(std::size_t size, std::align_val_t align) {
+    return bench::alloc::detail::allocate_or_throw(size, static_cast<std::size_t>(align));
+}
+void* operator new[](std::size_t size, std::align_val_t align) {
+    return bench::alloc::detail::allocate_or_throw(size, static_cast<std::size_t>(align));
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return bench::alloc::detail::allocate(size, 0);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return bench::alloc::detail::allocate(size, 0);
+}
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return bench::alloc::detail::allocate(size, static_cast<std::size_t>(align));
+}
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept {
+    return bench::alloc::detail::allocate(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void* p) noexcept {std::free(p);}
+void operator delete[](void* p) noexcept {std::free(p);}
+void operator delete(void* p, std::size_t) noexcept {std::free(p);}
+void operator delete[](void* p, std::size_t) noexcept {std::free(p);}
+void operator delete(void* p, std::align_val_t) noexcept {std::free(p);}
+void operator delete[](void* p, std::align_val_t) noexcept {std::free(p);}
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {std::free(p);}
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {std::free(p);}
+void operator delete(void* p, const std::nothrow_t&) noexcept {std::free(p);}
+void operator delete[](void* p, const std::nothrow_t&) noexcept {std::free(p);}
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept {std::free(p);}
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept {std::free(p);}
+
+#endif
+
+#endif
@@ -0,0 +1,472 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// A small microbenchmark harness, modeled on Go's testing.B.
+//
+// a benchmark is a function that performs state.iterations() operations.
+// the harness grows the iteration count until one run takes at least --min-time,
+// runs --warmup untimed repetitions, then --reps timed repetitions,
+// and reports ns/op statistics across repetitions as text, JSON or CSV.
+//
+//     void bench_send(bench::State& state) {
+//         Chan<int> chan(1);
+//         state.reset_timer();
+//         for (size_t i = 0; i < state.iterations(); ++i) {
+//             chan.send(1);
+//             chan.recv();
+//         }
+//     }
+//     BENCHMARK("chan/send_recv", bench_send);
+//
+// a benchmark that also times individual operations (ex. round trips) passes each
+// duration to state.sample(); the harness then reports latency percentiles over
+// all samples of all timed repetitions.
+//
+// with --perf, each timed repetition is also wrapped in PerfCounters (perf_counters.h),
+// and cycles, instructions, cache and branch misses, context switches and cpu migrations
+// are reported per message (iterations times items per iteration).
+// counters the kernel doesn't provide are left out.
+//
+// when the binary links the counting operator new (alloc_counter.h), heap allocations made
+// by any thread while the timer runs are reported as allocs/op and alloc_bytes/op.
+// a channel in steady state should report 0 allocs/op.
+//
+// benchmarks register themselves at static-initialization time,
+// so a benchmark binary is bench_main.cpp plus any number of benchmark sources.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "alloc_counter.h"
+#include "perf_counters.h"
+
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+class State {
+private:
+    size_t n;
+    Clock::time_point started;
+    Clock::duration elapsed{0};
+    bool running{false};
+    alloc::Counts allocs_started;
+    alloc::Counts allocs;
+    double items_per_iteration{1};
+    std::map<std::string, double> counters;
+    std::vector<double> samples;
+    std::string skip_reason;
+
+    friend class Runner;
+public:
+    explicit State(size_t iterations) : n(iterations) {}
+
+    // number of operations to perform in this run.
+    size_t iterations() const {return n;}
+
+    // discard time spent so far (ex. setup) and keep timing.
+    void reset_timer() {
+        elapsed = Clock::duration{0};
+        allocs = {};
+        allocs_started = alloc::snapshot();
+        started = Clock::now();
+        running = true;
+    }
+
+    // exclude a section (ex. per-iteration setup) from the measurement.
+    void stop_timer() {
+        if (running) {
+            elapsed += Clock::now() - started;
+            alloc::Counts delta = alloc::snapshot() - allocs_started;
+            allocs.allocations += delta.allocations;
+            allocs.bytes += delta.bytes;
+        }
+        running = false;
+    }
+    void start_timer() {
+        if (!running) {
+            allocs_started = alloc::snapshot();
+            started = Clock::now();
+        }
+        running = true;
+    }
+
+    // when one iteration moves several elements (ex. fill and drain a buffer of 50),
+    // report items/s in addition to ops/s.
+    void set_items_per_iteration(double items) {items_per_iteration = items;}
+
+    // an extra result column, averaged across repetitions.
+    void counter(const std::string& name, double value) {counters[name] = value;}
+
+    // one latency sample in ns.
+    void sample(double ns) {samples.push_back(ns);}
+
+    // mark the benchmark as not applicable here (ex. needs more cores). the function should return.
+    void skip(const std::string& reason) {skip_reason = reason;}
+};
+
+using Function = std::function<void(State&)>;
+
+struct Benchmark {
+    std::string name;
+    Function fn;
+};
+
+inline std::vector<Benchmark>& registry() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+struct Registrar {
+    Registrar(const std::string& name, Function fn) {
+        registry().push_back({name, std::move(fn)});
+    }
+};
+
+#define BENCH_CONCAT_(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_(a, b)
+#define BENCHMARK(name, fn) \
+    static ::bench::Registrar BENCH_CONCAT(bench_registrar_, __LINE__){name, fn}
+
+////////////////////////////////////////////////////////////////////////////////
+// Statistics
+
+struct Summary {
+    size_t count{0};
+    double mean{0};
+    double stdev{0};
+    double min{0};
+    double median{0};
+    double max{0};
+};
+
+// p in [0, 100], linear interpolation between closest ranks. v must be sorted.
+inline double percentile(const std::vector<double>& v, double p) {
+    if (v.empty()) return 0;
+    double rank = p / 100.0 * (v.size() - 1);
+    size_t lo = static_cast<size_t>(std::floor(rank));
+    size_t hi = std::min(lo + 1, v.size() - 1);
+    return v[lo] + (v[hi] - v[lo]) * (rank - lo);
+}
+
+inline Summary summarize(std::vector<double> v) {
+    Summary s;
+    if (v.empty()) return s;
+    std::sort(v.begin(), v.end());
+    s.count = v.size();
+    s.mean = std::accumulate(v.begin(), v.end(), 0.0) / v.size();
+    double sum_of_squares = 0;
+    for (double x : v) sum_of_squares += (x - s.mean) * (x - s.mean);
+    // sample standard deviation.
+    s.stdev = v.size() > 1 ? std::sqrt(sum_of_squares / (v.size() - 1)) : 0;
+    s.min = v.front();
+    s.median = percentile(v, 50);
+    s.max = v.back();
+    return s;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Results
+
+struct Result {
+    std::string name;
+    std::string skipped;            // reason, if the benchmark skipped itself.
+    size_t iterations{0};           // per repetition.
+    std::vector<double> ns_per_op;  // one per repetition.
+    Summary summary;
+    double items_per_iteration{1};
+    std::map<std::string, double> counters;
+
+    double ops_per_sec() const {return summary.mean > 0 ? 1e9 / summary.mean : 0;}
+    double items_per_sec() const {return ops_per_sec() * items_per_iteration;}
+};
+
+// union of counter names over all results, for tabular formats.
+inline std::vector<std::string> counter_names(const std::vector<Result>& results) {
+    std::vector<std::string> names;
+    for (auto& r : results) {
+        for (auto& kv : r.counters) {
+            if (std::find(names.begin(), names.end(), kv.first) == names.end()) names.push_back(kv.first);
+        }
+    }
+    return names;
+}
+
+inline std::string json_escape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+inline void write_text(std::ostream& os, const std::vector<Result>& results) {
+    auto names = counter_names(results);
+    os << std::left << std::setw(44) << "benchmark" << std::right
+       << std::setw(12) << "iterations" << std::setw(14) << "ns/op" << std::setw(10) << "stdev"
+       << std::setw(14) << "median" << std::setw(14) << "ops/s";
+    for (auto& c : names) os << std::setw(std::max<int>(14, c.size() + 2)) << c;
+    os << "\n";
+    for (auto& r : results) {
+        os << std::left << std::setw(44) << r.name << std::right;
+        if (!r.skipped.empty()) {
+            os << "  skipped: " << r.skipped << "\n";
+            continue;
+        }
+        os << std::fixed << std::setprecision(1)
+           << std::setw(12) << r.iterations << std::setw(14) << r.summary.mean << std::setw(10) << r.summary.stdev
+           << std::setw(14) << r.summary.median << std::setw(14) << std::setprecision(0) << r.ops_per_sec()
+           << std::setprecision(2);
+        for (auto& c : names) {
+            int w = std::max<int>(14, c.size() + 2);
+            auto it = r.counters.find(c);
+            if (it == r.counters.end()) os << std::setw(w) << "-";
+            else os << std::setw(w) << it->second;
+        }
+        os << "\n";
+    }
+    os << std::defaultfloat;
+}
+
+inline void write_csv(std::ostream& os, const std::vector<Result>& results) {
+    auto names = counter_names(results);
+    os << "name,iterations,repetitions,ns_per_op_mean,ns_per_op_stdev,ns_per_op_min,"
+          "ns_per_op_median,ns_per_op_max,ops_per_sec,items_per_sec";
+    for (auto& c : names) os << "," << c;
+    os << "\n";
+    os << std::setprecision(10);
+    for (auto& r : results) {
+        if (!r.skipped.empty()) continue;
+        os << r.name << "," << r.iterations << "," << r.summary.count << ","
+           << r.summary.mean << "," << r.summary.stdev << "," << r.summary.min << ","
+           << r.summary.median << "," << r.summary.max << "," << r.ops_per_sec() << "," << r.items_per_sec();
+        for (auto& c : names) {
+            os << ",";
+            auto it = r.counters.find(c);
+            if (it != r.counters.end()) os << it->second;
+        }
+        os << "\n";
+    }
+}
+
+inline void write_json(std::ostream& os, const std::vector<Result>& results) {
+    os << std::setprecision(10);
+    os << "{\n  \"context\": {\"hardware_concurrency\": " << std::thread::hardware_concurrency()
+#ifdef __VERSION__
+       << ", \"compiler\": \"" << json_escape(__VERSION__) << "\""
+#endif
+       << "},\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        os << (i ? ",\n" : "\n") << "    {\"name\": \"" << json_escape(r.name) << "\"";
+        if (!r.skipped.empty()) {
+            os << ", \"skipped\": \"" << json_escape(r.skipped) << "\"}";
+            continue;
+        }
+        os << ", \"iterations\": " << r.iterations
+           << ", \"repetitions\": " << r.summary.count
+           << ", \"ns_per_op\": {\"mean\": " << r.summary.mean << ", \"stdev\": " << r.summary.stdev
+           << ", \"min\": " << r.summary.min << ", \"median\": " << r.summary.median
+           << ", \"max\": " << r.summary.max << "}"
+           << ", \"ops_per_sec\": " << r.ops_per_sec()
+           << ", \"items_per_sec\": " << r.items_per_sec()
+           << ", \"counters\": {";
+        bool first = true;
+        for (auto& kv : r.counters) {
+            os << (first ? "" : ", ") << "\"" << json_escape(kv.first) << "\": " << kv.second;
+            first = false;
+        }
+        os << "}, \"samples_ns_per_op\": [";
+        for (size_t j = 0; j < r.ns_per_op.size(); ++j) os << (j ? ", " : "") << r.ns_per_op[j];
+        os << "]}";
+    }
+    os << "\n  ]\n}\n";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Runner
+
+struct Options {
+    std::string filter;             // regex, matched against benchmark names.
+    double min_time{0.5};           // seconds per repetition.
+    size_t warmup{1};
+    size_t repetitions{5};
+    std::string format{"text"};     // text, json or csv.
+    std::string out;                // file path; stdout if empty.
+    bool list{false};
+    bool perf{false};               // collect PerfCounters per repetition.
+};
+
+class Runner {
+private:
+    Options options;
+
+    static State run_once(const Benchmark& b, size_t n) {
+        State state(n);
+        state.reset_timer();
+        b.fn(state);
+        state.stop_timer();
+        return state;
+    }
+
+    // like Go's testing.B: grow n until a run takes min_time, predicting from the last run.
+    size_t calibrate(const Benchmark& b, std::string& skipped) {
+        const double min_ns = options.min_time * 1e9;
+        size_t n = 1;
+        while (true) {
+            State s = run_once(b, n);
+            if (!s.skip_reason.empty()) {
+                skipped = s.skip_reason;
+                return 0;
+            }
+            double ns = std::chrono::duration<double, std::nano>(s.elapsed).count();
+            if (ns >= min_ns || n >= 1'000'000'000) return n;
+            double per_op = std::max(ns / n, 1.0);
+            size_t next = static_cast<size_t>(min_ns * 1.2 / per_op);
+            next = std::clamp(next, n + 1, n * 100);
+            n = std::min<size_t>(next, 1'000'000'000);
+        }
+    }
+public:
+    explicit Runner(Options o) : options(std::move(o)) {}
+
+    Result run(const Benchmark& b) {
+        Result r;
+        r.name = b.name;
+        r.iterations = calibrate(b, r.skipped);
+        if (!r.skipped.empty()) return r;
+
+        for (size_t i = 0; i < options.warmup; ++i) {
+            run_once(b, r.iterations);
+        }
+
+        std::map<std::string, std::vector<double>> counter_samples;
+        std::vector<double> latencies;
+        std::unique_ptr<PerfCounters> perf;
+        if (options.perf) perf = std::make_unique<PerfCounters>();
+        for (size_t i = 0; i < options.repetitions; ++i) {
+            if (perf) perf->start();
+            State s = run_once(b, r.iterations);
+            if (perf) {
+                perf->stop();
+                double messages = r.iterations * s.items_per_iteration;
+                for (auto& [name, value] : perf->results()) {
+                    counter_samples[name + "/msg"].push_back(value / messages);
+                }
+            }
+            if (alloc::hooked()) {
+                counter_samples["allocs/op"].push_back(static_cast<double>(s.allocs.allocations) / r.iterations);
+                counter_samples["alloc_bytes/op"].push_back(static_cast<double>(s.allocs.bytes) / r.iterations);
+            }
+            r.ns_per_op.push_back(std::chrono::duration<double, std::nano>(s.elapsed).count() / r.iterations);
+            r.items_per_iteration = s.items_per_iteration;
+            for (auto& kv : s.counters) counter_samples[kv.first].push_back(kv.second);
+            latencies.insert(latencies.end(), s.samples.begin(), s.samples.end());
+        }
+        r.summary = summarize(r.ns_per_op);
+        for (auto& kv : counter_samples) r.counters[kv.first] = summarize(kv.second).mean;
+        if (!latencies.empty()) {
+            std::sort(latencies.begin(), latencies.end());
+            r.counters["p50_ns"] = percentile(latencies, 50);
+            r.counters["p90_ns"] = percentile(latencies, 90);
+            r.counters["p99_ns"] = percentile(latencies, 99);
+            r.counters["p999_ns"] = percentile(latencies, 99.9);
+            r.counters["max_ns"] = latencies.back();
+        }
+        return r;
+    }
+
+    std::vector<Result> run_all() {
+        std::regex filter(options.filter.empty() ? ".*" : options.filter);
+        std::vector<Result> results;
+        for (auto& b : registry()) {
+            if (!std::regex_search(b.name, filter)) continue;
+            if (options.list) {
+                std::cout << b.name << "\n";
+                continue;
+            }
+            // progress goes to stderr so stdout stays machine-readable.
+            std::cerr << "running " << b.name << "..." << std::endl;
+            results.push_back(run(b));
+        }
+        return results;
+    }
+};
+
+inline void usage(const char* argv0) {
+    std::cerr << "usage: " << argv0 << " [options]\n"
+        "  --filter=REGEX     run benchmarks whose name matches REGEX\n"
+        "  --min-time=SECS    minimum duration of one repetition (default 0.5)\n"
+        "  --warmup=N         untimed repetitions before measuring (default 1)\n"
+        "  --reps=N           timed repetitions (default 5)\n"
+        "  --format=FMT       text, json or csv (default text)\n"
+        "  --out=PATH         write results to PATH instead of stdout\n"
+        "  --perf             report hardware and scheduler counters per message\n"
+        "  --list             list benchmark names and exit\n";
+}
+
+inline bool parse_options(int argc, char** argv, Options& o) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](const std::string& flag, std::string& out) {
+            if (arg.rfind(flag + "=", 0) != 0) return false;
+            out = arg.substr(flag.size() + 1);
+            return true;
+        };
+        std::string v;
+        if (value("--filter", v)) o.filter = v;
+        else if (value("--min-time", v)) o.min_time = std::stod(v);
+        else if (value("--warmup", v)) o.warmup = std::stoul(v);
+        else if (value("--reps", v)) o.repetitions = std::max<size_t>(1, std::stoul(v));
+        else if (value("--format", v)) o.format = v;
+        else if (value("--out", v)) o.out = v;
+        else if (arg == "--list") o.list = true;
+        else if (arg == "--perf") o.perf = true;
+        else return false;
+    }
+    return o.format == "text" || o.format == "json" || o.format == "csv";
+}
+
+inline int run_main(int argc, char** argv) {
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<Result> results = Runner(options).run_all();
+    if (options.list) return 0;
+
+    std::ofstream file;
+    if (!options.out.empty()) {
+        file.open(options.out);
+        if (!file) {
+            std::cerr << "cannot open " << options.out << "\n";
+            return 1;
+        }
+    }
+    std::ostream& os = options.out.empty() ? std::cout : file;
+    if (options.format == "json") write_json(os, results);
+    else if (options.format == "csv") write_csv(os, results);
+    else write_text(os, results);
+    return 0;
+}
+
+} // namespace bench
+
+#endif
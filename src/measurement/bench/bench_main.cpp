@@ -0,0 +1,8 @@
+#define ALLOC_COUNTER_IMPLEMENTATION
+#include "alloc_counter.h"
+#include "bench.h"
+
+// benchmarks register themselves; see channel_bench.cpp and comparison_bench.cpp.
+int main(int argc, char** argv) {
+    return bench::run_main(argc, argv);
+}
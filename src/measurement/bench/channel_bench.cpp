@@ -0,0 +1,384 @@
+#include "../../chan.h"
+#include "bench.h"
+#include <array>
+#include <cstring>
+
+// microbenchmarks of single channel operations.
+// each iteration is one operation unless set_items_per_iteration says otherwise.
+
+////////////////////////////////////////////////////////////////////////////////
+// Creation
+
+void bench_create_unbuffered(bench::State& state) {
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        Chan<int> chan;
+    }
+}
+BENCHMARK("chan/create/unbuffered", bench_create_unbuffered);
+
+void bench_create_buffered(bench::State& state) {
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        Chan<int> chan(64);
+    }
+}
+BENCHMARK("chan/create/buffered_64", bench_create_buffered);
+
+////////////////////////////////////////////////////////////////////////////////
+// Uncontended: one thread, never blocks.
+
+void bench_send_recv_uncontended(bench::State& state) {
+    Chan<int> chan(1);
+    int num;
+    state.reset_timer();
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        chan.send(1);
+        chan.recv(num);
+    }
+}
+BENCHMARK("chan/send_recv/uncontended", bench_send_recv_uncontended);
+
+void bench_nonblocking_uncontended(bench::State& state) {
+    Chan<int> chan(1);
+    int num;
+    state.reset_timer();
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        chan.send_nonblocking(1);
+        chan.recv_nonblocking(num);
+    }
+}
+BENCHMARK("chan/send_recv_nonblocking/uncontended", bench_nonblocking_uncontended);
+
+////////////////////////////////////////////////////////////////////////////////
+// Nonblocking failure paths: the lock-free fast path of chan_send and chan_recv.
+
+void bench_recv_nonblocking_empty(bench::State& state) {
+    Chan<int> chan(1);
+    int num;
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        chan.recv_nonblocking(num);
+    }
+}
+BENCHMARK("chan/recv_nonblocking_fail/buffered_empty", bench_recv_nonblocking_empty);
+
+void bench_send_nonblocking_full(bench::State& state) {
+    Chan<int> chan(1);
+    chan.send(1);
+    state.reset_timer();
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        chan.send_nonblocking(1);
+    }
+}
+BENCHMARK("chan/send_nonblocking_fail/buffered_full", bench_send_nonblocking_full);
+
+void bench_send_nonblocking_no_recver(bench::State& state) {
+    Chan<int> chan;
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        chan.send_nonblocking(1);
+    }
+}
+BENCHMARK("chan/send_nonblocking_fail/unbuffered", bench_send_nonblocking_no_recver);
+
+void bench_recv_nonblocking_no_sender(bench::State& state) {
+    Chan<int> chan;
+    int num;
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        chan.recv_nonblocking(num);
+    }
+}
+BENCHMARK("chan/recv_nonblocking_fail/unbuffered", bench_recv_nonblocking_no_sender);
+
+////////////////////////////////////////////////////////////////////////////////
+// Two threads: one sender, one receiver, both alive for the whole run.
+
+template<typename C>
+void send_recv_two_threads(bench::State& state, C chan) {
+    size_t n = state.iterations();
+    std::thread recver{[chan, n]() mutable {
+        int num;
+        for (size_t i = 0; i < n; ++i) {
+            chan.recv(num);
+        }
+    }};
+    state.reset_timer();
+    for (size_t i = 0; i < n; ++i) {
+        chan.send(static_cast<int>(i));
+    }
+    recver.join();
+}
+
+void bench_handoff_unbuffered(bench::State& state) {
+    send_recv_two_threads(state, Chan<int>(0));
+}
+BENCHMARK("chan/handoff/unbuffered", bench_handoff_unbuffered);
+
+void bench_throughput_buffered_1(bench::State& state) {
+    send_recv_two_threads(state, Chan<int>(1));
+}
+BENCHMARK("chan/throughput/buffered_1", bench_throughput_buffered_1);
+
+void bench_throughput_buffered_16(bench::State& state) {
+    send_recv_two_threads(state, Chan<int>(16));
+}
+BENCHMARK("chan/throughput/buffered_16", bench_throughput_buffered_16);
+
+void bench_throughput_buffered_256(bench::State& state) {
+    send_recv_two_threads(state, Chan<int>(256));
+}
+BENCHMARK("chan/throughput/buffered_256", bench_throughput_buffered_256);
+
+////////////////////////////////////////////////////////////////////////////////
+// Policies: the buffered_256 throughput benchmark on other channel configurations.
+
+void bench_policy_fixed(bench::State& state) {
+    send_recv_two_threads(state, Chan<int, chan_policy::Fixed<256>>());
+}
+BENCHMARK("chan/policy/fixed_256", bench_policy_fixed);
+
+void bench_policy_spinlock(bench::State& state) {
+    send_recv_two_threads(state, Chan<int, chan_policy::Spinlock, chan_policy::SpinThenBlock<1000>>(256));
+}
+BENCHMARK("chan/policy/spinlock_256", bench_policy_spinlock);
+
+void bench_policy_nohooks(bench::State& state) {
+    send_recv_two_threads(state, Chan<int, chan_policy::NoHooks>(256));
+}
+BENCHMARK("chan/policy/nohooks_256", bench_policy_nohooks);
+
+void bench_policy_stats(bench::State& state) {
+    send_recv_two_threads(state, Chan<int, chan_policy::Stats>(256));
+}
+BENCHMARK("chan/policy/stats_256", bench_policy_stats);
+
+void bench_policy_spsc(bench::State& state) {
+    send_recv_two_threads(state, Chan<int, chan_policy::Spsc>(256));
+}
+BENCHMARK("chan/policy/spsc_256", bench_policy_spsc);
+
+void bench_policy_spsc_fixed_spin(bench::State& state) {
+    send_recv_two_threads(state, Chan<int, chan_policy::Spsc, chan_policy::Fixed<256>, chan_policy::Spin>());
+}
+BENCHMARK("chan/policy/spsc_fixed_256_spin", bench_policy_spsc_fixed_spin);
+
+////////////////////////////////////////////////////////////////////////////////
+// Large elements: a 4 KB frame through an Spsc channel, built locally and copied in and out
+// by send/recv, against built and read in its slot by reserve/commit and peek/release.
+
+using Frame4k = std::array<char, 4096>;
+using FrameChan = Chan<Frame4k, chan_policy::Spsc>;
+
+void bench_frame_send_recv(bench::State& state) {
+    FrameChan chan(64);
+    size_t n = state.iterations();
+    long sum = 0;
+    std::thread recver{[chan, n, &sum]() mutable {
+        Frame4k frame{};
+        for (size_t i = 0; i < n; ++i) {
+            chan.recv(frame);
+            sum += frame[0];
+        }
+    }};
+    state.reset_timer();
+    for (size_t i = 0; i < n; ++i) {
+        Frame4k frame;
+        std::memset(frame.data(), static_cast<int>(i), frame.size());
+        chan.send(frame);
+    }
+    recver.join();
+    state.counter("checksum", static_cast<double>(sum));
+}
+BENCHMARK("chan/frame_4k/send_recv", bench_frame_send_recv);
+
+void bench_frame_reserve_peek(bench::State& state) {
+    FrameChan chan(64);
+    size_t n = state.iterations();
+    long sum = 0;
+    std::thread recver{[chan, n, &sum]() mutable {
+        for (size_t i = 0; i < n; ++i) {
+            auto frame = chan.peek();
+            sum += (*frame)[0];
+            frame.release();
+        }
+    }};
+    state.reset_timer();
+    for (size_t i = 0; i < n; ++i) {
+        auto slot = chan.reserve();
+        std::memset(slot.fill().data(), static_cast<int>(i), sizeof(Frame4k));
+        slot.commit();
+    }
+    recver.join();
+    state.counter("checksum", static_cast<double>(sum));
+}
+BENCHMARK("chan/frame_4k/reserve_peek", bench_frame_reserve_peek);
+
+// consumers that read a few bytes of each frame: recv() moves the frame out, recv_with() reads
+// it in its slot. Mutex backend, buffered.
+template<typename Consume>
+void frame_consume(bench::State& state, Consume consume) {
+    Chan<Frame4k> chan(64);
+    size_t n = state.iterations();
+    long sum = 0;
+    std::thread recver{[chan, n, &sum, consume]() mutable {
+        for (size_t i = 0; i < n; ++i) {
+            sum += consume(chan);
+        }
+    }};
+    state.reset_timer();
+    Frame4k frame;
+    for (size_t i = 0; i < n; ++i) {
+        frame[0] = static_cast<char>(i);
+        chan.send(frame);
+    }
+    recver.join();
+    state.counter("checksum", static_cast<double>(sum));
+}
+
+void bench_frame_recv(bench::State& state) {
+    frame_consume(state, [frame = Frame4k()](Chan<Frame4k>& chan) mutable {
+        chan.recv(frame);
+        return frame[0] + frame[64];
+    });
+}
+BENCHMARK("chan/frame_4k/recv", bench_frame_recv);
+
+void bench_frame_recv_with(bench::State& state) {
+    frame_consume(state, [](Chan<Frame4k>& chan) {
+        long v = 0;
+        chan.recv_with([&](Frame4k& frame) {v = frame[0] + frame[64];});
+        return v;
+    });
+}
+BENCHMARK("chan/frame_4k/recv_with", bench_frame_recv_with);
+
+////////////////////////////////////////////////////////////////////////////////
+// Signals: Chan<void> against Chan<bool> used as a done/ready signal.
+
+template<typename C>
+void signal_uncontended(bench::State& state, C chan) {
+    state.reset_timer();
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        if constexpr (std::is_same_v<C, Chan<void>>) {
+            chan.send();
+            chan.recv();
+        } else {
+            chan.send(true);
+            chan.recv();
+        }
+    }
+}
+
+void bench_signal_void_uncontended(bench::State& state) {
+    signal_uncontended(state, Chan<void>(1));
+}
+BENCHMARK("chan/signal/void_uncontended", bench_signal_void_uncontended);
+
+void bench_signal_bool_uncontended(bench::State& state) {
+    signal_uncontended(state, Chan<bool>(1));
+}
+BENCHMARK("chan/signal/bool_uncontended", bench_signal_bool_uncontended);
+
+// a worker signals done, the waiter wakes: one blocking handoff per iteration.
+template<typename C>
+void signal_handoff(bench::State& state, C done) {
+    size_t n = state.iterations();
+    std::thread worker{[done, n]() mutable {
+        for (size_t i = 0; i < n; ++i) {
+            if constexpr (std::is_same_v<C, Chan<void>>) done.send();
+            else done.send(true);
+        }
+    }};
+    state.reset_timer();
+    for (size_t i = 0; i < n; ++i) {
+        done.recv();
+    }
+    worker.join();
+}
+
+void bench_signal_void_handoff(bench::State& state) {
+    signal_handoff(state, Chan<void>());
+}
+BENCHMARK("chan/signal/void_handoff", bench_signal_void_handoff);
+
+void bench_signal_bool_handoff(bench::State& state) {
+    signal_handoff(state, Chan<bool>());
+}
+BENCHMARK("chan/signal/bool_handoff", bench_signal_bool_handoff);
+
+////////////////////////////////////////////////////////////////////////////////
+// Bursts: a consumer outage. every element is sent before any is received, so all but
+// the in-memory ring of the Spill channel goes through its segment files.
+
+template<typename C>
+void burst(bench::State& state, C chan) {
+    size_t n = state.iterations();
+    Frame4k frame{};
+    for (size_t i = 0; i < n; ++i) {
+        frame[0] = static_cast<char>(i);
+        chan.send(frame);
+    }
+    long sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        chan.recv(frame);
+        sum += frame[0];
+    }
+    state.counter("checksum", static_cast<double>(sum));
+}
+
+void bench_burst_unbounded(bench::State& state) {
+    burst(state, Chan<Frame4k, chan_policy::Unbounded>(1024));
+}
+BENCHMARK("chan/burst_4k/unbounded", bench_burst_unbounded);
+
+void bench_burst_spill(bench::State& state) {
+    burst(state, Chan<Frame4k, chan_policy::Spill>(1024));
+}
+BENCHMARK("chan/burst_4k/spill_1024", bench_burst_spill);
+
+////////////////////////////////////////////////////////////////////////////////
+// Closed channel: the throwing API against the status API on the send-on-closed path,
+// which is what every sender hits during a shutdown.
+
+void bench_closed_send_throwing(bench::State& state) {
+    Chan<int> chan(1);
+    chan.close();
+    size_t caught = 0;
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        try {
+            chan.send(1);
+        } catch (const SendOnClosedChannelException&) {
+            caught++;
+        }
+    }
+    state.counter("caught", static_cast<double>(caught));
+}
+BENCHMARK("chan/closed_send/throwing", bench_closed_send_throwing);
+
+void bench_closed_send_status(bench::State& state) {
+    Chan<int> chan(1);
+    chan.close();
+    size_t closed = 0;
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        closed += chan.send_status(1) == ChanStatus::closed;
+    }
+    state.counter("caught", static_cast<double>(closed));
+}
+BENCHMARK("chan/closed_send/status", bench_closed_send_status);
+
+////////////////////////////////////////////////////////////////////////////////
+// Close and drain: fill a buffer, close it, drain it with foreach.
+
+void bench_close_drain(bench::State& state) {
+    const size_t size = 64;
+    state.set_items_per_iteration(size);
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        state.stop_timer();
+        Chan<int> chan(size);
+        for (size_t m = 0; m < size; ++m) {
+            chan.send(0);
+        }
+        state.start_timer();
+
+        chan.close();
+        chan.foreach([](int) {});
+    }
+}
+BENCHMARK("chan/close_drain/buffered_64", bench_close_drain);
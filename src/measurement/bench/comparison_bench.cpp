@@ -0,0 +1,60 @@
+#include "../../chan.h"
+#include "bench.h"
+
+// ports of the programs in measurement/channelComparison.
+// one iteration is one iteration of the original loop,
+// so ns/op here times 500000 is the "Program took" of the original C++ program,
+// comparable with the Go programs next to them.
+
+// unbufferedChannelSendAndReceive: a new sender thread per element.
+void send_to_channel(Chan<int> channel) {
+    channel.send(0);
+}
+
+void bench_ucsr(bench::State& state) {
+    Chan<int> unbufferedChannel;
+    for (size_t n = 0; n < state.iterations(); n++) {
+        std::thread t1{send_to_channel, unbufferedChannel};
+
+        unbufferedChannel.recv();
+
+        t1.join();
+    }
+}
+BENCHMARK("comparison/UCSR", bench_ucsr);
+
+// bufferedChannelSendAndReceive: fill a new buffered channel, then empty it.
+void bench_bcsr(bench::State& state) {
+    int i = 50;
+    state.set_items_per_iteration(i);
+    for (size_t n = 0; n < state.iterations(); n++) {
+        Chan<int> bufferedChannel(i);
+
+        for (int m = 0; m < i; m++) {
+            bufferedChannel.send(0);
+        }
+
+        for (int m = 0; m < i; m++) {
+            bufferedChannel.recv();
+        }
+    }
+}
+BENCHMARK("comparison/BCSR", bench_bcsr);
+
+// bufferedChannelRange: fill a new buffered channel, close it, range over it.
+void bench_bcr(bench::State& state) {
+    int i = 50;
+    state.set_items_per_iteration(i);
+    for (size_t n = 0; n < state.iterations(); n++) {
+        Chan<int> bufferedChannel(i);
+
+        for (int m = 0; m < i; m++) {
+            bufferedChannel.send(0);
+        }
+
+        bufferedChannel.close();
+
+        bufferedChannel.foreach([](int) {});
+    }
+}
+BENCHMARK("comparison/BCR", bench_bcr);
@@ -0,0 +1,127 @@
+#include "../../merge.h"
+#include "bench.h"
+
+#include <thread>
+#include <vector>
+
+// fan-in of N channels into one consumer: Merge against a forwarding thread per input that
+// foreach()es its input into one shared channel. one producer sends to the inputs in turn;
+// one iteration is one element received by the consumer. the 4096x8 cases have 8 producers, each
+// sending to its own eighth of the inputs, so their sends meet only in the merge's lock (or in
+// the shared channel).
+
+// sends n elements to the inputs round robin, then closes them.
+std::thread produce(std::vector<Chan<int>>& inputs, size_t n) {
+    return std::thread{[&inputs, n]() {
+        for (size_t i = 0; i < n; ++i) {
+            inputs[i % inputs.size()].send(static_cast<int>(i));
+        }
+        for (auto& c : inputs) c.close();
+    }};
+}
+
+// m producers, producer p sending to the inputs i with i % m == p, its share of n elements.
+std::vector<std::thread> produce(std::vector<Chan<int>>& inputs, size_t n, size_t m) {
+    std::vector<std::thread> producers;
+    for (size_t p = 0; p < m; ++p) {
+        producers.emplace_back([&inputs, n, m, p]() {
+            size_t mine = (inputs.size() - p + m - 1) / m;
+            for (size_t i = p; i < n; i += m) {
+                inputs[p + (i / m % mine) * m].send(static_cast<int>(i));
+            }
+            for (size_t i = p; i < inputs.size(); i += m) inputs[i].close();
+        });
+    }
+    return producers;
+}
+
+void bench_merge_native(bench::State& state, size_t n_inputs) {
+    std::vector<Chan<int>> inputs;
+    for (size_t i = 0; i < n_inputs; ++i) inputs.emplace_back(16);
+    Merge merged(inputs);
+    state.reset_timer();
+    std::thread producer = produce(inputs, state.iterations());
+    size_t received = 0;
+    int v;
+    while (merged.recv(v)) received++;
+    producer.join();
+    state.stop_timer();
+    state.counter("received", static_cast<double>(received));
+}
+
+void bench_merge_forwarding(bench::State& state, size_t n_inputs) {
+    std::vector<Chan<int>> inputs;
+    for (size_t i = 0; i < n_inputs; ++i) inputs.emplace_back(16);
+    Chan<int> out(64);
+    state.reset_timer();
+    std::vector<std::thread> forwarders;
+    for (auto& in : inputs) {
+        forwarders.emplace_back([in, out]() mutable {
+            in.foreach([&](int x) {out.send(x);});
+        });
+    }
+    std::thread producer = produce(inputs, state.iterations());
+    std::thread closer{[&]() {
+        for (auto& t : forwarders) t.join();
+        out.close();
+    }};
+    size_t received = 0;
+    int v;
+    while (out.recv(v)) received++;
+    producer.join();
+    closer.join();
+    state.stop_timer();
+    state.counter("received", static_cast<double>(received));
+}
+
+void bench_merge_native_many(bench::State& state, size_t n_inputs, size_t n_producers) {
+    std::vector<Chan<int>> inputs;
+    for (size_t i = 0; i < n_inputs; ++i) inputs.emplace_back(16);
+    Merge merged(inputs);
+    state.reset_timer();
+    std::vector<std::thread> producers = produce(inputs, state.iterations(), n_producers);
+    size_t received = 0;
+    int v;
+    while (merged.recv(v)) received++;
+    for (auto& t : producers) t.join();
+    state.stop_timer();
+    state.counter("received", static_cast<double>(received));
+}
+
+void bench_merge_forwarding_many(bench::State& state, size_t n_inputs, size_t n_producers) {
+    std::vector<Chan<int>> inputs;
+    for (size_t i = 0; i < n_inputs; ++i) inputs.emplace_back(16);
+    Chan<int> out(64);
+    state.reset_timer();
+    std::vector<std::thread> forwarders;
+    for (auto& in : inputs) {
+        forwarders.emplace_back([in, out]() mutable {
+            in.foreach([&](int x) {out.send(x);});
+        });
+    }
+    std::vector<std::thread> producers = produce(inputs, state.iterations(), n_producers);
+    std::thread closer{[&]() {
+        for (auto& t : forwarders) t.join();
+        out.close();
+    }};
+    size_t received = 0;
+    int v;
+    while (out.recv(v)) received++;
+    for (auto& t : producers) t.join();
+    closer.join();
+    state.stop_timer();
+    state.counter("received", static_cast<double>(received));
+}
+
+void bench_merge_native_64(bench::State& state)         {bench_merge_native(state, 64);}
+void bench_merge_native_1024(bench::State& state)       {bench_merge_native(state, 1024);}
+void bench_merge_forwarding_64(bench::State& state)     {bench_merge_forwarding(state, 64);}
+void bench_merge_forwarding_1024(bench::State& state)   {bench_merge_forwarding(state, 1024);}
+void bench_merge_native_4096x8(bench::State& state)     {bench_merge_native_many(state, 4096, 8);}
+void bench_merge_forwarding_4096x8(bench::State& state) {bench_merge_forwarding_many(state, 4096, 8);}
+BENCHMARK("merge/native/64", bench_merge_native_64);
+BENCHMARK("merge/native/1024", bench_merge_native_1024);
+BENCHMARK("merge/forwarding/64", bench_merge_forwarding_64);
+BENCHMARK("merge/forwarding/1024", bench_merge_forwarding_1024);
+BENCHMARK("merge/native/4096x8", bench_merge_native_4096x8);
+BENCHMARK("merge/forwarding/4096x8", bench_merge_forwarding_4096x8);
@@ -0,0 +1,83 @@
+#include "../../partitioned_chan.h"
+#include "bench.h"
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// N producers and N consumers keeping a count per key: a PartitionedChan of N partitions, whose
+// consumer i alone owns the counts of the keys of partition i, against one shared Chan of the same
+// total capacity, whose consumers share the counts under a mutex. one iteration is one element
+// received and counted.
+
+struct Keyed {
+    uint32_t key;
+    uint32_t value;
+};
+
+constexpr uint32_t n_keys = 1024;
+
+// producer p of n sends its share of iterations, with keys scattered over all of them.
+template<typename Out>
+std::vector<std::thread> produce(Out& out, size_t n, size_t iterations) {
+    std::vector<std::thread> producers;
+    for (size_t p = 0; p < n; ++p) {
+        size_t count = iterations / n + (p < iterations % n ? 1 : 0);
+        producers.emplace_back([&out, p, count]() {
+            for (size_t i = 0; i < count; ++i) {
+                uint32_t key = static_cast<uint32_t>((p * 7919 + i * 31) % n_keys);
+                out.send(Keyed{key, static_cast<uint32_t>(i)});
+            }
+        });
+    }
+    return producers;
+}
+
+void bench_shared(bench::State& state, size_t n) {
+    Chan<Keyed> chan(64 * n);
+    std::mutex counts_lock;
+    std::vector<uint64_t> counts(n_keys, 0);
+    state.reset_timer();
+    std::vector<std::thread> consumers;
+    for (size_t c = 0; c < n; ++c) {
+        consumers.emplace_back([&]() {
+            chan.foreach([&](Keyed e) {
+                std::scoped_lock lck{counts_lock};
+                counts[e.key] += e.value;
+            });
+        });
+    }
+    std::vector<std::thread> producers = produce(chan, n, state.iterations());
+    for (auto& t : producers) t.join();
+    chan.close();
+    for (auto& t : consumers) t.join();
+    state.stop_timer();
+}
+
+void bench_partitioned(bench::State& state, size_t n) {
+    auto key_of = [](const Keyed& e) {return e.key;};
+    PartitionedChan<Keyed, decltype(key_of)> chan(n, 64, key_of);
+    std::vector<std::vector<uint64_t>> counts(n, std::vector<uint64_t>(n_keys, 0));
+    state.reset_timer();
+    std::vector<std::thread> consumers;
+    for (size_t c = 0; c < n; ++c) {
+        consumers.emplace_back([&chan, &counts, c]() {
+            std::vector<uint64_t>& mine = counts[c];
+            chan.partition(c).foreach([&](Keyed e) {mine[e.key] += e.value;});
+        });
+    }
+    std::vector<std::thread> producers = produce(chan, n, state.iterations());
+    for (auto& t : producers) t.join();
+    chan.close();
+    for (auto& t : consumers) t.join();
+    state.stop_timer();
+}
+
+void bench_shared_2(bench::State& state)        {bench_shared(state, 2);}
+void bench_shared_8(bench::State& state)        {bench_shared(state, 8);}
+void bench_partitioned_2(bench::State& state)   {bench_partitioned(state, 2);}
+void bench_partitioned_8(bench::State& state)   {bench_partitioned(state, 8);}
+BENCHMARK("partition/shared/2", bench_shared_2);
+BENCHMARK("partition/shared/8", bench_shared_8);
+BENCHMARK("partition/partitioned/2", bench_partitioned_2);
+BENCHMARK("partition/partitioned/8", bench_partitioned_8);
@@ -0,0 +1,134 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+// Hardware and scheduler counters around a measured region.
+//
+// on Linux, each counter is a separate perf_event_open() fd on the calling thread with
+// inherit set, so threads created inside the region are counted once they are joined.
+// counters the kernel refuses (no PMU in a VM, perf_event_paranoid, seccomp in a container)
+// are simply absent from the results; getrusage() context-switch counts are always available.
+//
+//     bench::PerfCounters counters;
+//     counters.start();
+//     ... spawn, run and join threads ...
+//     counters.stop();
+//     for (auto& [name, value] : counters.results()) ...
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/resource.h>
+
+#ifdef __linux__
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace bench {
+
+class PerfCounters {
+private:
+    struct Counter {
+        std::string name;
+        int fd;
+        uint64_t value;
+    };
+    std::vector<Counter> counters;
+    struct rusage usage_before;
+    struct rusage usage_after;
+
+#ifdef __linux__
+    static int open_counter(uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        // scale for multiplexing when more counters are open than the PMU has.
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd < 0) {
+            // perf_event_paranoid >= 2 only allows user-space counting.
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+        return fd;
+    }
+
+    void add(const char* name, uint32_t type, uint64_t config) {
+        int fd = open_counter(type, config);
+        if (fd >= 0) counters.push_back({name, fd, 0});
+    }
+#endif
+public:
+    PerfCounters() {
+#ifdef __linux__
+        add("cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        add("instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        add("cache_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        add("branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+        add("context_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+        add("cpu_migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS);
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (auto& c : counters) close(c.fd);
+#endif
+    }
+
+    // true if at least one perf_event counter could be opened.
+    bool available() const {return !counters.empty();}
+
+    void start() {
+        getrusage(RUSAGE_SELF, &usage_before);
+#ifdef __linux__
+        for (auto& c : counters) {
+            ioctl(c.fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(c.fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    void stop() {
+#ifdef __linux__
+        for (auto& c : counters) {
+            ioctl(c.fd, PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t buf[3] = {0, 0, 0};  // value, time enabled, time running.
+            c.value = 0;
+            if (read(c.fd, buf, sizeof(buf)) == sizeof(buf) && buf[2] > 0) {
+                c.value = static_cast<uint64_t>(static_cast<double>(buf[0]) * buf[1] / buf[2]);
+            }
+        }
+#endif
+        getrusage(RUSAGE_SELF, &usage_after);
+    }
+
+    // (name, count) for the last start()/stop() region.
+    // getrusage() counts are process-wide, so keep other threads quiet during the region.
+    std::vector<std::pair<std::string, double>> results() const {
+        std::vector<std::pair<std::string, double>> r;
+        for (auto& c : counters) {
+            r.emplace_back(c.name, static_cast<double>(c.value));
+        }
+        r.emplace_back("voluntary_switches", static_cast<double>(usage_after.ru_nvcsw - usage_before.ru_nvcsw));
+        r.emplace_back("involuntary_switches", static_cast<double>(usage_after.ru_nivcsw - usage_before.ru_nivcsw));
+        return r;
+    }
+};
+
+} // namespace bench
+
+#endif
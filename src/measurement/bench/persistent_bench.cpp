@@ -0,0 +1,104 @@
+#include "../../chan.h"
+#include "../../persistent_chan.h"
+#include "bench.h"
+
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+// PersistentChan against the in-memory Chan it would replace: one operation is a send, a recv and
+// (for the log) an ack of a 64-byte message. the log is made under TMPDIR (or /tmp); point TMPDIR at
+// a local disk, as a tmpfs makes every sync free.
+
+struct Message {
+    uint64_t seq;
+    char payload[56];
+};
+
+// a fresh log directory for one run, removed afterwards.
+struct LogDir {
+    std::filesystem::path path;
+    LogDir() : path(std::filesystem::temp_directory_path() / ("chan_wal_bench_" + std::to_string(getpid()))) {
+        std::filesystem::remove_all(path);
+    }
+    ~LogDir() {std::filesystem::remove_all(path);}
+};
+
+// receives and acknowledges n messages, acking every batch-th one (acks are cumulative).
+void drain(PersistentChan<Message>& chan, size_t n, size_t batch) {
+    for (size_t i = 1; i <= n; ++i) {
+        auto d = chan.recv();
+        if (i % batch == 0 || i == n) chan.ack(d->seq);
+    }
+}
+
+void bench_persistent_in_memory(bench::State& state) {
+    Chan<Message, chan_policy::Unbounded> chan;
+    Message m{};
+    state.reset_timer();
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        m.seq = i;
+        chan.send(m);
+    }
+    for (size_t i = 0; i < state.iterations(); ++i) chan.recv();
+    state.stop_timer();
+}
+BENCHMARK("persistent/send_recv/chan_in_memory", bench_persistent_in_memory);
+
+// every send waits for its own sync.
+void bench_persistent_durable(bench::State& state) {
+    LogDir dir;
+    PersistentChan<Message> chan(dir.path.string());
+    Message m{};
+    state.reset_timer();
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        m.seq = i;
+        chan.send(m);
+    }
+    drain(chan, state.iterations(), 1);
+    chan.sync();
+    state.stop_timer();
+}
+BENCHMARK("persistent/send_recv/durable", bench_persistent_durable);
+
+// the producer makes a batch durable at once, as with a group commit window of 1024 messages.
+void bench_persistent_batched(bench::State& state) {
+    LogDir dir;
+    PersistentChan<Message> chan(dir.path.string());
+    Message m{};
+    state.reset_timer();
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        m.seq = i;
+        chan.send_nowait(m);
+        if (i % 1024 == 1023) chan.sync();
+    }
+    chan.sync();
+    drain(chan, state.iterations(), 1024);
+    chan.sync();
+    state.stop_timer();
+}
+BENCHMARK("persistent/send_recv/batched_1024", bench_persistent_batched);
+
+// durable sends from 8 threads: senders that arrive during a sync share the next one.
+void bench_persistent_group_commit(bench::State& state) {
+    LogDir dir;
+    PersistentChan<Message> chan(dir.path.string());
+    const size_t senders = 8;
+    size_t n = state.iterations() / senders * senders;
+    state.reset_timer();
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < senders; ++t) {
+        threads.emplace_back([&chan, n, senders]() {
+            Message m{};
+            for (size_t i = 0; i < n / senders; ++i) {
+                m.seq = i;
+                chan.send(m);
+            }
+        });
+    }
+    drain(chan, n, 64);
+    for (auto& t : threads) t.join();
+    chan.sync();
+    state.stop_timer();
+}
+BENCHMARK("persistent/send_recv/group_commit_8", bench_persistent_group_commit);
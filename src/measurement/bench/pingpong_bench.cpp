@@ -0,0 +1,91 @@
+#include "../../chan.h"
+#include "affinity.h"
+#include "bench.h"
+
+// round-trip wake-up latency between two persistent threads over a pair of unbuffered channels.
+// unlike comparison/UCSR, no thread is created or joined inside the timed loop,
+// so this isolates the cost of handing a value to a parked thread and waking it, twice.
+// one iteration is one round trip; per-round-trip samples give the latency percentiles.
+
+// first reports on pong whether it could pin itself (1) or not (0), and stops if not.
+void echo(Chan<int> ping, Chan<int> pong, int cpu) {
+    bench::ScopedPin pin{cpu};
+    bool pinned = cpu < 0 || pin.ok();
+    pong.send(pinned ? 1 : 0);
+    if (!pinned) return;
+    int num;
+    while (ping.recv(num)) {
+        pong.send(num);
+    }
+}
+
+void ping_pong(bench::State& state, bench::Placement placement) {
+    int cpu_a = -1;
+    int cpu_b = -1;
+    if (placement != bench::Placement::unpinned) {
+        auto pair = bench::pick_pair(bench::cpu_topology(), placement);
+        if (!pair) {
+            state.skip(std::string("no cpu pair for ") + bench::placement_name(placement));
+            return;
+        }
+        cpu_a = pair->first;
+        cpu_b = pair->second;
+    }
+
+    Chan<int> ping;
+    Chan<int> pong;
+    bench::ScopedPin pin{cpu_a};
+    if (cpu_a >= 0 && !pin.ok()) {
+        state.skip("cannot set thread affinity");
+        return;
+    }
+    std::thread echoer{echo, ping, pong, cpu_b};
+    if (pong.recv() == 0) {
+        echoer.join();
+        state.skip("cannot set thread affinity of the echo thread");
+        return;
+    }
+
+    // let the echo thread start and park before timing.
+    for (int i = 0; i < 100; ++i) {
+        ping.send(i);
+        pong.recv();
+    }
+
+    state.reset_timer();
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        auto start = bench::Clock::now();
+        ping.send(static_cast<int>(i));
+        pong.recv();
+        state.sample(std::chrono::duration<double, std::nano>(bench::Clock::now() - start).count());
+    }
+    state.stop_timer();
+
+    ping.close();
+    echoer.join();
+}
+
+void bench_pingpong_unpinned(bench::State& state) {
+    ping_pong(state, bench::Placement::unpinned);
+}
+BENCHMARK("pingpong/unpinned", bench_pingpong_unpinned);
+
+void bench_pingpong_same_cpu(bench::State& state) {
+    ping_pong(state, bench::Placement::same_cpu);
+}
+BENCHMARK("pingpong/same_cpu", bench_pingpong_same_cpu);
+
+void bench_pingpong_smt_sibling(bench::State& state) {
+    ping_pong(state, bench::Placement::smt_sibling);
+}
+BENCHMARK("pingpong/smt_sibling", bench_pingpong_smt_sibling);
+
+void bench_pingpong_cross_core(bench::State& state) {
+    ping_pong(state, bench::Placement::cross_core);
+}
+BENCHMARK("pingpong/cross_core", bench_pingpong_cross_core);
+
+void bench_pingpong_cross_socket(bench::State& state) {
+    ping_pong(state, bench::Placement::cross_socket);
+}
+BENCHMARK("pingpong/cross_socket", bench_pingpong_cross_socket);
@@ -0,0 +1,66 @@
+#include "../../pipeline.h"
+#include "bench.h"
+
+#include <numeric>
+
+// a parallel map stage of 4 workers: map() against ordered_map(), which pays for the reorder
+// buffer and for workers idling while a slow element holds up its window.
+// one iteration is one element through source -> map -> sink.
+
+// about 1 us of work per element, and every 64th element 20 times as long.
+int busy(int x) {
+    unsigned spins = x % 64 == 0 ? 20 * 300 : 300;
+    volatile unsigned acc = static_cast<unsigned>(x);
+    for (unsigned i = 0; i < spins; ++i) acc = acc * 31 + i;
+    return static_cast<int>(acc);
+}
+
+template<typename Build>
+void run_map(bench::State& state, Build build) {
+    std::vector<int> values(state.iterations());
+    std::iota(values.begin(), values.end(), 0);
+    size_t received = 0;
+    state.reset_timer();
+    Pipeline p;
+    build(p.from(std::move(values))).sink([&](int) {received++;});
+    p.wait();
+    state.stop_timer();
+    state.counter("received", static_cast<double>(received));
+}
+
+void bench_map_unordered(bench::State& state) {
+    run_map(state, [](Stage<int> in) {return in.map(busy, {4, 64});});
+}
+BENCHMARK("pipeline/map_4/unordered", bench_map_unordered);
+
+void bench_map_ordered(bench::State& state) {
+    run_map(state, [](Stage<int> in) {return in.ordered_map(busy, {4, 64});});
+}
+BENCHMARK("pipeline/map_4/ordered", bench_map_ordered);
+
+// a window of 64 lets the other workers run ahead of a slow element for longer.
+void bench_map_ordered_window64(bench::State& state) {
+    run_map(state, [](Stage<int> in) {return in.ordered_map(busy, {4, 64}, 64);});
+}
+BENCHMARK("pipeline/map_4/ordered_window_64", bench_map_ordered_window64);
+
+// map -> filter -> map -> sink of cheap functions: one fused loop, against a channel hop between
+// every two stages (fuse = false).
+void run_chain(bench::State& state, bool fuse) {
+    StageOptions o{1, 64, fuse};
+    run_map(state, [o](Stage<int> in) {
+        return in.map([](int x) {return x * 3;}, o)
+            .filter([](const int& x) {return x % 7 != 0;}, o)
+            .map([](int x) {return x + 1;}, o);
+    });
+}
+
+void bench_chain_fused(bench::State& state) {
+    run_chain(state, true);
+}
+BENCHMARK("pipeline/chain_3/fused", bench_chain_fused);
+
+void bench_chain_unfused(bench::State& state) {
+    run_chain(state, false);
+}
+BENCHMARK("pipeline/chain_3/unfused", bench_chain_unfused);
@@ -0,0 +1,72 @@
+#include "../../chan.h"
+#include "bench.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+// an event-loop thread that cannot block in recv(): it waits in epoll_wait on the channel's
+// recv_fd() (Linux only), against polling recv_nonblocking on a 1 ms timer as such loops do without it.
+// each iteration is one round trip: the main thread sends a request and blocks for the reply,
+// so the time is dominated by how soon the loop notices the request.
+
+// runs the loop until requests is closed; wait() blocks until requests may be ready.
+template<typename Wait>
+void event_loop(Chan<int> requests, Chan<int> replies, Wait wait) {
+    for (;;) {
+        wait();
+        int num;
+        ChanStatus s;
+        while ((s = requests.try_recv(num)) == ChanStatus::ok) {
+            replies.send(num);
+        }
+        if (s == ChanStatus::closed) return;
+    }
+}
+
+template<typename Loop>
+void round_trips(bench::State& state, Chan<int> requests, Chan<int> replies, Loop loop) {
+    std::thread looper{loop};
+    state.reset_timer();
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        auto start = bench::Clock::now();
+        requests.send(static_cast<int>(i));
+        replies.recv();
+        state.sample(std::chrono::duration<double, std::nano>(bench::Clock::now() - start).count());
+    }
+    state.stop_timer();
+    requests.close();
+    looper.join();
+}
+
+#ifdef __linux__
+void bench_readiness_epoll(bench::State& state) {
+    Chan<int> requests(64);
+    Chan<int> replies(64);
+    int fd = requests.recv_fd();
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+    round_trips(state, requests, replies, [=]() {
+        event_loop(requests, replies, [=]() {
+            epoll_event out;
+            while (epoll_wait(ep, &out, 1, -1) < 1) {}
+            clear_ready_fd(fd);
+        });
+    });
+    close(ep);
+}
+BENCHMARK("readiness/roundtrip/epoll", bench_readiness_epoll);
+#endif
+
+void bench_readiness_timer(bench::State& state) {
+    Chan<int> requests(64);
+    Chan<int> replies(64);
+    round_trips(state, requests, replies, [=]() {
+        event_loop(requests, replies, []() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        });
+    });
+}
+BENCHMARK("readiness/roundtrip/timer_1ms", bench_readiness_timer);
@@ -0,0 +1,169 @@
+#ifdef __linux__
+#include "../../shm_chan.h"
+#include "bench.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+// two processes: ShmChan against a pipe, the glue it replaces.
+// the peer is forked after setup and exits with _exit(), so it runs none of the runner's code.
+
+// a 64-byte record, about the size of a small serialized message.
+struct Record {
+    uint64_t seq;
+    char payload[56];
+};
+
+// runs child(fd...) in a forked process. returns false (after skipping the benchmark) if fork fails.
+template<typename F>
+bool fork_peer(bench::State& state, pid_t& pid, F child) {
+    pid = fork();
+    if (pid < 0) {
+        state.skip("fork failed");
+        return false;
+    }
+    if (pid == 0) {
+        child();
+        _exit(0);
+    }
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Throughput: the parent sends, the child receives and reports how many it got.
+
+void bench_shm_throughput(bench::State& state) {
+    auto chan = ShmChan<Record>::create_anonymous(256);
+    auto done = ShmChan<uint64_t>::create_anonymous(1);
+    size_t n = state.iterations();
+    pid_t pid;
+    bool forked = fork_peer(state, pid, [&]() {
+        auto in = ShmChan<Record>::from_fd(chan.fd());
+        auto out = ShmChan<uint64_t>::from_fd(done.fd());
+        Record r;
+        uint64_t count = 0;
+        while (in.recv(r)) count++;
+        out.send(count);
+    });
+    if (!forked) return;
+
+    state.reset_timer();
+    Record r{};
+    for (size_t i = 0; i < n; ++i) {
+        r.seq = i;
+        chan.send(r);
+    }
+    chan.close();
+    uint64_t received = done.recv();
+    state.stop_timer();
+    waitpid(pid, nullptr, 0);
+    state.counter("received", static_cast<double>(received));
+}
+BENCHMARK("shm/throughput/chan_256", bench_shm_throughput);
+
+// one write() and one read() per record, as with pipes between pipeline stages today.
+void bench_pipe_throughput(bench::State& state) {
+    int data[2];
+    int done[2];
+    if (pipe(data) != 0 || pipe(done) != 0) {
+        state.skip("pipe failed");
+        return;
+    }
+    size_t n = state.iterations();
+    pid_t pid;
+    bool forked = fork_peer(state, pid, [&]() {
+        close(data[1]);
+        Record r;
+        uint64_t count = 0;
+        while (read(data[0], &r, sizeof(r)) == sizeof(r)) count++;
+        [[maybe_unused]] ssize_t w = write(done[1], &count, sizeof(count));
+    });
+    close(data[0]);
+    if (!forked) {
+        close(data[1]);
+        return;
+    }
+
+    state.reset_timer();
+    Record r{};
+    for (size_t i = 0; i < n; ++i) {
+        r.seq = i;
+        [[maybe_unused]] ssize_t w = write(data[1], &r, sizeof(r));
+    }
+    close(data[1]);
+    uint64_t received = 0;
+    [[maybe_unused]] ssize_t got = read(done[0], &received, sizeof(received));
+    state.stop_timer();
+    waitpid(pid, nullptr, 0);
+    close(done[0]);
+    close(done[1]);
+    state.counter("received", static_cast<double>(received));
+}
+BENCHMARK("shm/throughput/pipe", bench_pipe_throughput);
+
+////////////////////////////////////////////////////////////////////////////////
+// Round trip: the child echoes every value back; each iteration is one round trip.
+
+void bench_shm_pingpong(bench::State& state) {
+    auto ping = ShmChan<uint64_t>::create_anonymous(1);
+    auto pong = ShmChan<uint64_t>::create_anonymous(1);
+    pid_t pid;
+    bool forked = fork_peer(state, pid, [&]() {
+        auto in = ShmChan<uint64_t>::from_fd(ping.fd());
+        auto out = ShmChan<uint64_t>::from_fd(pong.fd());
+        uint64_t v;
+        while (in.recv(v)) out.send(v);
+    });
+    if (!forked) return;
+
+    state.reset_timer();
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        auto start = bench::Clock::now();
+        ping.send(i);
+        pong.recv();
+        state.sample(std::chrono::duration<double, std::nano>(bench::Clock::now() - start).count());
+    }
+    state.stop_timer();
+    ping.close();
+    waitpid(pid, nullptr, 0);
+}
+BENCHMARK("shm/pingpong/chan", bench_shm_pingpong);
+
+void bench_pipe_pingpong(bench::State& state) {
+    int ping[2];
+    int pong[2];
+    if (pipe(ping) != 0 || pipe(pong) != 0) {
+        state.skip("pipe failed");
+        return;
+    }
+    pid_t pid;
+    bool forked = fork_peer(state, pid, [&]() {
+        close(ping[1]);
+        uint64_t v;
+        while (read(ping[0], &v, sizeof(v)) == sizeof(v)) {
+            [[maybe_unused]] ssize_t w = write(pong[1], &v, sizeof(v));
+        }
+    });
+    close(ping[0]);
+    if (!forked) {
+        close(ping[1]);
+        return;
+    }
+
+    state.reset_timer();
+    for (size_t i = 0; i < state.iterations(); ++i) {
+        auto start = bench::Clock::now();
+        uint64_t v = i;
+        [[maybe_unused]] ssize_t w = write(ping[1], &v, sizeof(v));
+        [[maybe_unused]] ssize_t r = read(pong[0], &v, sizeof(v));
+        state.sample(std::chrono::duration<double, std::nano>(bench::Clock::now() - start).count());
+    }
+    state.stop_timer();
+    close(ping[1]);
+    waitpid(pid, nullptr, 0);
+    close(pong[0]);
+    close(pong[1]);
+}
+BENCHMARK("shm/pingpong/pipe", bench_pipe_pingpong);
+
+#endif // __linux__
@@ -0,0 +1,182 @@
+#ifndef MERGE_H
+#define MERGE_H
+
+// Merge<T>: receive from many channels at once, without a forwarding thread per input.
+//
+//     std::vector<Chan<Event>> inputs = ...;
+//     Merge merged(inputs);
+//     merged.foreach([](Event e) {handle(e);});   // until every input is closed and drained
+//
+// the merge is the readiness observer (readiness.h) of each input: an input that becomes ready to
+// receive from is appended to a queue of ready inputs, under the input's lock, and a parked
+// consumer is woken. a consumer parks once, on the merge, whatever the number of inputs, and
+// takes the input at the front of the queue; after the receive, the input's observer puts it at
+// the back again if it still has elements. every ready input is therefore served once before any
+// is served twice (round robin), however unevenly they are filled.
+//
+// the queue is under one merge-wide mutex, which a send takes only when it makes its input ready
+// while the input is not queued yet; sends to an input already queued don't touch it. so with
+// many producers and a consumer that keeps up (the inputs go empty between sends) every send
+// takes that one lock, and the merge is a point of contention the inputs' own locks are not;
+// merge_bench's merge/native/4096x8 measures it.
+//
+// an input can't have another readiness observer (or eventfds) while it is merged, and must be
+// lock-based (not Spsc). the inputs stay open and usable; a value sent to an input is received
+// either by the merge or by whoever else receives from that input. with one consumer, each
+// input's elements are received in order.
+
+#include "chan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+template<typename T, typename Config = DefaultChanConfig>
+class Merge {
+private:
+    static_assert(!Config::sync::spsc, "Merge: inputs must be lock-based channels, not Spsc");
+
+    struct Input final : ReadinessObserver {
+        Merge* merge;
+        size_t index;
+        BasicChan<T, Config> chan;
+        // in ready; written under merge->lock. update() reads it under the input's lock only: take()
+        // clears it before its try_recv takes that lock, so an update after the receive sees it.
+        std::atomic<bool> queued{false};
+        bool done{false};       // closed and drained; under merge->lock.
+
+        Input(Merge* m, size_t i, BasicChan<T, Config> c) : merge(m), index(i), chan(std::move(c)) {}
+        void update(bool recv_ready, bool) noexcept override {
+            if (recv_ready && !queued.load(std::memory_order_relaxed)) merge->make_ready(*this);
+        }
+    };
+
+    std::mutex lock;
+    std::condition_variable not_empty;
+    std::vector<std::unique_ptr<Input>> inputs;
+    // a ring of the indices of ready inputs; each is in it at most once, so it never overflows.
+    std::vector<size_t> ready;
+    size_t head{0};
+    size_t count{0};
+    size_t open_inputs;
+    size_t waiting{0};
+    bool closed{false};
+
+    void make_ready(Input& in) noexcept {
+        std::scoped_lock lck{lock};
+        if (in.queued.load(std::memory_order_relaxed) || in.done) return;
+        in.queued.store(true, std::memory_order_relaxed);
+        ready[(head + count++) % ready.size()] = in.index;
+        if (waiting > 0) not_empty.notify_one();
+    }
+
+    template<typename Dst>
+    ChanStatus take(Dst& dst, bool is_blocking);
+
+public:
+    // starts observing every input; throws std::logic_error if one already has an observer
+    // (after releasing the ones observed so far).
+    explicit Merge(std::vector<BasicChan<T, Config>> chans);
+    Merge(const Merge&) = delete;
+    Merge& operator=(const Merge&) = delete;
+    // stops observing the inputs.
+    ~Merge();
+
+    // like Chan::recv: false once every input is closed and drained (or the merge is closed).
+    bool recv(T& dst) {
+        ChanStatus s = take(dst, true);
+        return s == ChanStatus::ok;
+    }
+    T recv() {
+        std::optional<T> temp = recv_optional();
+        return temp ? std::move(*temp) : T();
+    }
+    std::optional<T> recv_optional() {
+        std::optional<T> dst;
+        take(dst, true);
+        return dst;
+    }
+    // ok, would_block, or closed.
+    ChanStatus try_recv(T& dst)                 {return take(dst, false);}
+    ChanStatus try_recv(std::optional<T>& dst)  {return take(dst, false);}
+    void foreach(std::function<void(T)> f) {
+        while (std::optional<T> cur_data = recv_optional()) {
+            f(std::move(*cur_data));
+        }
+    }
+
+    // makes every receive from the merge return closed; the inputs stay open.
+    void close() {
+        std::scoped_lock lck{lock};
+        closed = true;
+        not_empty.notify_all();
+    }
+
+    size_t size() const {return inputs.size();}
+};
+
+template<typename T, typename Config>
+Merge<T, Config>::Merge(std::vector<BasicChan<T, Config>> chans) : ready(std::max<size_t>(chans.size(), 1)), open_inputs(chans.size()) {
+    inputs.reserve(chans.size());
+    for (size_t i = 0; i < chans.size(); ++i) {
+        inputs.push_back(std::make_unique<Input>(this, i, std::move(chans[i])));
+    }
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        try {
+            // queues the input right away if it is ready.
+            inputs[i]->chan.set_observer(inputs[i].get());
+        } catch (...) {
+            while (i-- > 0) inputs[i]->chan.set_observer(nullptr);
+            throw;
+        }
+    }
+}
+
+template<typename T, typename Config>
+Merge<T, Config>::~Merge() {
+    // once set_observer returns, no update is running in this merge.
+    for (auto& in : inputs) {
+        in->chan.set_observer(nullptr);
+    }
+}
+
+template<typename T, typename Config>
+template<typename Dst>
+ChanStatus Merge<T, Config>::take(Dst& dst, bool is_blocking) {
+    std::unique_lock<std::mutex> lck{lock};
+    while (true) {
+        if (closed) return ChanStatus::closed;
+        if (count == 0) {
+            if (open_inputs == 0) return ChanStatus::closed;
+            if (!is_blocking) return ChanStatus::would_block;
+            waiting++;
+            not_empty.wait(lck);
+            waiting--;
+            continue;
+        }
+        Input& in = *inputs[ready[head]];
+        head = (head + 1) % ready.size();
+        count--;
+        in.queued.store(false, std::memory_order_relaxed);
+
+        // the input's lock is taken after ours is released: update() takes them the other way.
+        lck.unlock();
+        ChanStatus s = in.chan.try_recv(dst);
+        if (s == ChanStatus::ok) return s;
+        lck.lock();
+        // would_block: another receiver of the input was first; it is queued again when it is ready.
+        if (s == ChanStatus::closed && !in.done) {
+            in.done = true;
+            if (--open_inputs == 0) not_empty.notify_all();
+        }
+    }
+}
+
+#endif
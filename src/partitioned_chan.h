@@ -0,0 +1,99 @@
+#ifndef PARTITIONED_CHAN_H
+#define PARTITIONED_CHAN_H
+
+// PartitionedChan<T, KeyOf, Policies...>: N channels behind one send(), chosen by the key of
+// each element, so that all elements with the same key go to the same consumer.
+//
+//     auto user_of = [](const Event& e) {return e.user_id;};
+//     PartitionedChan<Event, decltype(user_of)> events(8, 64, user_of);   // 8 partitions of 64
+//     events.send(e);                              // to partition_of(e), always the same for a user
+//     ... consumer i, with per-user state it alone touches:
+//     events.partition(i).foreach([&](Event e) {state[e.user_id].add(e);});
+//
+// each partition is a Chan<T, Policies...> with its own buffer and lock, so producers sending to
+// different partitions don't contend. the partition of an element is a hash of key_of(element)
+// (std::hash of the key, mixed so that keys differing only in high bits spread too) modulo N.
+// partitions are fixed for the life of the channel: there is no rebalancing, and a consumer binds
+// to one by index. a slow partition blocks only the producers sending to it.
+//
+// like Chan, a PartitionedChan is a handle: copies share the partitions.
+
+#include "chan.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+template<typename T, typename KeyOf, typename Config = DefaultChanConfig>
+class BasicPartitionedChan {
+private:
+    static_assert(!Config::sync::spsc, "PartitionedChan: partitions have many senders; Spsc doesn't fit");
+    using Key = std::decay_t<std::invoke_result_t<const KeyOf&, const T&>>;
+    // the status API calls key_of and std::hash<Key> too.
+    static constexpr bool nothrow = nothrow_ops<T, Config> && std::is_nothrow_invocable_v<const KeyOf&, const T&>
+        && noexcept(std::hash<Key>{}(std::declval<const Key&>()));
+
+    KeyOf key_of;
+    std::vector<BasicChan<T, Config>> parts;
+
+public:
+    // capacity is that of each partition (ignored with Fixed<N>).
+    BasicPartitionedChan(size_t partitions, size_t capacity, KeyOf k = KeyOf());
+
+    size_t partitions() const {return parts.size();}
+    // the index of the partition v is sent to.
+    size_t partition_of(const T& v) const {
+        uint64_t h = std::hash<Key>{}(key_of(v));
+        // fibonacci hashing: the high bits of the product depend on every bit of h.
+        return ((h * 0x9e3779b97f4a7c15ull) >> 32) % parts.size();
+    }
+    // partition i, for its consumer. throws std::out_of_range.
+    BasicChan<T, Config>& partition(size_t i) {return parts.at(i);}
+
+    void send(const T& src)                 {parts[partition_of(src)].send(src);}
+    void send(T&& src)                      {parts[partition_of(src)].send(std::move(src));}
+    bool send_nonblocking(const T& src)     {return parts[partition_of(src)].send_nonblocking(src);}
+    ChanStatus send_status(const T& src) noexcept(nothrow) {return parts[partition_of(src)].send_status(src);}
+    ChanStatus send_status(T&& src) noexcept(nothrow)      {return parts[partition_of(src)].send_status(std::move(src));}
+    ChanStatus try_send(const T& src) noexcept(nothrow)    {return parts[partition_of(src)].try_send(src);}
+    ChanStatus try_send(T&& src) noexcept(nothrow)         {return parts[partition_of(src)].try_send(std::move(src));}
+
+    // closes every partition; each consumer drains its own and stops.
+    // throws CloseOfClosedChannelException if they were all closed already.
+    void close()                            {throw_close_status(close_status());}
+    ChanStatus close_status() noexcept;
+};
+
+template<typename T, typename KeyOf, typename Config>
+BasicPartitionedChan<T, KeyOf, Config>::BasicPartitionedChan(size_t partitions, size_t capacity, KeyOf k)
+    : key_of(std::move(k)) {
+    if (partitions == 0) {
+        throw std::invalid_argument("PartitionedChan needs at least one partition");
+    }
+    parts.reserve(partitions);
+    for (size_t i = 0; i < partitions; ++i) {
+        if constexpr (Config::storage::runtime_capacity) {
+            parts.emplace_back(capacity);
+        } else {
+            parts.emplace_back();
+        }
+    }
+}
+
+template<typename T, typename KeyOf, typename Config>
+ChanStatus BasicPartitionedChan<T, KeyOf, Config>::close_status() noexcept {
+    ChanStatus s = ChanStatus::closed;
+    for (auto& p : parts) {
+        if (p.close_status() == ChanStatus::ok) s = ChanStatus::ok;
+    }
+    return s;
+}
+
+template<typename T, typename KeyOf, typename... Policies>
+using PartitionedChan = BasicPartitionedChan<T, KeyOf, typename chan_policy::make_config<Policies...>::type>;
+
+#endif
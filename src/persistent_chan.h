@@ -0,0 +1,537 @@
+#ifndef PERSISTENT_CHAN_H
+#define PERSISTENT_CHAN_H
+
+// PersistentChan<T>: a channel whose elements survive a process restart.
+//
+// sent elements are appended to a write-ahead log of memory-mapped segment files in a directory.
+// a receiver only sees an element once it is durable, and acknowledges it with ack(seq) once it
+// has been handled. when the channel is opened again, every element that was sent durably but
+// not acknowledged is received again, in order (at-least-once delivery).
+//
+//     PersistentChan<Job> jobs("/var/lib/app/jobs");
+//     jobs.send(job);                         // returns once job is on disk
+//     while (auto d = jobs.recv()) {
+//         run(d->value);
+//         jobs.ack(d->seq);                   // acknowledges d->seq and everything before it
+//     }
+//
+// group commit: a send waits for its record to be synced, but one sync covers every record
+// appended before it started. the first waiting sender syncs (msync of the new pages, and the
+// acknowledged offset if it moved) with the lock released; senders that arrive meanwhile append
+// and wait for the next sync, so under load a sync is amortized over many sends.
+// send_nowait() only appends; sync() (or any later send) makes it durable.
+//
+// on disk, each segment is named by the seq of its first record, and a record is a header of
+// length, CRC-32 and seq, then the bytes written by SpillCodec<T>. a record torn by a crash fails
+// its CRC or seq check; the log is cut there on open. segments whose elements are all
+// acknowledged are deleted. the acknowledged offset is kept in a small meta file.
+// close() is not persistent: a reopened channel is open. one process at a time may open a directory.
+
+#include "chan.h"
+#include "spill_buffer.h"
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace wal {
+
+inline constexpr std::array<uint32_t, 256> crc_table = [] {
+    std::array<uint32_t, 256> t{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        t[i] = c;
+    }
+    return t;
+}();
+
+inline uint32_t crc32(const void* data, size_t n, uint32_t crc = 0) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < n; ++i) crc = crc_table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+[[noreturn]] inline void throw_errno(const std::string& what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+// makes the data written to fd durable. fdatasync where there is one; on macOS fsync leaves the
+// data in the drive's cache, so F_FULLFSYNC (which some file systems refuse, then fsync).
+inline int sync_data(int fd) {
+#if defined(__linux__)
+    return fdatasync(fd);
+#elif defined(F_FULLFSYNC)
+    return fcntl(fd, F_FULLFSYNC) == 0 ? 0 : fsync(fd);
+#else
+    return fsync(fd);
+#endif
+}
+
+// makes the entries of dir durable: a file created or removed there survives a crash only after this.
+inline void sync_dir(const std::string& dir) {
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) throw_errno("PersistentChan: open " + dir);
+    int r = fsync(fd);
+    int e = errno;
+    ::close(fd);
+    if (r != 0) {
+        errno = e;
+        throw_errno("PersistentChan: fsync " + dir);
+    }
+}
+
+// seq 0 is never used, so zeros (the rest of a fresh file) end a segment.
+struct RecordHeader {
+    uint32_t len;
+    uint32_t crc;   // of seq and the payload.
+    uint64_t seq;
+};
+
+inline size_t record_size(size_t n) {return (sizeof(RecordHeader) + n + 7) / 8 * 8;}
+
+// one log file, mapped whole.
+class Segment {
+private:
+    int fd{-1};
+    size_t size{0};
+public:
+    std::byte* data{nullptr};
+    std::string path;
+    uint64_t first_seq{0};
+    size_t write_off{0};    // end of the records.
+    size_t synced_off{0};   // records before this are durable.
+
+    Segment() = default;
+    Segment(const Segment&) = delete;
+    Segment& operator=(const Segment&) = delete;
+    ~Segment() {
+        if (data) munmap(data, size);
+        if (fd >= 0) close(fd);
+    }
+
+    static std::unique_ptr<Segment> open(const std::string& path, uint64_t first_seq, size_t size, bool create);
+
+    bool fits(size_t n) const {return write_off + record_size(n) <= size;}
+    size_t capacity() const {return size;}
+
+    // the record at off, or nullptr at the end of the segment.
+    const RecordHeader* at(size_t off) const {
+        if (off + sizeof(RecordHeader) > size) return nullptr;
+        auto h = reinterpret_cast<const RecordHeader*>(data + off);
+        return h->seq == 0 ? nullptr : h;
+    }
+    // true if the record at off is whole and is number seq.
+    bool valid(size_t off, uint64_t seq) const;
+
+    void sync(size_t from, size_t to);
+};
+
+inline std::unique_ptr<Segment> Segment::open(const std::string& path, uint64_t first_seq, size_t size, bool create) {
+    auto s = std::make_unique<Segment>();
+    s->path = path;
+    s->first_seq = first_seq;
+    s->fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+    if (s->fd < 0) throw_errno("PersistentChan: open " + path);
+    if (create) {
+        if (ftruncate(s->fd, static_cast<off_t>(size)) != 0) throw_errno("PersistentChan: ftruncate " + path);
+        // the size, and the file itself, must be durable before any record is.
+        if (fsync(s->fd) != 0) throw_errno("PersistentChan: fsync " + path);
+        sync_dir(std::filesystem::path(path).parent_path().string());
+    } else {
+        size = static_cast<size_t>(lseek(s->fd, 0, SEEK_END));
+    }
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+    if (p == MAP_FAILED) throw_errno("PersistentChan: mmap " + path);
+    s->data = static_cast<std::byte*>(p);
+    s->size = size;
+    return s;
+}
+
+inline bool Segment::valid(size_t off, uint64_t seq) const {
+    const RecordHeader* h = at(off);
+    if (!h || h->seq != seq || off + record_size(h->len) > size) return false;
+    return h->crc == crc32(data + off + sizeof(RecordHeader), h->len, crc32(&h->seq, sizeof(h->seq)));
+}
+
+inline void Segment::sync(size_t from, size_t to) {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t start = from / page * page;
+    if (msync(data + start, to - start, MS_SYNC) != 0) throw_errno("PersistentChan: msync " + path);
+}
+
+} // namespace wal
+
+struct PersistentOptions {
+    size_t segment_size{64 << 20};
+};
+
+template<typename T>
+struct Delivery {
+    uint64_t seq;
+    T value;
+};
+
+template<typename T>
+class PersistentChan {
+private:
+    static_assert(has_spill_codec<T>, "PersistentChan: T is not trivially copyable; specialize SpillCodec<T>");
+    using Codec = SpillCodec<T>;
+
+    std::string dir;
+    PersistentOptions options;
+    int lock_fd{-1};
+    int meta_fd{-1};
+
+    std::mutex m;
+    std::condition_variable durable_cv;
+    std::condition_variable recv_cv;
+
+    // oldest first; the back one is appended to.
+    std::deque<std::unique_ptr<wal::Segment>> segments;
+    uint64_t next_seq{1};       // of the next send.
+    uint64_t durable_seq{0};    // every record up to this one is synced.
+    uint64_t acked_seq{0};
+    uint64_t synced_acked{0};   // the acked_seq in the meta file.
+    uint64_t read_seq{1};       // the next to be received, at segments[read_index], read_off.
+    size_t read_index{0};
+    size_t read_off{0};
+    bool syncing{false};
+    bool closed{false};
+
+    std::string segment_path(uint64_t first_seq) const;
+    void open_log();
+    void write_meta(uint64_t acked);
+    uint64_t append(const T& v);
+    // one round of group commit, as the leader; called with the lock held and syncing set.
+    void sync_round(std::unique_lock<std::mutex>& lk);
+    void wait_durable(std::unique_lock<std::mutex>& lk, uint64_t seq);
+    void retire();
+
+public:
+    // opens the log in directory (making it if needed) and replays what was not acknowledged.
+    explicit PersistentChan(const std::string& directory, PersistentOptions o = PersistentOptions());
+    PersistentChan(const PersistentChan&) = delete;
+    PersistentChan& operator=(const PersistentChan&) = delete;
+    // syncs and closes the files; unacknowledged elements stay in the log.
+    ~PersistentChan();
+
+    // returns the element's seq once it is durable. throws SendOnClosedChannelException after close().
+    uint64_t send(const T& v);
+    // returns once the element is appended; it is durable after the next sync.
+    uint64_t send_nowait(const T& v);
+    // makes every send so far, and the acknowledged offset, durable.
+    void sync();
+
+    // the next durable element; nullopt once the channel is closed and drained.
+    std::optional<Delivery<T>> recv();
+    std::optional<Delivery<T>> try_recv();
+    // acknowledges seq and every element before it; persisted with the next sync, and the
+    // segments it frees are deleted then.
+    void ack(uint64_t seq);
+
+    // like Chan::close(); syncs first, so receivers see everything that was sent.
+    void close();
+
+    // elements sent and not yet acknowledged, and segment files on disk.
+    uint64_t unacked() {
+        std::lock_guard<std::mutex> lk(m);
+        return next_seq - 1 - acked_seq;
+    }
+    size_t segment_count() {
+        std::lock_guard<std::mutex> lk(m);
+        return segments.size();
+    }
+};
+
+template<typename T>
+std::string PersistentChan<T>::segment_path(uint64_t first_seq) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "wal-%020llu.log", static_cast<unsigned long long>(first_seq));
+    return dir + "/" + name;
+}
+
+template<typename T>
+PersistentChan<T>::PersistentChan(const std::string& directory, PersistentOptions o) : dir(directory), options(o) {
+    std::filesystem::create_directories(dir);
+    lock_fd = ::open((dir + "/lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd < 0) wal::throw_errno("PersistentChan: open lock");
+    if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+        ::close(lock_fd);
+        throw std::runtime_error("PersistentChan: " + dir + " is open in another process");
+    }
+    try {
+        meta_fd = ::open((dir + "/acked").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (meta_fd < 0) wal::throw_errno("PersistentChan: open acked");
+        wal::sync_dir(dir);
+        uint64_t meta[2] = {0, 0};
+        if (pread(meta_fd, meta, sizeof(meta), 0) == sizeof(meta) && meta[1] == ~meta[0]) {
+            acked_seq = synced_acked = meta[0];
+        }
+        open_log();
+    } catch (...) {
+        segments.clear();
+        if (meta_fd >= 0) ::close(meta_fd);
+        ::close(lock_fd);
+        throw;
+    }
+}
+
+// replays the log: finds where it ends (or was torn), and where receiving resumes.
+template<typename T>
+void PersistentChan<T>::open_log() {
+    std::vector<uint64_t> firsts;
+    for (auto& e : std::filesystem::directory_iterator(dir)) {
+        unsigned long long first;
+        std::string name = e.path().filename().string();
+        if (std::sscanf(name.c_str(), "wal-%llu.log", &first) == 1) firsts.push_back(first);
+    }
+    std::sort(firsts.begin(), firsts.end());
+
+    uint64_t expected = firsts.empty() ? acked_seq + 1 : firsts.front();
+    bool torn = false;
+    for (uint64_t first : firsts) {
+        if (torn || first != expected
+                || std::filesystem::file_size(segment_path(first)) < sizeof(wal::RecordHeader)) {
+            // after a cut, a gap, or a file whose size never reached the disk: nothing further
+            // can be trusted.
+            torn = true;
+            std::filesystem::remove(segment_path(first));
+            continue;
+        }
+        segments.push_back(wal::Segment::open(segment_path(first), first, 0, false));
+        wal::Segment& s = *segments.back();
+        size_t off = 0;
+        while (s.at(off)) {
+            if (!s.valid(off, expected)) {
+                torn = true;
+                break;
+            }
+            off += wal::record_size(s.at(off)->len);
+            expected++;
+        }
+        s.write_off = s.synced_off = off;
+        if (torn) {
+            // clear the torn tail, so that later records can't be confused with what was there.
+            std::memset(s.data + off, 0, s.capacity() - off);
+            s.sync(off, s.capacity());
+        }
+    }
+    // the removals and the cleared tail must not come back after another crash.
+    if (torn) wal::sync_dir(dir);
+    next_seq = expected;
+    durable_seq = next_seq - 1;
+    if (acked_seq > durable_seq) acked_seq = synced_acked = durable_seq;
+
+    if (segments.empty()) {
+        segments.push_back(wal::Segment::open(segment_path(next_seq), next_seq, options.segment_size, true));
+    }
+
+    // skip what was acknowledged.
+    read_seq = segments.front()->first_seq;
+    while (read_seq <= acked_seq) {
+        const wal::RecordHeader* h = segments[read_index]->at(read_off);
+        if (!h) {
+            read_index++;
+            read_off = 0;
+            continue;
+        }
+        read_off += wal::record_size(h->len);
+        read_seq++;
+    }
+    retire();
+}
+
+template<typename T>
+PersistentChan<T>::~PersistentChan() {
+    try {
+        sync();
+    } catch (...) {
+        // unsynced records are replayed or cut on the next open.
+    }
+    segments.clear();
+    ::close(meta_fd);
+    ::close(lock_fd);
+}
+
+template<typename T>
+void PersistentChan<T>::write_meta(uint64_t acked) {
+    uint64_t meta[2] = {acked, ~acked};
+    if (pwrite(meta_fd, meta, sizeof(meta), 0) != sizeof(meta) || wal::sync_data(meta_fd) != 0) {
+        wal::throw_errno("PersistentChan: write acked");
+    }
+}
+
+template<typename T>
+uint64_t PersistentChan<T>::append(const T& v) {
+    size_t n = Codec::size(v);
+    if (wal::record_size(n) > options.segment_size) {
+        throw std::length_error("PersistentChan: element larger than a segment");
+    }
+    if (!segments.back()->fits(n)) {
+        segments.push_back(wal::Segment::open(segment_path(next_seq), next_seq, options.segment_size, true));
+    }
+    wal::Segment& s = *segments.back();
+    std::byte* out = s.data + s.write_off;
+    Codec::write(v, out + sizeof(wal::RecordHeader));
+    wal::RecordHeader h{static_cast<uint32_t>(n), 0, next_seq};
+    h.crc = wal::crc32(out + sizeof(h), n, wal::crc32(&h.seq, sizeof(h.seq)));
+    std::memcpy(out, &h, sizeof(h));
+    s.write_off += wal::record_size(n);
+    return next_seq++;
+}
+
+template<typename T>
+void PersistentChan<T>::sync_round(std::unique_lock<std::mutex>& lk) {
+    struct Range {
+        wal::Segment* s;
+        size_t from;
+        size_t to;
+    };
+    std::vector<Range> ranges;
+    for (auto& s : segments) {
+        if (s->synced_off < s->write_off) ranges.push_back({s.get(), s->synced_off, s->write_off});
+    }
+    uint64_t upto = next_seq - 1;
+    uint64_t acked = acked_seq;
+
+    // segments with unsynced records hold elements nobody could receive, so none of them is
+    // retired while the lock is released.
+    lk.unlock();
+    std::exception_ptr error;
+    try {
+        for (auto& r : ranges) r.s->sync(r.from, r.to);
+        if (acked != synced_acked) write_meta(acked);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    lk.lock();
+
+    syncing = false;
+    durable_cv.notify_all();
+    if (error) std::rethrow_exception(error);
+    for (auto& r : ranges) r.s->synced_off = std::max(r.s->synced_off, r.to);
+    durable_seq = std::max(durable_seq, upto);
+    synced_acked = std::max(synced_acked, acked);
+    retire();
+    recv_cv.notify_all();
+}
+
+template<typename T>
+void PersistentChan<T>::wait_durable(std::unique_lock<std::mutex>& lk, uint64_t seq) {
+    while (durable_seq < seq) {
+        if (!syncing) {
+            syncing = true;
+            sync_round(lk);
+        } else {
+            durable_cv.wait(lk);
+        }
+    }
+}
+
+template<typename T>
+uint64_t PersistentChan<T>::send(const T& v) {
+    std::unique_lock<std::mutex> lk(m);
+    if (closed) throw SendOnClosedChannelException();
+    uint64_t seq = append(v);
+    wait_durable(lk, seq);
+    return seq;
+}
+
+template<typename T>
+uint64_t PersistentChan<T>::send_nowait(const T& v) {
+    std::unique_lock<std::mutex> lk(m);
+    if (closed) throw SendOnClosedChannelException();
+    return append(v);
+}
+
+template<typename T>
+void PersistentChan<T>::sync() {
+    std::unique_lock<std::mutex> lk(m);
+    // a round already under way may have started before our sends or ack; run one of our own.
+    durable_cv.wait(lk, [this] {return !syncing;});
+    syncing = true;
+    sync_round(lk);
+}
+
+template<typename T>
+std::optional<Delivery<T>> PersistentChan<T>::try_recv() {
+    std::unique_lock<std::mutex> lk(m);
+    if (read_seq > durable_seq) return std::nullopt;
+    const wal::RecordHeader* h = segments[read_index]->at(read_off);
+    if (!h) {
+        read_index++;
+        read_off = 0;
+        h = segments[read_index]->at(0);
+    }
+    const std::byte* in = segments[read_index]->data + read_off + sizeof(wal::RecordHeader);
+    Delivery<T> d{read_seq, Codec::read(in, h->len)};
+    read_off += wal::record_size(h->len);
+    read_seq++;
+    return d;
+}
+
+template<typename T>
+std::optional<Delivery<T>> PersistentChan<T>::recv() {
+    // a racing receiver may take the element first; then wait again, unless closed and drained.
+    while (true) {
+        if (auto d = try_recv()) return d;
+        std::unique_lock<std::mutex> lk(m);
+        // drained means every appended record was received: close() may still be syncing the last
+        // ones, and its sync_round wakes us when they are durable.
+        if (closed && read_seq == next_seq) return std::nullopt;
+        recv_cv.wait(lk, [this] {return read_seq <= durable_seq || (closed && read_seq == next_seq);});
+    }
+}
+
+template<typename T>
+void PersistentChan<T>::ack(uint64_t seq) {
+    std::lock_guard<std::mutex> lk(m);
+    acked_seq = std::max(acked_seq, std::min(seq, read_seq - 1));
+    retire();
+}
+
+// deletes segments before the read position whose records are all acknowledged.
+template<typename T>
+void PersistentChan<T>::retire() {
+    bool removed = false;
+    while (read_index > 0 && segments[1]->first_seq - 1 <= synced_acked) {
+        std::filesystem::remove(segments.front()->path);
+        segments.pop_front();
+        read_index--;
+        removed = true;
+    }
+    if (removed) wal::sync_dir(dir);
+}
+
+template<typename T>
+void PersistentChan<T>::close() {
+    {
+        std::lock_guard<std::mutex> lk(m);
+        if (closed) throw CloseOfClosedChannelException();
+        closed = true;
+    }
+    sync();
+    recv_cv.notify_all();
+}
+
+#endif
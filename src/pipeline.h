@@ -0,0 +1,466 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// pipelines of stages connected by channels, each stage run by a pool of worker threads.
+//
+//     Pipeline p;
+//     p.from(lines)                                                   // a Chan<std::string>
+//         .flat_map([](std::string l) {return split(l);}, {4, 256})   // 4 workers, capacity 256
+//         .filter([](const std::string& w) {return !w.empty();}, {4})
+//         .map([](std::string w) {return w.size();}, {4})
+//         .batch(100)
+//         .sink([&](std::vector<size_t> b) {record(b);});
+//     p.wait();
+//
+// each stage reads its input channel with StageOptions::workers threads and writes to its own
+// output channel of StageOptions::capacity. when the last worker of a stage finishes (its input
+// is closed and drained), it closes the output, so closing the source closes every stage in
+// turn and nothing needs to sleep and then close.
+//
+// fusion: map, filter, flat_map and sink keep no state, so when one follows another with the
+// same number of workers, both run in the same worker loop and the element is passed by a call
+// instead of a channel (above, flat_map > filter > map is one loop of 4 workers, writing to a
+// channel of 256 for batch). the channel of fused stages has the capacity of the last, or a larger
+// one given to a stage before it (a capacity other than the default). a channel is put between two stages when the number of workers
+// changes, when StageOptions::fuse is false (to buffer between them), and around batch and
+// ordered_map. plan() lists the resulting stages, their workers and their channels.
+//
+// map() with several workers emits results in the order they finish; ordered_map() emits them in
+// input order, through a reorder buffer (see OrderedMap).
+//
+// if a stage function throws, wait() rethrows the first exception. the failing stage closes its
+// input, so the stages before it stop at their next send, and its output as usual, so the stages
+// after it drain what they have and stop.
+
+#include "chan.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+struct StageOptions {
+    size_t workers{1};
+    // of the stage's output channel; 0 for an unbuffered one.
+    size_t capacity{64};
+    // run in the loop of the stage before, if both keep no state and have as many workers.
+    // false puts a channel of the stage before's capacity between them.
+    bool fuse{true};
+};
+
+// one stage of the physical plan: the stages fused into it, its threads, and its output channel.
+struct PhysicalStage {
+    std::string ops;            // ex. "map > filter > map".
+    size_t workers;
+    bool has_output;            // false for the sink.
+    size_t capacity;
+};
+
+template<typename T>
+class Stage;
+
+class Pipeline {
+private:
+    std::mutex lock;
+    std::vector<std::thread> threads;
+    std::vector<PhysicalStage> physical;
+    std::exception_ptr error;
+
+    template<typename T>
+    friend class Stage;
+
+    void fail(std::exception_ptr e) {
+        std::scoped_lock lck{lock};
+        if (!error) error = e;
+    }
+
+    // starts o.workers threads that run body(out) and then, in the last one to finish, close out.
+    // body returns once the stage's input is drained or out is closed. stop_input closes the
+    // input: when a worker throws, and when out was closed by the next stage (it failed).
+    template<typename U, typename Body>
+    Stage<U> spawn(std::string ops, StageOptions o, bool has_output, std::function<void()> stop_input, Body body);
+
+public:
+    Pipeline() = default;
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+    // waits for the stages, without rethrowing.
+    ~Pipeline();
+
+    // a pipeline reading a channel that the caller fills and closes.
+    template<typename T>
+    Stage<T> from(Chan<T> in) {return Stage<T>(this, std::move(in));}
+    // a pipeline reading values, sent by one thread.
+    template<typename T>
+    Stage<T> from(std::vector<T> values, StageOptions o = StageOptions());
+
+    // joins every worker; rethrows the first exception a stage threw.
+    // stages must not be added while waiting.
+    void wait();
+
+    // the stages started so far, in the order they were started.
+    std::vector<PhysicalStage> physical_plan() {
+        std::scoped_lock lck{lock};
+        return physical;
+    }
+    // physical_plan() as text, one stage per line.
+    std::string plan();
+};
+
+// stateless stages that are not started yet: run(emit) is the loop of one worker, which reads
+// the input of the first of them and passes each result of the last to emit. emit returns false
+// once the output is closed, and run then returns.
+template<typename T>
+struct PendingStages {
+    std::string ops;
+    StageOptions options;
+    std::function<void()> stop_input;
+    std::function<void(const std::function<bool(T&&)>&)> run;
+};
+
+// the output of one stage, from which the next is built. a Stage is consumed by exactly one next
+// stage (or read directly through chan()); building two from it makes them compete for elements.
+// a stage that can be fused is only started when the stage after it is built: a Stage that is
+// never consumed never runs.
+template<typename T>
+class Stage {
+private:
+    Pipeline* pipeline;
+    std::optional<Chan<T>> out;                 // once started,
+    std::shared_ptr<PendingStages<T>> pending;  // or else.
+
+    friend class Pipeline;
+    template<typename U>
+    friend class Stage;
+    Stage(Pipeline* p, Chan<T> c) : pipeline(p), out(std::move(c)) {}
+    Stage(Pipeline* p, std::shared_ptr<PendingStages<T>> s) : pipeline(p), pending(std::move(s)) {}
+
+    // starts the pending stages, writing to a channel.
+    void start();
+    // the stateless stage op, whose step(T&&, emit) returns false once emit does, fused into the
+    // pending stages when o allows it.
+    template<typename U, typename Step>
+    Stage<U> then(const char* op, StageOptions o, Step step);
+    std::function<void()> stop_input() {
+        Chan<T> in = *out;
+        return [in]() mutable {in.close_status();};
+    }
+
+public:
+    // f(T) -> U
+    template<typename F>
+    auto map(F f, StageOptions o = StageOptions());
+    // map() whose output keeps the input order. at most window elements (default 4 per worker)
+    // are in flight between the oldest one not yet emitted and the newest one taken.
+    template<typename F>
+    auto ordered_map(F f, StageOptions o = StageOptions(), size_t window = 0);
+    // elements for which f(const T&) is true.
+    template<typename F>
+    Stage<T> filter(F f, StageOptions o = StageOptions());
+    // every element of the range f(T) returns, in order.
+    template<typename F>
+    auto flat_map(F f, StageOptions o = StageOptions());
+    // vectors of n elements; each worker batches on its own, and sends what it has left at the end.
+    Stage<std::vector<T>> batch(size_t n, StageOptions o = StageOptions());
+    // calls f(T) on every element; the last stage. o.capacity is unused.
+    template<typename F>
+    void sink(F f, StageOptions o = StageOptions());
+
+    // the stage's output channel, to read it outside the pipeline; starts the stage.
+    Chan<T> chan() {
+        start();
+        return *out;
+    }
+};
+
+// reads in until it is drained, calling body(T&&); stops early if body returns false
+// (the output is closed).
+template<typename T, typename Body>
+void pipeline_each(Chan<T>& in, Body& body) {
+    std::optional<T> v;
+    while (in.recv_status(v) == ChanStatus::ok && v) {
+        if (!body(std::move(*v))) return;
+        v.reset();
+    }
+}
+
+// sends v, false if out is closed: a later stage failed.
+template<typename U>
+bool pipeline_emit(Chan<U>& out, U&& v) {
+    return out.send_status(std::move(v)) == ChanStatus::ok;
+}
+
+// the reorder buffer of an ordered_map stage, shared by its workers.
+// a worker takes an element and its seq together (recv_lock keeps them in order), and puts the
+// result in slot seq % window. the worker that fills the slot of the next seq to emit sends it,
+// and every later result that is ready, with the lock released; the others return at once.
+// a seq is only taken once it is less than window past the next one to emit, so an element that
+// is slow to map, or a slow next stage, stops the workers from taking more: backpressure reaches
+// the input instead of the buffer growing.
+template<typename T, typename U>
+class OrderedMap {
+private:
+    std::mutex recv_lock;
+    std::mutex lock;
+    std::condition_variable window_open;
+    std::vector<std::optional<U>> slots;
+    uint64_t next_seq{0};       // of the next element taken.
+    uint64_t next_emit{0};      // of the next result sent.
+    bool emitting{false};
+    bool stopped{false};        // a worker failed, or the next stage is closed.
+
+public:
+    explicit OrderedMap(size_t window) : slots(window) {}
+
+    // the next element and its seq, once the window allows it; false at the end.
+    bool take(Chan<T>& in, std::optional<T>& v, uint64_t& seq) {
+        std::scoped_lock r{recv_lock};
+        {
+            std::unique_lock<std::mutex> lck{lock};
+            window_open.wait(lck, [this] {return stopped || next_seq - next_emit < slots.size();});
+            if (stopped) return false;
+        }
+        if (in.recv_status(v) != ChanStatus::ok || !v) return false;
+        std::scoped_lock lck{lock};
+        seq = next_seq++;
+        return true;
+    }
+
+    // false if the next stage is closed.
+    bool put(Chan<U>& out, uint64_t seq, U&& result) {
+        std::unique_lock<std::mutex> lck{lock};
+        slots[seq % slots.size()] = std::move(result);
+        if (emitting) return true;
+        emitting = true;
+        while (!stopped) {
+            std::optional<U>& head = slots[next_emit % slots.size()];
+            if (!head) break;
+            U r = std::move(*head);
+            head.reset();
+            lck.unlock();
+            bool sent = pipeline_emit(out, std::move(r));
+            lck.lock();
+            if (!sent) stopped = true;
+            next_emit++;
+            window_open.notify_all();
+        }
+        emitting = false;
+        return !stopped;
+    }
+
+    void stop() {
+        std::scoped_lock lck{lock};
+        stopped = true;
+        window_open.notify_all();
+    }
+};
+
+template<typename U, typename Body>
+Stage<U> Pipeline::spawn(std::string ops, StageOptions o, bool has_output, std::function<void()> stop_input, Body body) {
+    Chan<U> out(o.capacity);
+    auto running = std::make_shared<std::atomic<size_t>>(o.workers);
+    std::scoped_lock lck{lock};
+    physical.push_back(PhysicalStage{std::move(ops), o.workers, has_output, o.capacity});
+    for (size_t i = 0; i < o.workers; ++i) {
+        threads.emplace_back([this, stop_input, out, running, body]() mutable {
+            try {
+                body(out);
+            } catch (...) {
+                fail(std::current_exception());
+                stop_input();
+            }
+            if (--*running == 0) {
+                // if out was closed by the next stage, it failed; stop the stages before this one.
+                if (out.close_status() == ChanStatus::closed) stop_input();
+            }
+        });
+    }
+    return Stage<U>(this, std::move(out));
+}
+
+template<typename T>
+Stage<T> Pipeline::from(std::vector<T> values, StageOptions o) {
+    auto shared = std::make_shared<std::vector<T>>(std::move(values));
+    return spawn<T>("source", StageOptions{1, o.capacity}, true, []() {}, [shared](Chan<T>& out) {
+        for (auto& v : *shared) {
+            if (!pipeline_emit(out, std::move(v))) break;
+        }
+    });
+}
+
+inline void Pipeline::wait() {
+    for (auto& t : threads) {
+        t.join();
+    }
+    threads.clear();
+    if (error) std::rethrow_exception(std::exchange(error, nullptr));
+}
+
+inline Pipeline::~Pipeline() {
+    for (auto& t : threads) {
+        if (t.joinable()) t.join();
+    }
+}
+
+inline std::string Pipeline::plan() {
+    std::ostringstream os;
+    for (auto& s : physical_plan()) {
+        os << s.ops << ": " << s.workers << (s.workers == 1 ? " worker" : " workers");
+        if (s.has_output) os << " -> chan(" << s.capacity << ")";
+        os << "\n";
+    }
+    return os.str();
+}
+
+template<typename T>
+void Stage<T>::start() {
+    if (!pending) return;
+    std::shared_ptr<PendingStages<T>> s = std::move(pending);
+    pending.reset();
+    *this = pipeline->spawn<T>(s->ops, s->options, true, s->stop_input, [run = s->run](Chan<T>& out) {
+        run([&](T&& v) {return pipeline_emit(out, std::move(v));});
+    });
+}
+
+template<typename T>
+template<typename U, typename Step>
+Stage<U> Stage<T>::then(const char* op, StageOptions o, Step step) {
+    if (o.workers == 0) {
+        throw std::invalid_argument("Pipeline: a stage needs at least one worker");
+    }
+    if (pending && !(o.fuse && o.workers == pending->options.workers)) start();
+    auto s = std::make_shared<PendingStages<U>>();
+    s->options = o;
+    if (pending && pending->options.capacity != StageOptions().capacity) {
+        s->options.capacity = std::max(o.capacity, pending->options.capacity);
+    }
+    if (pending) {
+        s->ops = pending->ops + " > " + op;
+        s->stop_input = pending->stop_input;
+        s->run = [run = pending->run, step](const std::function<bool(U&&)>& emit) mutable {
+            run([&](T&& v) {return step(std::move(v), emit);});
+        };
+    } else {
+        Chan<T> in = *out;
+        s->ops = op;
+        s->stop_input = stop_input();
+        s->run = [in, step](const std::function<bool(U&&)>& emit) mutable {
+            auto body = [&](T&& v) {return step(std::move(v), emit);};
+            pipeline_each(in, body);
+        };
+    }
+    return Stage<U>(pipeline, std::move(s));
+}
+
+template<typename T>
+template<typename F>
+auto Stage<T>::map(F f, StageOptions o) {
+    using U = std::decay_t<std::invoke_result_t<F&, T&&>>;
+    return then<U>("map", o, [f](T&& v, const std::function<bool(U&&)>& emit) mutable {
+        return emit(f(std::move(v)));
+    });
+}
+
+template<typename T>
+template<typename F>
+auto Stage<T>::ordered_map(F f, StageOptions o, size_t window) {
+    using U = std::decay_t<std::invoke_result_t<F&, T&&>>;
+    if (o.workers == 0) {
+        throw std::invalid_argument("Pipeline: a stage needs at least one worker");
+    }
+    start();
+    Chan<T> in = *out;
+    auto reorder = std::make_shared<OrderedMap<T, U>>(window ? window : 4 * o.workers);
+    return pipeline->spawn<U>("ordered_map", o, true, stop_input(), [in, f, reorder](Chan<U>& out) mutable {
+        std::optional<T> v;
+        uint64_t seq;
+        try {
+            while (reorder->take(in, v, seq)) {
+                if (!reorder->put(out, seq, f(std::move(*v)))) break;
+                v.reset();
+            }
+        } catch (...) {
+            // the failed element's slot is never filled: release the workers waiting for it.
+            reorder->stop();
+            throw;
+        }
+    });
+}
+
+template<typename T>
+template<typename F>
+Stage<T> Stage<T>::filter(F f, StageOptions o) {
+    return then<T>("filter", o, [f](T&& v, const std::function<bool(T&&)>& emit) mutable {
+        return !f(std::as_const(v)) || emit(std::move(v));
+    });
+}
+
+template<typename T>
+template<typename F>
+auto Stage<T>::flat_map(F f, StageOptions o) {
+    using R = std::decay_t<std::invoke_result_t<F&, T&&>>;
+    using U = std::decay_t<decltype(*std::begin(std::declval<R&>()))>;
+    return then<U>("flat_map", o, [f](T&& v, const std::function<bool(U&&)>& emit) mutable {
+        R range = f(std::move(v));
+        for (auto& u : range) {
+            if (!emit(U(std::move(u)))) return false;
+        }
+        return true;
+    });
+}
+
+template<typename T>
+Stage<std::vector<T>> Stage<T>::batch(size_t n, StageOptions o) {
+    if (n == 0) {
+        throw std::invalid_argument("Pipeline: batch size must be positive");
+    }
+    if (o.workers == 0) {
+        throw std::invalid_argument("Pipeline: a stage needs at least one worker");
+    }
+    using U = std::vector<T>;
+    start();
+    Chan<T> in = *out;
+    return pipeline->spawn<U>("batch", o, true, stop_input(), [in, n](Chan<U>& out) mutable {
+        U b;
+        b.reserve(n);
+        auto body = [&](T&& v) {
+            b.push_back(std::move(v));
+            if (b.size() < n) return true;
+            bool sent = pipeline_emit(out, std::move(b));
+            b = U();
+            b.reserve(n);
+            return sent;
+        };
+        pipeline_each(in, body);
+        if (!b.empty()) pipeline_emit(out, std::move(b));
+    });
+}
+
+template<typename T>
+template<typename F>
+void Stage<T>::sink(F f, StageOptions o) {
+    // a stage of no output; its channel is never written, and only closed at the end.
+    o.capacity = 0;
+    Stage<char> end = then<char>("sink", o, [f](T&& v, const std::function<bool(char&&)>&) mutable {
+        f(std::move(v));
+        return true;
+    });
+    auto s = std::move(end.pending);
+    pipeline->spawn<char>(s->ops, s->options, false, s->stop_input, [run = s->run](Chan<char>&) {
+        run([](char&&) {return true;});
+    });
+}
+
+#endif
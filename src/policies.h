@@ -0,0 +1,376 @@
+#ifndef POLICIES_H
+#define POLICIES_H
+
+// Compile-time policies for Chan<T, Policies...>.
+//
+// each policy belongs to one of five independent categories; a Chan takes at most one
+// policy per category, in any order, and uses the default for the others:
+//
+//     storage         Bounded (default)   capacity given to the constructor, 0 for unbuffered.
+//                     Fixed<N>            capacity N inside the channel, known at compile time.
+//                     Unbounded           never full: sends never block (Go has no equivalent).
+//                     Spill               never full, but only the constructor's capacity is kept in
+//                                         memory; the rest goes to segment files (spill_buffer.h).
+//     sync            Mutex (default)     any number of senders and receivers.
+//                     Spinlock            like Mutex, but spins on a test-and-test-and-set lock;
+//                                         for short critical sections on dedicated cores.
+//                     Spsc                one sender thread and one receiver thread, lock-free.
+//     wait            Block (default)     a blocked thread sleeps in the kernel (atomic wait).
+//                     Spin                a blocked thread busy-waits and never sleeps.
+//                     SpinThenBlock<N>    spins N times, then sleeps.
+//     instrument      Hooks (default)     chan_trace and chan_watchdog hooks; these are no-ops
+//                                         unless CHAN_TRACE / CHAN_WATCHDOG are defined.
+//                     NoHooks             nothing, even in traced builds.
+//                     Stats               per-channel operation counters, read by Chan::stats().
+//     allocator       Allocator<A>        A<U> allocates the shared channel state and the
+//                                         buffer slots. default Allocator<std::allocator>.
+//
+// ex. a single-producer single-consumer channel of 1024 slots that spins instead of sleeping:
+//     Chan<int, chan_policy::Fixed<1024>, chan_policy::Spsc, chan_policy::Spin> c;
+//
+// Chan<T> is Chan<T, Bounded, Mutex, Block, Hooks, Allocator<std::allocator>>,
+// and both spell the same type.
+
+#include "buffer.h"
+#include "spill_buffer.h"
+#include "trace.h"
+#include "watchdog.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <type_traits>
+
+namespace chan_policy {
+
+struct storage_category {};
+struct sync_category {};
+struct wait_category {};
+struct instrument_category {};
+struct allocator_category {};
+
+////////////////////////////////////////////////////////////////////////////////
+// spinning
+
+// one step of a busy-wait. yields the cpu now and then, so a spinning thread can't starve
+// the thread it waits for when both share a cpu.
+class Backoff {
+private:
+    unsigned spins{0};
+public:
+    void pause() {
+        if (++spins % 1024 == 0) {
+            std::this_thread::yield();
+            return;
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// storage
+
+struct Bounded {
+    using category = storage_category;
+    static constexpr bool runtime_capacity = true;
+    static constexpr bool bounded = true;
+    // a send may allocate (the channel's status API is then not noexcept).
+    static constexpr bool allocates = false;
+    template<typename T, typename Alloc> using buffer = Buffer<T, Alloc>;
+    template<typename T, typename Alloc> using slots = HeapSlots<T, Alloc>;
+};
+
+template<size_t N>
+struct Fixed {
+    static_assert(N > 0, "chan_policy::Fixed<N>: N must be positive; use Bounded with capacity 0 for an unbuffered channel");
+    using category = storage_category;
+    static constexpr bool runtime_capacity = false;
+    static constexpr bool bounded = true;
+    static constexpr bool allocates = false;
+    static constexpr size_t capacity = N;
+    template<typename T, typename Alloc> using buffer = FixedBuffer<T, N>;
+    template<typename T, typename Alloc> using slots = InlineSlots<T, N>;
+};
+
+struct Unbounded {
+    using category = storage_category;
+    // the constructor argument is the initial number of slots.
+    static constexpr bool runtime_capacity = true;
+    static constexpr bool bounded = false;
+    // a send grows the buffer when it is full.
+    static constexpr bool allocates = true;
+    template<typename T, typename Alloc> using buffer = GrowableBuffer<T, Alloc>;
+};
+
+struct Spill {
+    using category = storage_category;
+    // the constructor argument is the capacity of the ring in memory; a SpillOptions may follow it.
+    static constexpr bool runtime_capacity = true;
+    static constexpr bool bounded = false;
+    // a send may make a segment, or keep the element in memory when it can't.
+    static constexpr bool allocates = true;
+    template<typename T, typename Alloc> using buffer = SpillBuffer<T, Alloc>;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// sync
+
+class SpinlockMutex {
+private:
+    std::atomic<bool> locked{false};
+public:
+    void lock() {
+        Backoff backoff;
+        while (locked.exchange(true, std::memory_order_acquire)) {
+            while (locked.load(std::memory_order_relaxed)) backoff.pause();
+        }
+    }
+    bool try_lock() {
+        return !locked.load(std::memory_order_relaxed) && !locked.exchange(true, std::memory_order_acquire);
+    }
+    void unlock() {
+        locked.store(false, std::memory_order_release);
+    }
+};
+
+struct Mutex {
+    using category = sync_category;
+    static constexpr bool spsc = false;
+    using lock_type = std::mutex;
+};
+
+struct Spinlock {
+    using category = sync_category;
+    static constexpr bool spsc = false;
+    using lock_type = SpinlockMutex;
+};
+
+struct Spsc {
+    using category = sync_category;
+    static constexpr bool spsc = true;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// wait
+//
+// wait(a, old) returns once a no longer holds old (or spuriously; callers re-check).
+// notifies is false when waiters never sleep, so wakers can skip notify_one().
+
+struct Block {
+    using category = wait_category;
+    static constexpr bool notifies = true;
+    template<typename A, typename V>
+    static void wait(const A& a, V old) {
+        a.wait(old, std::memory_order_acquire);
+    }
+};
+
+struct Spin {
+    using category = wait_category;
+    static constexpr bool notifies = false;
+    template<typename A, typename V>
+    static void wait(const A& a, V old) {
+        Backoff backoff;
+        while (a.load(std::memory_order_acquire) == old) backoff.pause();
+    }
+};
+
+template<unsigned N>
+struct SpinThenBlock {
+    using category = wait_category;
+    static constexpr bool notifies = true;
+    template<typename A, typename V>
+    static void wait(const A& a, V old) {
+        Backoff backoff;
+        for (unsigned i = 0; i < N; ++i) {
+            if (a.load(std::memory_order_acquire) != old) return;
+            backoff.pause();
+        }
+        a.wait(old, std::memory_order_acquire);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// instrument
+//
+// a channel keeps one instrument object and calls:
+//     scope(chan, kind, is_blocking)  at the start of each send/recv/close; the returned object
+//                                     gets failed(), parking() and woken() like chan_trace::OpScope.
+//     parked(chan, op)                around the time a thread is parked.
+//     new_flow_id(), handoff(chan, id) when a thread parks and when it is released.
+// and says whether any of these may allocate (static constexpr bool allocates).
+
+struct Hooks {
+    using category = instrument_category;
+    static constexpr bool allocates = chan_trace::hooks_allocate || chan_watchdog::hooks_allocate;
+    chan_trace::OpScope scope(const void* chan, chan_trace::Kind kind, bool is_blocking = true) {
+        return chan_trace::OpScope(chan, kind, is_blocking);
+    }
+    chan_watchdog::Parked parked(const void* chan, chan_watchdog::Op op) {
+        return chan_watchdog::Parked(chan, op);
+    }
+    uint64_t new_flow_id() {return chan_trace::new_flow_id();}
+    void handoff(const void* chan, uint64_t flow_id) {chan_trace::handoff(chan, flow_id);}
+};
+
+struct NoHooks {
+    using category = instrument_category;
+    static constexpr bool allocates = false;
+    struct Scope {
+        void failed() {}
+        uint64_t parking() {return 0;}
+        void woken(uint64_t, uint64_t) {}
+    };
+    struct Parked {};
+    Scope scope(const void*, chan_trace::Kind, bool = true) {return {};}
+    Parked parked(const void*, chan_watchdog::Op) {return {};}
+    uint64_t new_flow_id() {return 0;}
+    void handoff(const void*, uint64_t) {}
+};
+
+// counts as of some moment; counters are updated independently, so they may be a few ops apart.
+struct ChanStats {
+    uint64_t sends{0};              // completed sends.
+    uint64_t recvs{0};              // completed receives of a value.
+    uint64_t blocked_sends{0};      // sends that parked before completing.
+    uint64_t blocked_recvs{0};      // receives that parked.
+    uint64_t failed_sends{0};       // nonblocking sends that found no room.
+    uint64_t failed_recvs{0};       // nonblocking receives that found nothing, and receives on a closed, drained channel.
+};
+
+class Stats {
+private:
+    std::atomic<uint64_t> counts[6] = {};
+public:
+    using category = instrument_category;
+    static constexpr bool allocates = false;
+
+    // counts one operation when it ends, from what happened to it.
+    class Scope {
+    private:
+        std::atomic<uint64_t>* counts;
+        chan_trace::Kind kind;
+        bool is_failed{false};
+        bool is_blocked{false};
+    public:
+        Scope(std::atomic<uint64_t>* c, chan_trace::Kind k) : counts(c), kind(k) {}
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        void failed() {is_failed = true;}
+        uint64_t parking() {
+            is_blocked = true;
+            return 0;
+        }
+        void woken(uint64_t, uint64_t) {}
+        ~Scope() {
+            if (kind == chan_trace::Kind::close) return;
+            size_t base = kind == chan_trace::Kind::send ? 0 : 1;
+            counts[is_failed ? 4 + base : base].fetch_add(1, std::memory_order_relaxed);
+            if (is_blocked) counts[2 + base].fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+    struct Parked {};
+
+    Scope scope(const void*, chan_trace::Kind kind, bool = true) {return Scope(counts, kind);}
+    Parked parked(const void*, chan_watchdog::Op) {return {};}
+    uint64_t new_flow_id() {return 0;}
+    void handoff(const void*, uint64_t) {}
+
+    ChanStats stats() const {
+        auto get = [this](size_t i) {return counts[i].load(std::memory_order_relaxed);};
+        return ChanStats{get(0), get(1), get(2), get(3), get(4), get(5)};
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// allocator
+
+// A is an allocator template such as std::allocator; it is default-constructed wherever needed,
+// so it must be stateless (or find its state globally).
+template<template<typename> class A>
+struct Allocator {
+    using category = allocator_category;
+    template<typename U> using type = A<U>;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// resolution of Policies... into one Config
+
+template<typename P, typename = void>
+struct category_of {
+    using type = void;
+};
+
+template<typename P>
+struct category_of<P, std::void_t<typename P::category>> {
+    using type = typename P::category;
+};
+
+template<typename P>
+constexpr bool is_policy =
+    std::is_same_v<typename category_of<P>::type, storage_category>
+    || std::is_same_v<typename category_of<P>::type, sync_category>
+    || std::is_same_v<typename category_of<P>::type, wait_category>
+    || std::is_same_v<typename category_of<P>::type, instrument_category>
+    || std::is_same_v<typename category_of<P>::type, allocator_category>;
+
+template<typename Category, typename... Policies>
+constexpr size_t count_of = (0 + ... + (std::is_same_v<typename category_of<Policies>::type, Category> ? 1 : 0));
+
+// the policy of Category in Policies, or Default.
+template<typename Category, typename Default, typename... Policies>
+struct select;
+
+template<typename Category, typename Default>
+struct select<Category, Default> {
+    using type = Default;
+};
+
+template<typename Category, typename Default, typename P, typename... Rest>
+struct select<Category, Default, P, Rest...> {
+    using type = std::conditional_t<std::is_same_v<typename category_of<P>::type, Category>,
+        P, typename select<Category, Default, Rest...>::type>;
+};
+
+template<typename Storage, typename Sync, typename Wait, typename Instrument, typename Alloc>
+struct Config {
+    using storage = Storage;
+    using sync = Sync;
+    using wait = Wait;
+    using instrument = Instrument;
+    using allocator = Alloc;
+
+    template<typename U> using allocator_type = typename Alloc::template type<U>;
+    template<typename T> using buffer_type = typename Storage::template buffer<T, allocator_type<T>>;
+
+    static_assert(!(Sync::spsc && !Storage::bounded),
+        "chan_policy::Spsc needs a bounded ring; use Bounded (with a positive capacity) or Fixed<N>");
+};
+
+template<typename... Policies>
+struct make_config {
+    static_assert((is_policy<Policies> && ...),
+        "Chan<T, Policies...>: every argument after T must be a policy from chan_policy");
+    static_assert(count_of<storage_category, Policies...> <= 1, "Chan: more than one storage policy");
+    static_assert(count_of<sync_category, Policies...> <= 1, "Chan: more than one sync policy");
+    static_assert(count_of<wait_category, Policies...> <= 1, "Chan: more than one wait policy");
+    static_assert(count_of<instrument_category, Policies...> <= 1, "Chan: more than one instrument policy");
+    static_assert(count_of<allocator_category, Policies...> <= 1, "Chan: more than one allocator policy");
+
+    using type = Config<
+        typename select<storage_category, Bounded, Policies...>::type,
+        typename select<sync_category, Mutex, Policies...>::type,
+        typename select<wait_category, Block, Policies...>::type,
+        typename select<instrument_category, Hooks, Policies...>::type,
+        typename select<allocator_category, Allocator<std::allocator>, Policies...>::type>;
+};
+
+} // namespace chan_policy
+
+#endif
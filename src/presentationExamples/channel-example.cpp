@@ -1,5 +1,6 @@
 #include "../chan.h"
 #include <iostream>
+#include <thread>
 
 using namespace std;
 
@@ -1,5 +1,8 @@
+#include <cassert>
 #include <numeric>
 #include <iostream>
+#include <thread>
+#include <vector>
 #include "chan.h"
 
 void send_task(Chan<int> chan, const std::vector<int>& each_sender_data) {
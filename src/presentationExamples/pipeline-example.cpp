@@ -0,0 +1,41 @@
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+#include <mutex>
+#include <numeric>
+#include <vector>
+#include "pipeline.h"
+
+// complex-example.cpp as a pipeline: the stages close in turn once the data is sent,
+// so there is no sleep before closing the channel.
+void parallel_send_and_recv(
+    unsigned chan_size = 0,
+    unsigned n_workers = 3,
+    unsigned n_recvers = 3,
+    unsigned send_upto = 1000) {
+
+    // fill all_sender_data with [1,send_upto].
+    std::vector<int> all_sender_data(send_upto);
+    std::iota(all_sender_data.begin(), all_sender_data.end(), 1);
+
+    std::mutex lock;
+    std::vector<int> all_recver_data;
+
+    Pipeline p;
+    p.from(all_sender_data, {1, chan_size})
+        .map([](int num) {return num * num;}, {n_workers, chan_size})
+        .sink([&](int num) {
+            std::scoped_lock lck{lock};
+            all_recver_data.push_back(num);
+        }, {n_recvers});
+    p.wait();
+
+    std::cout << "received " << all_recver_data.size() << " ints" << std::endl;
+    std::sort(all_recver_data.begin(), all_recver_data.end());
+    for (auto& num : all_sender_data) num *= num;
+    assert(all_recver_data == all_sender_data);
+}
+
+int main() {
+    parallel_send_and_recv();
+}
@@ -0,0 +1,91 @@
+#ifndef READINESS_H
+#define READINESS_H
+
+// readiness of a channel for event loops.
+//
+// a channel with an observer calls update(recv_ready, send_ready) under its lock whenever either
+// may have changed, with:
+//     recv_ready      a recv would not block: elements are buffered, a sender is parked, or it is closed.
+//     send_ready      a send would not block: there is room, a receiver is parked, or it is closed
+//                     (then the send fails at once).
+//
+// on Linux, EventFdReadiness turns these into two eventfds for epoll, poll or io_uring (register both for
+// reading). a fd is signaled only on a rising edge (ex. the buffer goes from empty to non-empty),
+// so a busy channel makes no syscalls. the fds are edge-like: the event loop clears a fd with
+// clear_ready_fd() and then drains the channel with try_recv (or fills it with try_send) until
+// would_block, as with EPOLLET.
+//
+//     int fd = chan.recv_fd();   // epoll_ctl(ep, EPOLL_CTL_ADD, fd, {EPOLLIN})
+//     ... on EPOLLIN:
+//     clear_ready_fd(fd);
+//     while (chan.try_recv(v) == ChanStatus::ok) handle(v);
+
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+class ReadinessObserver {
+public:
+    // called under the channel's lock: must be quick, and must not use the channel.
+    virtual void update(bool recv_ready, bool send_ready) noexcept = 0;
+protected:
+    ~ReadinessObserver() = default;
+};
+
+#ifdef __linux__
+// resets an eventfd, so it is not readable until it is signaled again.
+inline void clear_ready_fd(int fd) {
+    uint64_t count;
+    [[maybe_unused]] ssize_t r = read(fd, &count, sizeof(count));
+}
+
+class EventFdReadiness final : public ReadinessObserver {
+private:
+    int recv_efd;
+    int send_efd;
+    bool recv_ready{false};
+    bool send_ready{false};
+
+    static int make() {
+        int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) throw std::system_error(errno, std::generic_category(), "eventfd");
+        return fd;
+    }
+    static void signal(int fd) {
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t r = write(fd, &one, sizeof(one));
+    }
+public:
+    EventFdReadiness() : recv_efd(make()) {
+        try {
+            send_efd = make();
+        } catch (...) {
+            close(recv_efd);
+            throw;
+        }
+    }
+    EventFdReadiness(const EventFdReadiness&) = delete;
+    EventFdReadiness& operator=(const EventFdReadiness&) = delete;
+    ~EventFdReadiness() {
+        close(recv_efd);
+        close(send_efd);
+    }
+
+    void update(bool r, bool s) noexcept override {
+        if (r && !recv_ready) signal(recv_efd);
+        if (s && !send_ready) signal(send_efd);
+        recv_ready = r;
+        send_ready = s;
+    }
+
+    int recv_fd() const {return recv_efd;}
+    int send_fd() const {return send_efd;}
+};
+#endif // __linux__
+
+#endif
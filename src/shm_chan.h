@@ -0,0 +1,506 @@
+#ifndef SHM_CHAN_H
+#define SHM_CHAN_H
+
+// ShmChan<T>: a channel between processes, for trivially copyable T.
+//
+// the whole channel (ring, head and tail, closed flag, waiter counts, and the futex words
+// processes park on) lives in one shared memory object, either named (shm_open) or anonymous
+// (memfd_create, handed to the peer by fork or over a unix socket). parking uses FUTEX_WAIT and
+// FUTEX_WAKE without FUTEX_PRIVATE_FLAG, so it works across address spaces.
+//
+//     // process A                                // process B
+//     auto c = ShmChan<Msg>::create("/jobs", 256);  auto c = ShmChan<Msg>::open("/jobs");
+//     c.send(msg);                                 Msg m; while (c.recv(m)) {...}
+//     c.close();                                   // then one of them calls ShmChan<Msg>::unlink("/jobs")
+//
+// the operations, their blocking and close() semantics, and the status API are those of Chan<T>
+// (from ChanOps), with two differences:
+//     the capacity must be positive: there is no rendezvous between processes.
+//     recv_with() runs f under the channel lock, which here is shared with the other processes.
+//
+// a crashed peer closes the channel, like the end of a pipe whose writer died: a process that
+// attached and then exited without its ShmChan being destroyed (killed, crashed, or _exit) is
+// noticed by any process blocked on the channel within liveness_interval. the channel is then
+// closed and peer_crashed() returns true: blocked senders get closed_while_blocked, receivers
+// drain what was sent and then get closed. if the peer died holding the channel lock, the lock
+// is taken over; every critical section publishes its work with a single store of head or tail
+// at its end, so the ring is consistent whatever point it died at (an element it was receiving
+// is received again by someone else). processes are told apart by pid and start time, so all
+// of them must share a pid namespace and see the same /proc.
+// a process that exits normally without close() does not close the channel, as with Chan<T>.
+
+#include "chan.h"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace shm_chan {
+
+// how long a blocked process sleeps before it checks whether its peers are still alive.
+inline constexpr std::chrono::milliseconds liveness_interval{100};
+
+// the largest number of ShmChan handles (in any processes) attached to one channel at a time.
+inline constexpr size_t max_peers = 64;
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+    "ShmChan needs address-free atomics");
+
+// returns false if the wait timed out.
+inline bool futex_wait(std::atomic<uint32_t>* word, uint32_t expected) {
+    timespec timeout{0, std::chrono::nanoseconds(liveness_interval).count()};
+    long r = syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+    return r == 0 || errno != ETIMEDOUT;
+}
+
+inline void futex_wake(std::atomic<uint32_t>* word, int n) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, n, nullptr, nullptr, 0);
+}
+
+// process_start_time() when /proc can't tell (ex. mounted with hidepid=2): pid may be alive.
+inline constexpr uint64_t unknown_start_time = UINT64_MAX;
+
+// the start time of pid, in clock ticks since boot (field 22 of /proc/pid/stat), 0 if pid has
+// exited (no such entry, or a zombie that was not reaped yet), or unknown_start_time.
+inline uint64_t process_start_time(uint32_t pid) {
+    char path[32];
+    std::snprintf(path, sizeof(path), "/proc/%u/stat", pid);
+    FILE* f = std::fopen(path, "r");
+    if (!f) return errno == ENOENT ? 0 : unknown_start_time;
+    char buf[1024];
+    size_t n = std::fread(buf, 1, sizeof(buf) - 1, f);
+    std::fclose(f);
+    buf[n] = '\0';
+    // the command name (field 2) is in parentheses and may contain anything, so parse after the last ')'.
+    const char* p = std::strrchr(buf, ')');
+    if (!p) return unknown_start_time;
+    char state;
+    unsigned long long start;
+    if (std::sscanf(p + 1, " %c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu",
+            &state, &start) != 2) {
+        return unknown_start_time;
+    }
+    return state == 'Z' || state == 'X' ? 0 : start;
+}
+
+// an attached handle. pid is claimed first; start_time is 0 until the claim is complete.
+struct Peer {
+    std::atomic<uint32_t> pid{0};
+    std::atomic<uint64_t> start_time{0};
+};
+
+// the shared part of a channel, followed in the mapping by the slots.
+struct Header {
+    static constexpr uint64_t magic_value = 0x31636e6168636d73; // "smchanc1"
+    static constexpr uint32_t contended_bit = uint32_t(1) << 31;
+
+    // set last by the creator, so a process that opens the object early waits for it.
+    std::atomic<uint64_t> magic{0};
+    uint64_t elem_size{0};
+    uint64_t capacity{0};
+
+    // 0, or the pid of the holder, with contended_bit if anyone may be waiting for it.
+    alignas(64) std::atomic<uint32_t> lock{0};
+    std::atomic<uint32_t> closed{0};
+    std::atomic<uint32_t> peer_crashed{0};
+    // processes parked on not_full and not_empty; changed under lock.
+    uint32_t send_waiters{0};
+    uint32_t recv_waiters{0};
+    // head and tail only grow, and are written under lock; tail - head elements are buffered.
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+
+    // futex words, bumped whenever there may be something new to see.
+    alignas(64) std::atomic<uint32_t> not_empty{0};
+    alignas(64) std::atomic<uint32_t> not_full{0};
+
+    alignas(64) Peer peers[max_peers];
+};
+
+template<typename T>
+constexpr size_t slots_offset = (sizeof(Header) + alignof(T) - 1) / alignof(T) * alignof(T);
+
+[[noreturn]] inline void throw_errno(const char* what) {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+} // namespace shm_chan
+
+template<typename T>
+class ShmChan : public ChanOps<ShmChan<T>, T> {
+private:
+    static_assert(std::is_trivially_copyable_v<T>, "ShmChan: T must be trivially copyable; it is copied between address spaces");
+    static_assert(alignof(T) <= 64, "ShmChan: T must not be over-aligned");
+
+    friend class ChanOps<ShmChan<T>, T>;
+    using Header = shm_chan::Header;
+
+    int shm_fd{-1};
+    size_t map_size{0};
+    Header* h{nullptr};
+    unsigned char* slots{nullptr};
+    uint32_t self_pid{0};
+    size_t peer_index{0};
+
+    ShmChan(int fd, bool create, size_t capacity);
+
+    T* slot(uint64_t i) {return std::launder(reinterpret_cast<T*>(slots + (i % h->capacity) * sizeof(T)));}
+
+    void lock() noexcept;
+    void unlock() noexcept;
+    // marks the channel closed by a crash; called under lock.
+    void close_by_crash() noexcept;
+    void wake_all() noexcept;
+
+    // waits, under lock, until the ring has an element; returns ok with the lock held.
+    ChanStatus lock_not_empty(bool is_blocking) noexcept;
+
+    template<typename U>
+    ChanStatus chan_send(U&& src, bool is_blocking) noexcept;
+    ChanStatus chan_recv(RecvDst<T> dst, bool is_blocking) noexcept;
+    ChanStatus chan_close() noexcept;
+    template<typename F>
+    ChanStatus chan_recv_with(F& f, bool is_blocking);
+
+public:
+    // creates a named channel of capacity elements; fails if name exists.
+    static ShmChan create(const std::string& name, size_t capacity) {
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) shm_chan::throw_errno("ShmChan: shm_open");
+        return ShmChan(fd, true, capacity);
+    }
+    // attaches to a channel made by create().
+    static ShmChan open(const std::string& name) {
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) shm_chan::throw_errno("ShmChan: shm_open");
+        return ShmChan(fd, false, 0);
+    }
+    // removes the name; attached processes keep the channel until they detach.
+    static void unlink(const std::string& name) {
+        shm_unlink(name.c_str());
+    }
+
+    // creates an anonymous channel. pass fd() to a peer, which attaches with from_fd().
+    static ShmChan create_anonymous(size_t capacity) {
+        int fd = memfd_create("ShmChan", MFD_CLOEXEC);
+        if (fd < 0) shm_chan::throw_errno("ShmChan: memfd_create");
+        return ShmChan(fd, true, capacity);
+    }
+    // attaches to the channel behind fd (from fd() of another handle, ex. inherited by fork).
+    // fd itself is not taken over.
+    static ShmChan from_fd(int fd) {
+        int own = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (own < 0) shm_chan::throw_errno("ShmChan: dup");
+        return ShmChan(own, false, 0);
+    }
+
+    // a handle is one attachment of one process; threads of the process share it by reference.
+    ShmChan(const ShmChan&) = delete;
+    ShmChan& operator=(const ShmChan&) = delete;
+    ~ShmChan();
+
+    int fd() const {return shm_fd;}
+    size_t capacity() const {return h->capacity;}
+    size_t size() const {return h->tail.load(std::memory_order_acquire) - h->head.load(std::memory_order_acquire);}
+
+    // true if the channel was closed because an attached process died.
+    bool peer_crashed() const {return h->peer_crashed.load(std::memory_order_acquire) != 0;}
+    // looks for attached processes that died, and closes the channel if there are any.
+    // blocked operations call this every liveness_interval; an event loop that only uses the
+    // nonblocking operations can call it on its own timer. returns peer_crashed().
+    bool check_peers() noexcept;
+
+    // send, recv, their nonblocking and status variants, recv_with, foreach and close come from ChanOps.
+};
+
+template<typename T>
+ShmChan<T>::ShmChan(int fd, bool create, size_t capacity) : shm_fd(fd), self_pid(static_cast<uint32_t>(getpid())) {
+    try {
+        if (create) {
+            if (capacity == 0) {
+                throw std::invalid_argument("ShmChan needs a positive capacity");
+            }
+            map_size = shm_chan::slots_offset<T> + capacity * sizeof(T);
+            if (ftruncate(fd, static_cast<off_t>(map_size)) != 0) shm_chan::throw_errno("ShmChan: ftruncate");
+        } else {
+            struct stat st;
+            if (fstat(fd, &st) != 0) shm_chan::throw_errno("ShmChan: fstat");
+            map_size = static_cast<size_t>(st.st_size);
+            if (map_size < sizeof(Header)) throw std::runtime_error("ShmChan: not a channel");
+        }
+
+        void* p = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) shm_chan::throw_errno("ShmChan: mmap");
+        slots = static_cast<unsigned char*>(p) + shm_chan::slots_offset<T>;
+
+        if (create) {
+            h = new (p) Header();
+            h->elem_size = sizeof(T);
+            h->capacity = capacity;
+            h->magic.store(Header::magic_value, std::memory_order_release);
+        } else {
+            h = std::launder(static_cast<Header*>(p));
+            // the creator may still be initializing the header.
+            for (int i = 0; h->magic.load(std::memory_order_acquire) != Header::magic_value; ++i) {
+                if (i == 1000) throw std::runtime_error("ShmChan: not a channel");
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (h->elem_size != sizeof(T) || map_size < shm_chan::slots_offset<T> + h->capacity * sizeof(T)) {
+                throw std::runtime_error("ShmChan: element type does not match the channel");
+            }
+        }
+
+        uint64_t start_time = shm_chan::process_start_time(self_pid);
+        for (peer_index = 0; peer_index < shm_chan::max_peers; ++peer_index) {
+            uint32_t expected = 0;
+            if (h->peers[peer_index].pid.compare_exchange_strong(expected, self_pid)) break;
+        }
+        if (peer_index == shm_chan::max_peers) {
+            throw std::runtime_error("ShmChan: too many attached processes");
+        }
+        h->peers[peer_index].start_time.store(start_time, std::memory_order_release);
+    } catch (...) {
+        if (slots) munmap(slots - shm_chan::slots_offset<T>, map_size);
+        ::close(shm_fd);
+        throw;
+    }
+}
+
+template<typename T>
+ShmChan<T>::~ShmChan() {
+    shm_chan::Peer& peer = h->peers[peer_index];
+    peer.start_time.store(0, std::memory_order_relaxed);
+    peer.pid.store(0, std::memory_order_release);
+    munmap(h, map_size);
+    ::close(shm_fd);
+}
+
+template<typename T>
+void ShmChan<T>::lock() noexcept {
+    uint32_t v = 0;
+    if (h->lock.compare_exchange_strong(v, self_pid, std::memory_order_acquire, std::memory_order_relaxed)) return;
+    for (;;) {
+        if (v == 0) {
+            // having waited, take it as contended: others may still be parked on it.
+            if (h->lock.compare_exchange_weak(v, self_pid | Header::contended_bit,
+                    std::memory_order_acquire, std::memory_order_relaxed)) return;
+            continue;
+        }
+        if (!(v & Header::contended_bit)
+            && !h->lock.compare_exchange_weak(v, v | Header::contended_bit, std::memory_order_relaxed)) {
+            continue;
+        }
+        v |= Header::contended_bit;
+        if (!shm_chan::futex_wait(&h->lock, v) && shm_chan::process_start_time(v & ~Header::contended_bit) == 0) {
+            // the holder died inside a critical section (not merely hidden from our /proc);
+            // see the top of this file for why taking over is safe.
+            if (h->lock.compare_exchange_strong(v, self_pid | Header::contended_bit,
+                    std::memory_order_acquire, std::memory_order_relaxed)) {
+                close_by_crash();
+                return;
+            }
+        }
+        v = h->lock.load(std::memory_order_relaxed);
+    }
+}
+
+template<typename T>
+void ShmChan<T>::unlock() noexcept {
+    if (h->lock.exchange(0, std::memory_order_release) & Header::contended_bit) {
+        shm_chan::futex_wake(&h->lock, 1);
+    }
+}
+
+template<typename T>
+void ShmChan<T>::wake_all() noexcept {
+    h->not_empty.fetch_add(1, std::memory_order_release);
+    shm_chan::futex_wake(&h->not_empty, INT_MAX);
+    h->not_full.fetch_add(1, std::memory_order_release);
+    shm_chan::futex_wake(&h->not_full, INT_MAX);
+}
+
+template<typename T>
+void ShmChan<T>::close_by_crash() noexcept {
+    h->peer_crashed.store(1, std::memory_order_release);
+    if (!h->closed.exchange(1, std::memory_order_release)) wake_all();
+}
+
+template<typename T>
+bool ShmChan<T>::check_peers() noexcept {
+    bool crashed = false;
+    for (shm_chan::Peer& peer : h->peers) {
+        uint32_t pid = peer.pid.load(std::memory_order_acquire);
+        uint64_t start_time = peer.start_time.load(std::memory_order_acquire);
+        // skip free entries, and entries still being claimed.
+        if (pid == 0 || start_time == 0) continue;
+        uint64_t now = shm_chan::process_start_time(pid);
+        // alive, or maybe alive: only a missing entry, a zombie, or a reused pid is a death.
+        if (now == start_time || now == shm_chan::unknown_start_time) continue;
+        // it died attached. free the entry, unless it was freed and reclaimed meanwhile.
+        if (peer.start_time.compare_exchange_strong(start_time, 0)) {
+            peer.pid.store(0, std::memory_order_release);
+            crashed = true;
+        }
+    }
+    if (crashed) {
+        lock();
+        close_by_crash();
+        unlock();
+    }
+    return peer_crashed();
+}
+
+template<typename T>
+template<typename U>
+ChanStatus ShmChan<T>::chan_send(U&& src, bool is_blocking) noexcept {
+    // Fast path: check for failed non-blocking operation without acquiring the lock.
+    if (!is_blocking
+        && !h->closed.load(std::memory_order_acquire)
+        && h->tail.load(std::memory_order_acquire) - h->head.load(std::memory_order_acquire) == h->capacity) {
+        return ChanStatus::would_block;
+    }
+
+    lock();
+
+    // sending to a closed channel is an error.
+    if (h->closed.load(std::memory_order_relaxed)) {
+        unlock();
+        return ChanStatus::closed;
+    }
+
+    uint64_t t = h->tail.load(std::memory_order_relaxed);
+    while (t - h->head.load(std::memory_order_relaxed) == h->capacity) {
+        if (!is_blocking) {
+            unlock();
+            return ChanStatus::would_block;
+        }
+        h->send_waiters++;
+        uint32_t seq = h->not_full.load(std::memory_order_relaxed);
+        unlock();
+        if (!shm_chan::futex_wait(&h->not_full, seq)) check_peers();
+        lock();
+        h->send_waiters--;
+        // By Go semantics, a close() while we wait is an error.
+        if (h->closed.load(std::memory_order_relaxed)) {
+            unlock();
+            return ChanStatus::closed_while_blocked;
+        }
+    }
+
+    std::memcpy(static_cast<void*>(slot(t)), static_cast<const void*>(&src), sizeof(T));
+    h->tail.store(t + 1, std::memory_order_release);
+    bool wake = h->recv_waiters > 0;
+    unlock();
+
+    if (wake) {
+        h->not_empty.fetch_add(1, std::memory_order_release);
+        shm_chan::futex_wake(&h->not_empty, 1);
+    }
+    return ChanStatus::ok;
+}
+
+template<typename T>
+ChanStatus ShmChan<T>::lock_not_empty(bool is_blocking) noexcept {
+    // Fast path, as in ChanData::chan_recv: the order of the two loads matters when racing with a close.
+    if (!is_blocking
+        && h->tail.load(std::memory_order_acquire) == h->head.load(std::memory_order_acquire)
+        && !h->closed.load(std::memory_order_acquire)) {
+        return ChanStatus::would_block;
+    }
+
+    lock();
+    while (h->tail.load(std::memory_order_relaxed) == h->head.load(std::memory_order_relaxed)) {
+        if (h->closed.load(std::memory_order_relaxed)) {
+            unlock();
+            return ChanStatus::closed;
+        }
+        if (!is_blocking) {
+            unlock();
+            return ChanStatus::would_block;
+        }
+        h->recv_waiters++;
+        uint32_t seq = h->not_empty.load(std::memory_order_relaxed);
+        unlock();
+        if (!shm_chan::futex_wait(&h->not_empty, seq)) check_peers();
+        lock();
+        h->recv_waiters--;
+    }
+    return ChanStatus::ok;
+}
+
+template<typename T>
+ChanStatus ShmChan<T>::chan_recv(RecvDst<T> dst, bool is_blocking) noexcept {
+    ChanStatus s = lock_not_empty(is_blocking);
+    if (s != ChanStatus::ok) return s;
+
+    uint64_t hd = h->head.load(std::memory_order_relaxed);
+    dst.put(*slot(hd));
+    h->head.store(hd + 1, std::memory_order_release);
+    bool wake = h->send_waiters > 0;
+    unlock();
+
+    if (wake) {
+        h->not_full.fetch_add(1, std::memory_order_release);
+        shm_chan::futex_wake(&h->not_full, 1);
+    }
+    return ChanStatus::ok;
+}
+
+template<typename T>
+template<typename F>
+ChanStatus ShmChan<T>::chan_recv_with(F& f, bool is_blocking) {
+    ChanStatus s = lock_not_empty(is_blocking);
+    if (s != ChanStatus::ok) return s;
+
+    uint64_t hd = h->head.load(std::memory_order_relaxed);
+    auto pop = [&]() {
+        h->head.store(hd + 1, std::memory_order_release);
+        bool wake = h->send_waiters > 0;
+        unlock();
+        if (wake) {
+            h->not_full.fetch_add(1, std::memory_order_release);
+            shm_chan::futex_wake(&h->not_full, 1);
+        }
+    };
+    try {
+        f(*slot(hd));
+    } catch (...) {
+        pop();
+        throw;
+    }
+    pop();
+    return ChanStatus::ok;
+}
+
+template<typename T>
+ChanStatus ShmChan<T>::chan_close() noexcept {
+    lock();
+    if (h->closed.load(std::memory_order_relaxed)) {
+        unlock();
+        return ChanStatus::closed;
+    }
+    h->closed.store(1, std::memory_order_release);
+    unlock();
+    // release all receivers and senders.
+    wake_all();
+    return ChanStatus::ok;
+}
+
+#endif
@@ -0,0 +1,283 @@
+#ifndef SPILL_BUFFER_H
+#define SPILL_BUFFER_H
+
+// SpillBuffer: the buffer of a chan_policy::Spill channel. a bounded ring in memory, and
+// behind it append-only segment files, memory-mapped, in a configured directory.
+//
+// elements go to the ring while it has room and nothing is on disk; after that they are appended
+// to the newest segment until the disk backlog is gone, so the order stays FIFO. when the ring
+// runs empty it is refilled from the oldest segment. a segment that has been read out is kept as
+// a spare (up to SpillOptions::spare_segments) and reused, or deleted.
+// like Unbounded, the buffer is never full, so senders never block; memory stays bounded by the
+// ring plus the page cache of the segments, which the kernel can write back and reclaim.
+//
+// if a segment can't be made (ex. the disk is full), elements are kept in memory after the ones
+// on disk instead, and SpillDepth::failures counts it; the channel then behaves like Unbounded
+// until the backlog drains. a push can therefore allocate (that overflow, a new segment, the list
+// of segments) and throw std::bad_alloc, so chan_policy::Spill is declared as allocating and a
+// Spill channel's status API is not noexcept: the exception reaches the sender.
+//
+// elements are written by SpillCodec<T>: trivially copyable types are copied as bytes;
+// specialize SpillCodec for others.
+
+#include "buffer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// how SpillBuffer writes T to a segment, and reads it back:
+//     static size_t size(const T& v);                  bytes needed for v
+//     static void write(const T& v, std::byte* out);   writes those bytes
+//     static T read(const std::byte* in, size_t n);    rebuilds a value from its n bytes
+template<typename T, typename = void>
+struct SpillCodec;
+
+template<typename T, typename = void>
+constexpr bool has_spill_codec = false;
+
+template<typename T>
+constexpr bool has_spill_codec<T, std::void_t<decltype(&SpillCodec<T>::size)>> = true;
+
+template<typename T>
+struct SpillCodec<T, std::enable_if_t<std::is_trivially_copyable_v<T>>> {
+    static size_t size(const T&) {return sizeof(T);}
+    static void write(const T& v, std::byte* out) {std::memcpy(out, &v, sizeof(T));}
+    static T read(const std::byte* in, size_t) {
+        alignas(T) std::byte bytes[sizeof(T)];
+        std::memcpy(bytes, in, sizeof(T));
+        return *std::launder(reinterpret_cast<T*>(bytes));
+    }
+};
+
+struct SpillOptions {
+    // where segment files are made; empty for std::filesystem::temp_directory_path().
+    std::string directory;
+    size_t segment_size{64 << 20};
+    // read-out segments kept for reuse instead of being deleted.
+    size_t spare_segments{2};
+};
+
+// depths as of some moment, like ChanStats.
+struct SpillDepth {
+    size_t in_memory{0};    // in the ring, and kept in memory after a failed spill.
+    size_t on_disk{0};
+    size_t segments{0};     // segment files, including spares.
+    size_t failures{0};     // elements that could not be spilled.
+};
+
+// one segment file, mapped whole. records are a 4-byte length and the bytes, 8-byte aligned.
+class SpillSegment {
+private:
+    int fd{-1};
+    std::byte* data{nullptr};
+    size_t size{0};
+    std::string path;
+public:
+    size_t write_off{0};
+    size_t read_off{0};
+
+    // nullptr if the file can't be made.
+    static std::unique_ptr<SpillSegment> create(const std::string& directory, size_t size);
+    SpillSegment() = default;
+    SpillSegment(const SpillSegment&) = delete;
+    SpillSegment& operator=(const SpillSegment&) = delete;
+    ~SpillSegment();
+
+    static size_t record_size(size_t n) {return (sizeof(uint32_t) + n + 7) / 8 * 8;}
+    bool fits(size_t n) const {return write_off + record_size(n) <= size;}
+    bool drained() const {return read_off == write_off;}
+    void reset() {write_off = read_off = 0;}
+
+    // the start of a record of n bytes; the caller writes them.
+    std::byte* append(size_t n);
+    // the next unread record, and its length.
+    const std::byte* next(size_t& n);
+};
+
+inline std::unique_ptr<SpillSegment> SpillSegment::create(const std::string& directory, size_t size) {
+    auto s = std::make_unique<SpillSegment>();
+    s->path = directory + "/chan-spill-XXXXXX";
+    s->fd = mkstemp(s->path.data());
+    if (s->fd < 0) {
+        s->path.clear();
+        return nullptr;
+    }
+    if (ftruncate(s->fd, static_cast<off_t>(size)) != 0) return nullptr;
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+    if (p == MAP_FAILED) return nullptr;
+    s->data = static_cast<std::byte*>(p);
+    s->size = size;
+    return s;
+}
+
+inline SpillSegment::~SpillSegment() {
+    if (data) munmap(data, size);
+    if (fd >= 0) close(fd);
+    if (!path.empty()) unlink(path.c_str());
+}
+
+inline std::byte* SpillSegment::append(size_t n) {
+    uint32_t len = static_cast<uint32_t>(n);
+    std::memcpy(data + write_off, &len, sizeof(len));
+    std::byte* out = data + write_off + sizeof(len);
+    write_off += record_size(n);
+    return out;
+}
+
+inline const std::byte* SpillSegment::next(size_t& n) {
+    uint32_t len;
+    std::memcpy(&len, data + read_off, sizeof(len));
+    n = len;
+    const std::byte* in = data + read_off + sizeof(len);
+    read_off += record_size(n);
+    return in;
+}
+
+template<typename T, typename Alloc = std::allocator<T>>
+class SpillBuffer {
+private:
+    static_assert(has_spill_codec<T>, "chan_policy::Spill: T is not trivially copyable; specialize SpillCodec<T>");
+    using Codec = SpillCodec<T>;
+
+    Ring<T, HeapSlots<T, Alloc>> ring;
+    SpillOptions options;
+    // oldest first; the back one is appended to.
+    std::deque<std::unique_ptr<SpillSegment>> segments;
+    std::vector<std::unique_ptr<SpillSegment>> spares;
+    // elements that came after a failed spill, in order; only used until they drain.
+    std::deque<T> overflow;
+
+    // all elements, read by the lock-free fast paths of the channel like Ring::cur_size.
+    std::atomic<size_t> total{0};
+    std::atomic<size_t> on_disk{0};
+    std::atomic<size_t> n_segments{0};
+    std::atomic<size_t> failures{0};
+
+    bool spill(const T& v);
+    void refill();
+    template<typename U>
+    void push_any(U&& v);
+public:
+    // n is the capacity of the ring, which must be positive.
+    explicit SpillBuffer(size_t n = 0, SpillOptions o = SpillOptions(), const Alloc& a = Alloc());
+    explicit SpillBuffer(size_t n, const Alloc& a) : SpillBuffer(n, SpillOptions(), a) {}
+
+    void push(const T& elem)    {push_any(elem);}
+    void push(T&& elem)         {push_any(std::move(elem));}
+    T& front();
+    void pop();
+
+    size_t current_size()       {return total.load();}
+    // reported as unlimited, like GrowableBuffer.
+    size_t capacity()           {return SIZE_MAX;}
+    bool is_full()              {return false;}
+
+    SpillDepth depth() const;
+};
+
+template<typename T, typename Alloc>
+SpillBuffer<T, Alloc>::SpillBuffer(size_t n, SpillOptions o, const Alloc& a) : ring(n, a), options(std::move(o)) {
+    if (n == 0) {
+        throw std::invalid_argument("chan_policy::Spill needs a positive capacity for its ring");
+    }
+    if (options.directory.empty()) {
+        options.directory = std::filesystem::temp_directory_path().string();
+    }
+}
+
+template<typename T, typename Alloc>
+template<typename U>
+void SpillBuffer<T, Alloc>::push_any(U&& v) {
+    if (on_disk == 0 && overflow.empty() && !ring.is_full()) {
+        ring.push(std::forward<U>(v));
+    } else if (!overflow.empty() || !spill(v)) {
+        overflow.push_back(std::forward<U>(v));
+        failures++;
+    }
+    total++;
+}
+
+template<typename T, typename Alloc>
+bool SpillBuffer<T, Alloc>::spill(const T& v) {
+    size_t n = Codec::size(v);
+    if (SpillSegment::record_size(n) > options.segment_size) return false;
+    if (segments.empty() || !segments.back()->fits(n)) {
+        std::unique_ptr<SpillSegment> s;
+        if (!spares.empty()) {
+            s = std::move(spares.back());
+            spares.pop_back();
+        } else {
+            s = SpillSegment::create(options.directory, options.segment_size);
+            if (!s) return false;
+            n_segments++;
+        }
+        segments.push_back(std::move(s));
+    }
+    Codec::write(v, segments.back()->append(n));
+    on_disk++;
+    return true;
+}
+
+// moves the oldest elements into the empty ring: from disk, or once that is empty, from overflow.
+template<typename T, typename Alloc>
+void SpillBuffer<T, Alloc>::refill() {
+    while (!ring.is_full() && on_disk > 0) {
+        SpillSegment& s = *segments.front();
+        size_t n;
+        const std::byte* in = s.next(n);
+        ring.push(Codec::read(in, n));
+        on_disk--;
+        if (s.drained()) {
+            std::unique_ptr<SpillSegment> done = std::move(segments.front());
+            segments.pop_front();
+            done->reset();
+            if (spares.size() < options.spare_segments) {
+                spares.push_back(std::move(done));
+            } else {
+                n_segments--;
+            }
+        }
+    }
+    while (!ring.is_full() && on_disk == 0 && !overflow.empty()) {
+        ring.push(std::move(overflow.front()));
+        overflow.pop_front();
+    }
+}
+
+template<typename T, typename Alloc>
+T& SpillBuffer<T, Alloc>::front() {
+    if (ring.current_size() == 0) refill();
+    return ring.front();
+}
+
+template<typename T, typename Alloc>
+void SpillBuffer<T, Alloc>::pop() {
+    if (ring.current_size() == 0) refill();
+    ring.pop();
+    total--;
+}
+
+template<typename T, typename Alloc>
+SpillDepth SpillBuffer<T, Alloc>::depth() const {
+    size_t disk = on_disk.load(std::memory_order_relaxed);
+    size_t all = total.load(std::memory_order_relaxed);
+    return SpillDepth{all > disk ? all - disk : 0, disk,
+        n_segments.load(std::memory_order_relaxed), failures.load(std::memory_order_relaxed)};
+}
+
+#endif
@@ -0,0 +1,382 @@
+#ifndef TAP_H
+#define TAP_H
+
+// recording and replay of channel traffic, to benchmark against captured load instead of
+// synthetic random values.
+//
+// a SendTap attached to a channel with set_tap() sees every send that goes through (or parks),
+// under the channel's lock, as it arrives. TrafficRecorder is a tap that writes each send's time,
+// size and optionally its payload to a compact binary file; the tap only appends to a buffer, and
+// a writer thread of the recorder writes full buffers out:
+//
+//     TrafficRecorder<Event> rec("events.tap", true);
+//     chan.set_tap(&rec);
+//     ... run the service ...
+//     chan.set_tap(nullptr);
+//     rec.flush();
+//
+// later, replay() sends the same traffic into a channel under test with the recorded
+// inter-arrival times, or scaled by ReplayOptions::speed:
+//
+//     TrafficReader in("events.tap");
+//     Chan<Event> test(64);
+//     ReplayStats s = replay(in, test, [](const TrafficRecord& r) {return payload_as<Event>(r);});
+//
+// the schedule is fixed when the replay starts (open loop): a send that blocks makes the later
+// ones late, and they go out at once rather than shifting the rest of the schedule.
+// ReplayStats reports how late sends were.
+//
+// file format: a 16-byte header ("CHANTAP" and a NUL, u32 version, u32 flags), then per send an
+// LEB128 varint of the ns since the previous send, a varint of the size, and with
+// flag_payloads the SpillCodec<T> bytes.
+
+#include "spill_buffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+template<typename T>
+class SendTap {
+public:
+    // called under the channel's lock for each send that delivers or parks (a send that then
+    // fails because the channel is closed while it waits is still seen); must be quick, and must
+    // not use the channel.
+    virtual void sent(const T& v) noexcept = 0;
+protected:
+    ~SendTap() = default;
+};
+
+namespace chan_tap {
+
+inline constexpr char magic[8] = {'C', 'H', 'A', 'N', 'T', 'A', 'P', '\0'};
+inline constexpr uint32_t version = 1;
+enum : uint32_t {
+    flag_payloads = 1,
+};
+
+using Clock = std::chrono::steady_clock;
+
+inline void put_varint(std::vector<char>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+// false at the end of the stream, or in the middle of a varint.
+inline bool get_varint(std::istream& in, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = in.get();
+        if (c == std::char_traits<char>::eof()) return false;
+        v |= static_cast<uint64_t>(c & 0x7f) << shift;
+        if (!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+// sleep for most of the wait, then yield-spin, since sleep_until alone overshoots by tens of
+// microseconds. also paces the open-loop senders of ParallelSendRecv.
+inline void wait_until(Clock::time_point deadline) {
+    const auto spin = std::chrono::microseconds(100);
+    auto now = Clock::now();
+    if (deadline - now > spin) {
+        std::this_thread::sleep_until(deadline - spin);
+    }
+    while (Clock::now() < deadline) {
+        std::this_thread::yield();
+    }
+}
+
+} // namespace chan_tap
+
+// writes records to a buffer; when it fills, the buffer goes to the recorder's writer thread,
+// so sent() never waits for the disk under the channel's lock. attach it to one channel.
+// the size of a send is SpillCodec<T>::size() where T has a codec, else sizeof(T).
+template<typename T>
+class TrafficRecorder final : public SendTap<T> {
+private:
+    int fd;
+    bool payloads;
+    std::vector<char> buf;                  // being filled by sent().
+    chan_tap::Clock::time_point last;
+    uint64_t n{0};
+    std::atomic<int> error{0};              // errno of a failed write; later records are dropped.
+
+    std::mutex lock;
+    std::condition_variable has_work;
+    std::condition_variable idle;
+    std::deque<std::vector<char>> full;     // waiting for the writer, oldest first.
+    std::vector<std::vector<char>> spare;   // written out, for reuse.
+    bool writing{false};
+    bool stopping{false};
+    std::thread writer;
+
+    static constexpr size_t flush_at = 64 << 10;
+
+    void hand_off() noexcept;
+    void write_loop();
+    void write_all(const std::vector<char>& b) noexcept;
+public:
+    // payloads: also write each element, which needs a SpillCodec<T>.
+    explicit TrafficRecorder(const std::string& path, bool payloads = false);
+    TrafficRecorder(const TrafficRecorder&) = delete;
+    TrafficRecorder& operator=(const TrafficRecorder&) = delete;
+    ~TrafficRecorder();
+
+    void sent(const T& v) noexcept override;
+
+    // writes what is buffered and waits for it; throws std::system_error if any write failed.
+    // detach the recorder (or close the channel) first.
+    void flush();
+    uint64_t count() const {return n;}
+};
+
+template<typename T>
+TrafficRecorder<T>::TrafficRecorder(const std::string& path, bool p) : payloads(p) {
+    if constexpr (!has_spill_codec<T>) {
+        if (payloads) throw std::invalid_argument("TrafficRecorder: payloads need a SpillCodec<T>");
+    }
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) throw std::system_error(errno, std::generic_category(), "TrafficRecorder: open " + path);
+    buf.reserve(flush_at + 256);
+    buf.insert(buf.end(), chan_tap::magic, chan_tap::magic + sizeof(chan_tap::magic));
+    uint32_t header[2] = {chan_tap::version, payloads ? uint32_t{chan_tap::flag_payloads} : uint32_t{0}};
+    buf.insert(buf.end(), reinterpret_cast<const char*>(header), reinterpret_cast<const char*>(header) + sizeof(header));
+    last = chan_tap::Clock::now();
+    try {
+        writer = std::thread{[this]() {write_loop();}};
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+}
+
+template<typename T>
+TrafficRecorder<T>::~TrafficRecorder() {
+    hand_off();
+    {
+        std::scoped_lock lk{lock};
+        stopping = true;
+    }
+    has_work.notify_one();
+    writer.join();
+    ::close(fd);
+}
+
+template<typename T>
+void TrafficRecorder<T>::sent(const T& v) noexcept {
+    if (error.load(std::memory_order_relaxed)) return;
+    auto now = chan_tap::Clock::now();
+    // the first send is at time 0.
+    uint64_t dt = n == 0 ? 0 : std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count();
+    last = now;
+    size_t size = sizeof(T);
+    if constexpr (has_spill_codec<T>) size = SpillCodec<T>::size(v);
+    try {
+        chan_tap::put_varint(buf, dt);
+        chan_tap::put_varint(buf, size);
+        if constexpr (has_spill_codec<T>) {
+            if (payloads) {
+                size_t at = buf.size();
+                buf.resize(at + size);
+                SpillCodec<T>::write(v, reinterpret_cast<std::byte*>(buf.data() + at));
+            }
+        }
+    } catch (const std::bad_alloc&) {
+        error = ENOMEM;
+        return;
+    }
+    n++;
+    if (buf.size() >= flush_at) hand_off();
+}
+
+// queues buf for the writer, and carries on in a spare buffer.
+template<typename T>
+void TrafficRecorder<T>::hand_off() noexcept {
+    if (buf.empty()) return;
+    try {
+        std::vector<char> next;
+        {
+            std::scoped_lock lk{lock};
+            if (!spare.empty()) {
+                next = std::move(spare.back());
+                spare.pop_back();
+            }
+            full.push_back(std::move(buf));
+        }
+        has_work.notify_one();
+        buf = std::move(next);
+        buf.reserve(flush_at + 256);
+    } catch (const std::bad_alloc&) {
+        error = ENOMEM;
+        buf.clear();
+    }
+}
+
+template<typename T>
+void TrafficRecorder<T>::write_loop() {
+    std::unique_lock<std::mutex> lk{lock};
+    while (true) {
+        has_work.wait(lk, [this] {return !full.empty() || stopping;});
+        // stopping: everything handed off before is written first.
+        if (full.empty()) return;
+        std::vector<char> b = std::move(full.front());
+        full.pop_front();
+        writing = true;
+        lk.unlock();
+        write_all(b);
+        b.clear();
+        lk.lock();
+        writing = false;
+        // a couple of spares are enough unless the disk falls behind.
+        if (spare.size() < 2) spare.push_back(std::move(b));
+        idle.notify_all();
+    }
+}
+
+template<typename T>
+void TrafficRecorder<T>::write_all(const std::vector<char>& b) noexcept {
+    size_t done = 0;
+    while (done < b.size() && !error.load(std::memory_order_relaxed)) {
+        ssize_t w = ::write(fd, b.data() + done, b.size() - done);
+        if (w < 0 && errno != EINTR) error = errno;
+        if (w > 0) done += static_cast<size_t>(w);
+    }
+}
+
+template<typename T>
+void TrafficRecorder<T>::flush() {
+    hand_off();
+    {
+        std::unique_lock<std::mutex> lk{lock};
+        idle.wait(lk, [this] {return full.empty() && !writing;});
+    }
+    if (int e = error.load()) throw std::system_error(e, std::generic_category(), "TrafficRecorder: write");
+}
+
+struct TrafficRecord {
+    uint64_t time_ns{0};                // since the first send.
+    uint64_t size{0};
+    std::vector<std::byte> payload;     // empty unless recorded with payloads.
+};
+
+class TrafficReader {
+private:
+    std::ifstream in;
+    bool payloads{false};
+    uint64_t time_ns{0};
+    uint64_t file_size{0};
+public:
+    explicit TrafficReader(const std::string& path) : in(path, std::ios::binary | std::ios::ate) {
+        if (in) {
+            file_size = static_cast<uint64_t>(in.tellg());
+            in.seekg(0);
+        }
+        char m[sizeof(chan_tap::magic)];
+        uint32_t header[2];
+        if (!in.read(m, sizeof(m)) || std::memcmp(m, chan_tap::magic, sizeof(m)) != 0
+            || !in.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != chan_tap::version) {
+            throw std::runtime_error("TrafficReader: " + path + " is not a traffic recording");
+        }
+        payloads = header[1] & chan_tap::flag_payloads;
+    }
+
+    bool has_payloads() const {return payloads;}
+
+    // the next record; false at the end, including a record cut short by a crash.
+    bool next(TrafficRecord& r) {
+        uint64_t dt;
+        if (!chan_tap::get_varint(in, dt) || !chan_tap::get_varint(in, r.size)) return false;
+        if (payloads) {
+            // a corrupt size can't make us allocate more than the file holds.
+            std::streamoff at = in.tellg();
+            if (at < 0 || r.size > file_size - static_cast<uint64_t>(at)) return false;
+        }
+        r.payload.resize(payloads ? r.size : 0);
+        if (payloads && !in.read(reinterpret_cast<char*>(r.payload.data()), static_cast<std::streamsize>(r.size))) {
+            return false;
+        }
+        time_ns += dt;
+        r.time_ns = time_ns;
+        return true;
+    }
+};
+
+// the recorded element; the recording must have payloads.
+template<typename T>
+T payload_as(const TrafficRecord& r) {
+    if (r.payload.size() != r.size) throw std::logic_error("payload_as: the recording has no payloads");
+    return SpillCodec<T>::read(r.payload.data(), r.payload.size());
+}
+
+struct ReplayOptions {
+    // 1 keeps the recorded pace, 2 replays twice as fast; 0 sends as fast as the channel takes them.
+    double speed{1.0};
+};
+
+struct ReplayStats {
+    uint64_t sent{0};
+    double mean_lateness_ns{0};     // how long after its scheduled time a send started.
+    double max_lateness_ns{0};
+    double elapsed_ns{0};
+};
+
+// sends make(record) to chan for each record, at the record's time divided by speed; make may
+// also take the scheduled time point, to stamp it into the element. stops early if chan is closed.
+// chan is any channel with send_status(), such as Chan<T>.
+template<typename C, typename Make>
+ReplayStats replay(TrafficReader& in, C& chan, Make make, ReplayOptions o = ReplayOptions()) {
+    using chan_tap::Clock;
+    ReplayStats s;
+    TrafficRecord r;
+    double lateness = 0;
+    auto start = Clock::now();
+    while (in.next(r)) {
+        auto due = start;
+        if (o.speed > 0) {
+            due += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::nano>(r.time_ns / o.speed));
+            chan_tap::wait_until(due);
+        }
+        double late = std::max(0.0, std::chrono::duration<double, std::nano>(Clock::now() - due).count());
+        auto send = [&]() {
+            if constexpr (std::is_invocable_v<Make&, const TrafficRecord&, Clock::time_point>) {
+                return chan.send_status(make(r, due));
+            } else {
+                return chan.send_status(make(r));
+            }
+        };
+        auto status = send();
+        if (status != decltype(status)::ok) break;
+        s.sent++;
+        if (o.speed > 0) {
+            lateness += late;
+            s.max_lateness_ns = std::max(s.max_lateness_ns, late);
+        }
+    }
+    s.elapsed_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    s.mean_lateness_ns = s.sent ? lateness / s.sent : 0;
+    return s;
+}
+
+#endif
@@ -0,0 +1,337 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Chrome trace-event recording of channel operations.
+//
+// Define CHAN_TRACE before including chan.h to compile the hooks in.
+// Without it, OpScope is empty and every hook is a no-op,
+// so an untraced build pays nothing.
+//
+// Each thread appends fixed-size events to its own ring buffer (no locks on the hot path),
+// and write_json() merges all rings into a trace-event JSON document that can be opened
+// offline in chrome://tracing or https://ui.perfetto.dev.
+//
+// usage:
+//     chan_trace::start();
+//     ... run the pipeline ...
+//     chan_trace::stop();
+//     chan_trace::write_json("trace.json");
+
+#include <cstdint>
+
+#ifdef CHAN_TRACE
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// number of events each thread keeps. older events are overwritten.
+#ifndef CHAN_TRACE_BUFFER_EVENTS
+#define CHAN_TRACE_BUFFER_EVENTS 65536
+#endif
+
+namespace chan_trace {
+
+enum class Kind : uint8_t {
+    send,           // slice covering a whole send (including any time blocked).
+    recv,           // slice covering a whole recv.
+    close,          // slice covering close().
+    blocked,        // slice covering the time a thread was parked on a channel.
+    flow_start,     // this thread handed off to (or released) a parked thread.
+    flow_end,       // this thread was woken by the matching flow_start.
+};
+
+// flags on send/recv slices.
+enum : uint8_t {
+    flag_nonblocking = 1,
+    flag_failed = 2,        // nonblocking op found nothing to do, or recv on closed channel.
+    flag_blocked = 4,
+};
+
+struct Event {
+    uint64_t ts;        // ns since the trace epoch.
+    uint64_t dur;       // ns, for slices.
+    const void* chan;
+    uint64_t flow_id;
+    Kind kind;
+    uint8_t flags;
+};
+
+// a thread's first event registers its ring buffer, which allocates.
+inline constexpr bool hooks_allocate = true;
+
+inline uint64_t now() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - epoch).count();
+}
+
+// single-producer ring: only the owning thread writes, write_json() reads.
+// the reader discards any slot that may have been overwritten while it was copying,
+// so flushing while threads are still tracing loses events instead of tearing them.
+class ThreadBuffer {
+private:
+    std::array<Event, CHAN_TRACE_BUFFER_EVENTS> events;
+    std::atomic<uint64_t> head{0};
+public:
+    const uint32_t tid;
+    std::string name;
+
+    explicit ThreadBuffer(uint32_t id) : tid(id), name("thread " + std::to_string(id)) {}
+
+    void push(const Event& e) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        events[h % events.size()] = e;
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    void snapshot(std::vector<Event>& out) const {
+        uint64_t h = head.load(std::memory_order_acquire);
+        uint64_t first = h > events.size() ? h - events.size() : 0;
+        size_t base = out.size();
+        for (uint64_t i = first; i < h; ++i) {
+            out.push_back(events[i % events.size()]);
+        }
+        // drop whatever the owner may have lapped while we copied.
+        uint64_t h_after = head.load(std::memory_order_acquire);
+        uint64_t overwritten = h_after > events.size() ? h_after - events.size() : 0;
+        if (overwritten > first) {
+            size_t lost = std::min<uint64_t>(overwritten - first, h - first);
+            out.erase(out.begin() + base, out.begin() + base + lost);
+        }
+    }
+
+    void clear() {
+        head.store(0, std::memory_order_release);
+    }
+};
+
+class Registry {
+private:
+    std::mutex lock;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+public:
+    std::atomic<bool> enabled{false};
+    std::atomic<uint64_t> next_flow_id{1};
+
+    std::shared_ptr<ThreadBuffer> add_thread() {
+        std::scoped_lock lck{lock};
+        auto b = std::make_shared<ThreadBuffer>(static_cast<uint32_t>(buffers.size() + 1));
+        buffers.push_back(b);
+        return b;
+    }
+
+    // buffers are shared with their threads so a thread may exit before the flush.
+    std::vector<std::shared_ptr<ThreadBuffer>> threads() {
+        std::scoped_lock lck{lock};
+        return buffers;
+    }
+};
+
+inline Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+inline ThreadBuffer& this_thread_buffer() {
+    thread_local std::shared_ptr<ThreadBuffer> buffer = registry().add_thread();
+    return *buffer;
+}
+
+inline bool enabled() {
+    return registry().enabled.load(std::memory_order_relaxed);
+}
+
+inline void record(const Event& e) {
+    this_thread_buffer().push(e);
+}
+
+inline void start() { registry().enabled = true; }
+inline void stop()  { registry().enabled = false; }
+
+// discard everything recorded so far.
+inline void clear() {
+    for (auto& b : registry().threads()) {
+        b->clear();
+    }
+}
+
+// label the calling thread in the trace viewer.
+inline void set_thread_name(const std::string& name) {
+    this_thread_buffer().name = name;
+}
+
+inline const char* kind_name(Kind k) {
+    switch (k) {
+        case Kind::send:    return "send";
+        case Kind::recv:    return "recv";
+        case Kind::close:   return "close";
+        case Kind::blocked: return "blocked";
+        default:            return "handoff";
+    }
+}
+
+// trace-event timestamps are microseconds; keep ns precision in the fraction.
+inline void write_us(std::ostream& os, uint64_t ns) {
+    os << ns / 1000 << '.';
+    uint64_t frac = ns % 1000;
+    os << static_cast<char>('0' + frac / 100)
+       << static_cast<char>('0' + frac / 10 % 10)
+       << static_cast<char>('0' + frac % 10);
+}
+
+// s as a JSON string, quotes included.
+inline void write_string(std::ostream& os, const std::string& s) {
+    static const char hex[] = "0123456789abcdef";
+    os << '"';
+    for (char c : s) {
+        auto u = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            os << '\\' << c;
+        } else if (u < 0x20) {
+            os << "\\u00" << hex[u >> 4] << hex[u & 0xf];
+        } else {
+            os << c;
+        }
+    }
+    os << '"';
+}
+
+inline void write_json(std::ostream& os) {
+    const int pid = static_cast<int>(getpid());
+    bool first = true;
+    auto sep = [&]() {
+        os << (first ? "\n" : ",\n");
+        first = false;
+    };
+
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    std::vector<Event> events;
+    for (auto& b : registry().threads()) {
+        sep();
+        os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << b->tid
+           << ",\"args\":{\"name\":";
+        write_string(os, b->name);
+        os << "}}";
+
+        events.clear();
+        b->snapshot(events);
+        for (const Event& e : events) {
+            sep();
+            os << "{\"name\":\"" << kind_name(e.kind) << "\",\"cat\":\"chan\",\"pid\":" << pid
+               << ",\"tid\":" << b->tid << ",\"ts\":";
+            write_us(os, e.ts);
+            switch (e.kind) {
+                case Kind::flow_start:
+                    os << ",\"ph\":\"s\",\"id\":" << e.flow_id;
+                    break;
+                case Kind::flow_end:
+                    // bind to the enclosing slice, i.e. the blocked send/recv.
+                    os << ",\"ph\":\"f\",\"bp\":\"e\",\"id\":" << e.flow_id;
+                    break;
+                default:
+                    os << ",\"ph\":\"X\",\"dur\":";
+                    write_us(os, e.dur);
+                    break;
+            }
+            os << ",\"args\":{\"chan\":\"" << e.chan << "\"";
+            if (e.flags & flag_nonblocking) os << ",\"nonblocking\":true";
+            if (e.flags & flag_failed)      os << ",\"failed\":true";
+            if (e.flags & flag_blocked)     os << ",\"blocked\":true";
+            os << "}}";
+        }
+    }
+    os << "\n]}\n";
+}
+
+inline bool write_json(const std::string& path) {
+    std::ofstream out(path);
+    write_json(out);
+    return static_cast<bool>(out);
+}
+
+// records one send/recv/close as a slice from construction to destruction,
+// so an operation that throws is still recorded.
+class OpScope {
+private:
+    const void* chan;
+    uint64_t start;
+    Kind kind;
+    uint8_t flags;
+    bool active;
+public:
+    OpScope(const void* c, Kind k, bool is_blocking = true)
+        : chan(c), start(0), kind(k), flags(is_blocking ? 0 : flag_nonblocking), active(enabled()) {
+        if (active) start = now();
+    }
+    OpScope(const OpScope&) = delete;
+    OpScope& operator=(const OpScope&) = delete;
+
+    void failed() { flags |= flag_failed; }
+
+    // the calling thread is about to park. returns the time to pass to woken().
+    uint64_t parking() {
+        flags |= flag_blocked;
+        return active ? now() : 0;
+    }
+
+    // the calling thread was released by whoever recorded flow_start with flow_id.
+    // flow_id 0 means the waker is unknown (ex. Spsc): the blocked slice has no flow arrow.
+    void woken(uint64_t flow_id, uint64_t parked_at) {
+        if (!active) return;
+        uint64_t t = now();
+        record({parked_at, t - parked_at, chan, 0, Kind::blocked, 0});
+        if (flow_id != 0) record({t, 0, chan, flow_id, Kind::flow_end, 0});
+    }
+
+    ~OpScope() {
+        if (!active) return;
+        record({start, now() - start, chan, 0, kind, flags});
+    }
+};
+
+// a parked thread takes a fresh flow id; whoever wakes it records flow_start with that id,
+// and the woken thread records the matching flow_end.
+inline uint64_t new_flow_id() {
+    return registry().next_flow_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+// called by the thread that releases a parked thread (under chan_lock). ids start at 1.
+inline void handoff(const void* chan, uint64_t flow_id) {
+    if (flow_id != 0 && enabled()) record({now(), 0, chan, flow_id, Kind::flow_start, 0});
+}
+
+} // namespace chan_trace
+
+#else // !CHAN_TRACE
+
+namespace chan_trace {
+
+enum class Kind : uint8_t { send, recv, close };
+
+inline constexpr bool hooks_allocate = false;
+
+class OpScope {
+public:
+    OpScope(const void*, Kind, bool = true) {}
+    void failed() {}
+    uint64_t parking() { return 0; }
+    void woken(uint64_t, uint64_t) {}
+};
+
+inline uint64_t new_flow_id() {return 0;}
+inline void handoff(const void*, uint64_t) {}
+
+} // namespace chan_trace
+
+#endif // CHAN_TRACE
+
+#endif
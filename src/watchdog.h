@@ -0,0 +1,333 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+// Deadlock and stall detection for threads parked in chan_send/chan_recv.
+//
+// Define CHAN_WATCHDOG before including chan.h to compile the hooks in.
+// Without it, Parked is empty and parking costs nothing extra.
+//
+// Go can report "all goroutines are asleep - deadlock!" because its runtime knows every goroutine.
+// we don't know which threads are expected to make progress, so threads opt in with a WorkerScope.
+// when every registered worker is parked on a channel (and no TimerScope is alive that could
+// wake one of them later) for two consecutive polls, the watchdog reports a deadlock.
+// independently, any parked thread, worker or not, that stays parked longer than
+// stall_threshold is reported once per park.
+//
+// parking costs a handful of relaxed stores to a thread-local slot; all scanning happens
+// on the watchdog thread, so it is cheap enough to leave on in staging.
+//
+// usage:
+//     chan_watchdog::start();
+//     std::thread t{[&] {
+//         chan_watchdog::WorkerScope worker{"consumer"};
+//         chan.foreach(...);
+//     }};
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace chan_watchdog {
+
+enum class Op : uint8_t { none, send, recv };
+
+// one edge of the wait graph: a thread parked on a channel.
+struct Waiter {
+    uint32_t thread_id;
+    std::string thread_name;
+    bool is_worker;
+    const void* chan;
+    Op op;
+    std::chrono::nanoseconds blocked_for;
+};
+
+struct Report {
+    // true for a deadlock report, false for a stall report.
+    bool deadlock;
+    std::vector<Waiter> waiters;
+
+    std::string to_string() const;
+};
+
+struct Config {
+    std::chrono::milliseconds poll_interval{100};
+    std::chrono::milliseconds stall_threshold{10000};
+    // default handlers print the report to stderr.
+    std::function<void(const Report&)> on_deadlock;
+    std::function<void(const Report&)> on_stall;
+};
+
+} // namespace chan_watchdog
+
+#ifdef CHAN_WATCHDOG
+
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace chan_watchdog {
+
+// a thread's first park registers its slot, which allocates.
+inline constexpr bool hooks_allocate = true;
+
+inline int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// written by its own thread with relaxed stores, read by the watchdog thread.
+struct Slot {
+    const uint32_t id;
+    std::atomic<const void*> chan{nullptr};
+    std::atomic<Op> op{Op::none};
+    std::atomic<int64_t> parked_at{0};
+    // incremented on every park, so the watchdog can tell "still parked" from "parked again".
+    std::atomic<uint64_t> generation{0};
+    std::atomic<unsigned> worker_depth{0};
+    std::atomic<bool> alive{true};
+    // last generation reported as stalled.
+    uint64_t stall_reported{0};
+
+    explicit Slot(uint32_t i) : id(i), name_("thread " + std::to_string(i)) {}
+
+    std::string name() {
+        std::scoped_lock lck{name_lock};
+        return name_;
+    }
+    void set_name(const std::string& n) {
+        std::scoped_lock lck{name_lock};
+        name_ = n;
+    }
+private:
+    std::mutex name_lock;
+    std::string name_;
+};
+
+class Registry {
+private:
+    std::mutex lock;
+    std::vector<std::shared_ptr<Slot>> slots;
+    uint32_t next_id{1};
+public:
+    std::atomic<int> pending_timers{0};
+
+    std::shared_ptr<Slot> add_thread() {
+        std::scoped_lock lck{lock};
+        auto s = std::make_shared<Slot>(next_id++);
+        slots.push_back(s);
+        return s;
+    }
+
+    // prunes exited threads as a side effect.
+    std::vector<std::shared_ptr<Slot>> threads() {
+        std::scoped_lock lck{lock};
+        std::erase_if(slots, [](const std::shared_ptr<Slot>& s) {return !s->alive;});
+        return slots;
+    }
+};
+
+inline Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+// marks the slot dead when the thread exits.
+struct SlotHolder {
+    std::shared_ptr<Slot> slot = registry().add_thread();
+    ~SlotHolder() { slot->alive = false; }
+};
+
+inline Slot& this_thread_slot() {
+    thread_local SlotHolder holder;
+    return *holder.slot;
+}
+
+// registers the calling thread as a worker for its lifetime. nests.
+class WorkerScope {
+public:
+    WorkerScope() { this_thread_slot().worker_depth++; }
+    explicit WorkerScope(const std::string& name) : WorkerScope() { this_thread_slot().set_name(name); }
+    WorkerScope(const WorkerScope&) = delete;
+    WorkerScope& operator=(const WorkerScope&) = delete;
+    ~WorkerScope() { this_thread_slot().worker_depth--; }
+};
+
+// a pending timer (ex. a thread sleeping before it sends) that may wake parked workers,
+// so the watchdog must not report a deadlock while it exists.
+class TimerScope {
+public:
+    TimerScope() { registry().pending_timers++; }
+    TimerScope(const TimerScope&) = delete;
+    TimerScope& operator=(const TimerScope&) = delete;
+    ~TimerScope() { registry().pending_timers--; }
+};
+
+// hook placed by ChanData around the wait of a blocked send or recv.
+class Parked {
+private:
+    Slot& slot;
+public:
+    Parked(const void* chan, Op op) : slot(this_thread_slot()) {
+        slot.chan.store(chan, std::memory_order_relaxed);
+        slot.parked_at.store(now_ns(), std::memory_order_relaxed);
+        slot.generation.fetch_add(1, std::memory_order_relaxed);
+        // publish op last: the watchdog only looks at slots whose op is set.
+        slot.op.store(op, std::memory_order_release);
+    }
+    Parked(const Parked&) = delete;
+    Parked& operator=(const Parked&) = delete;
+    ~Parked() {
+        slot.op.store(Op::none, std::memory_order_release);
+    }
+};
+
+inline std::string Report::to_string() const {
+    std::ostringstream os;
+    os << (deadlock ? "all workers are asleep - deadlock!" : "channel waiters blocked too long") << "\n";
+    for (const Waiter& w : waiters) {
+        os << "  " << w.thread_name << (w.is_worker ? " [worker]" : "")
+           << " -> " << (w.op == Op::send ? "send on" : "recv on") << " chan " << w.chan
+           << " for " << std::chrono::duration_cast<std::chrono::milliseconds>(w.blocked_for).count() << "ms\n";
+    }
+    return os.str();
+}
+
+inline Waiter waiter_of(Slot& s, int64_t now) {
+    return Waiter{s.id, s.name(), s.worker_depth > 0,
+        s.chan.load(std::memory_order_relaxed), s.op.load(std::memory_order_relaxed),
+        std::chrono::nanoseconds(now - s.parked_at.load(std::memory_order_relaxed))};
+}
+
+class Watchdog {
+private:
+    Config config;
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable stop_cond;
+    bool stopping{false};
+
+    // generations of the workers in the previous poll, if they were all parked.
+    std::vector<std::pair<const Slot*, uint64_t>> all_parked_before;
+    bool deadlock_reported{false};
+
+    void poll() {
+        auto slots = registry().threads();
+        int64_t now = now_ns();
+
+        Report stalled{false, {}};
+        std::vector<std::pair<const Slot*, uint64_t>> parked_workers;
+        size_t n_workers = 0;
+        for (auto& s : slots) {
+            bool parked = s->op.load(std::memory_order_acquire) != Op::none;
+            bool worker = s->worker_depth > 0;
+            n_workers += worker;
+            if (!parked) continue;
+
+            uint64_t gen = s->generation.load(std::memory_order_relaxed);
+            if (worker) parked_workers.emplace_back(s.get(), gen);
+            if (now - s->parked_at.load(std::memory_order_relaxed) > std::chrono::nanoseconds(config.stall_threshold).count()
+                && s->stall_reported != gen) {
+                s->stall_reported = gen;
+                stalled.waiters.push_back(waiter_of(*s, now));
+            }
+        }
+        if (!stalled.waiters.empty()) config.on_stall(stalled);
+
+        // a thread that was just woken still looks parked until it clears its slot,
+        // so require the same parks to be seen on two consecutive polls.
+        bool all_parked = n_workers > 0 && parked_workers.size() == n_workers && registry().pending_timers == 0;
+        if (!all_parked) {
+            all_parked_before.clear();
+            deadlock_reported = false;
+            return;
+        }
+        if (parked_workers == all_parked_before) {
+            if (!deadlock_reported) {
+                Report r{true, {}};
+                for (auto& s : slots) {
+                    if (s->op.load(std::memory_order_acquire) != Op::none) r.waiters.push_back(waiter_of(*s, now));
+                }
+                deadlock_reported = true;
+                config.on_deadlock(r);
+            }
+        } else {
+            deadlock_reported = false;
+        }
+        all_parked_before = std::move(parked_workers);
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lck{lock};
+        while (!stop_cond.wait_for(lck, config.poll_interval, [this] {return stopping;})) {
+            lck.unlock();
+            poll();
+            lck.lock();
+        }
+    }
+public:
+    explicit Watchdog(Config c) : config(std::move(c)) {
+        auto print = [](const Report& r) {std::cerr << r.to_string();};
+        if (!config.on_deadlock) config.on_deadlock = print;
+        if (!config.on_stall) config.on_stall = print;
+        thread = std::thread{&Watchdog::run, this};
+    }
+
+    ~Watchdog() {
+        {
+            std::scoped_lock lck{lock};
+            stopping = true;
+        }
+        stop_cond.notify_one();
+        thread.join();
+    }
+};
+
+inline std::unique_ptr<Watchdog>& instance() {
+    static std::unique_ptr<Watchdog> w;
+    return w;
+}
+
+// starts (or restarts with a new config) the watchdog thread.
+inline void start(Config config = {}) {
+    instance().reset();
+    instance() = std::make_unique<Watchdog>(std::move(config));
+}
+
+inline void stop() {
+    instance().reset();
+}
+
+// the current wait graph: every thread parked on a channel right now.
+inline Report snapshot() {
+    Report r{false, {}};
+    int64_t now = now_ns();
+    for (auto& s : registry().threads()) {
+        if (s->op.load(std::memory_order_acquire) != Op::none) r.waiters.push_back(waiter_of(*s, now));
+    }
+    return r;
+}
+
+} // namespace chan_watchdog
+
+#else // !CHAN_WATCHDOG
+
+namespace chan_watchdog {
+
+inline constexpr bool hooks_allocate = false;
+
+class Parked {
+public:
+    Parked(const void*, Op) {}
+};
+
+} // namespace chan_watchdog
+
+#endif // CHAN_WATCHDOG
+
+#endif